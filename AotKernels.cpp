@@ -0,0 +1,100 @@
+// AotKernels.cpp : Entry points for the libraries built by add_halide_library().
+
+#include "AotKernels.h"
+#include "CpuFeatures.h"
+
+#include "box_average.h"
+#include "box_average_integral.h"
+#include "box_average_integral_wide.h"
+#include "box_demosaic.h"
+#include "bayer_demosaic.h"
+#include "bayer_demosaic_mhc.h"
+#include "bayer_demosaic_bggr.h"
+#include "bayer_demosaic_mhc_bggr.h"
+#include "bayer_demosaic_grbg.h"
+#include "bayer_demosaic_mhc_grbg.h"
+#include "bayer_demosaic_gbrg.h"
+#include "bayer_demosaic_mhc_gbrg.h"
+#include "median_3x3.h"
+#include "median_5x5.h"
+#include "bayer_median_3x3.h"
+#include "bayer_median_5x5.h"
+#include "median_gate.h"
+#include "local_statistics.h"
+#include "brighten.h"
+
+const char* AotHostIsa() {
+    const CpuFeatures& cpu = GetCpuFeatures();
+    if (cpu.avx512) {
+        return "avx512";
+    }
+    if (cpu.avx2 && cpu.fma && cpu.f16c) {
+        return "avx2";
+    }
+    return "sse41";
+}
+
+int AotBoxAverage(halide_buffer_t* input, halide_buffer_t* output) {
+    return box_average(input, output);
+}
+
+int AotBoxAverageIntegral(halide_buffer_t* input, int radius, halide_buffer_t* output) {
+    // uint32 sums stay exact up to 65536 pixels per window (see BoxSumType())
+    if ((2 * radius + 1) * (2 * radius + 1) <= 65536) {
+        return box_average_integral(input, radius, output);
+    }
+    return box_average_integral_wide(input, radius, output);
+}
+
+int AotBoxDemosaic(halide_buffer_t* input, halide_buffer_t* output) {
+    return box_demosaic(input, output);
+}
+
+int AotBayerDemosaic(halide_buffer_t* input, halide_buffer_t* output, CfaPattern pattern) {
+    switch (pattern) {
+    case CfaPattern::BGGR:
+        return bayer_demosaic_bggr(input, output);
+    case CfaPattern::GRBG:
+        return bayer_demosaic_grbg(input, output);
+    case CfaPattern::GBRG:
+        return bayer_demosaic_gbrg(input, output);
+    default:
+        return bayer_demosaic(input, output);
+    }
+}
+
+int AotBayerDemosaicMHC(halide_buffer_t* input, halide_buffer_t* output, CfaPattern pattern) {
+    switch (pattern) {
+    case CfaPattern::BGGR:
+        return bayer_demosaic_mhc_bggr(input, output);
+    case CfaPattern::GRBG:
+        return bayer_demosaic_mhc_grbg(input, output);
+    case CfaPattern::GBRG:
+        return bayer_demosaic_mhc_gbrg(input, output);
+    default:
+        return bayer_demosaic_mhc(input, output);
+    }
+}
+
+int AotMedian(halide_buffer_t* input, int kernelSize, bool bayer, halide_buffer_t* output) {
+    switch (kernelSize) {
+    case 3:
+        return bayer ? bayer_median_3x3(input, output) : median_3x3(input, output);
+    case 5:
+        return bayer ? bayer_median_5x5(input, output) : median_5x5(input, output);
+    default:
+        return halide_error_code_generic_error;
+    }
+}
+
+int AotMedianGate(halide_buffer_t* input, float varianceThreshold, halide_buffer_t* output) {
+    return median_gate(input, varianceThreshold, output);
+}
+
+int AotLocalStatistics(halide_buffer_t* input, int radius, halide_buffer_t* mean, halide_buffer_t* variance) {
+    return local_statistics(input, radius, mean, variance);
+}
+
+int AotBrighten(halide_buffer_t* input, int factor, halide_buffer_t* output) {
+    return brighten(input, factor, output);
+}
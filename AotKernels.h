@@ -0,0 +1,31 @@
+// AotKernels.h : Ahead-of-time compiled versions of the Halide pipelines.
+//
+// Each kernel is compiled for several x86-64 feature levels into one library
+// (see SPEEDTESTS_AOT_TARGETS in CMakeLists.txt). The library's wrapper checks
+// the host CPU on the first call and runs the widest variant it supports.
+// Only available when built with SPEEDTESTS_AOT.
+
+#pragma once
+
+#include "HalideRuntime.h"
+#include "CfaPattern.h"
+
+// Radius and window size the AOT kernels were generated with.
+const int kAotBoxRadius = 3;
+const int kAotMedianKernelSize = 3;
+
+// Feature level the AOT kernels will use on this host: "avx512", "avx2" or "sse41".
+const char* AotHostIsa();
+
+// Each returns 0 on success or a halide_error_code_t.
+int AotBoxAverage(halide_buffer_t* input, halide_buffer_t* output);
+int AotBoxAverageIntegral(halide_buffer_t* input, int radius, halide_buffer_t* output);
+int AotBoxDemosaic(halide_buffer_t* input, halide_buffer_t* output);
+// One library per CFA pattern; the pattern only picks which one runs.
+int AotBayerDemosaic(halide_buffer_t* input, halide_buffer_t* output, CfaPattern pattern = CfaPattern::RGGB);
+int AotBayerDemosaicMHC(halide_buffer_t* input, halide_buffer_t* output, CfaPattern pattern = CfaPattern::RGGB);
+// kernelSize 3 or 5; anything else returns halide_error_code_generic_error.
+int AotMedian(halide_buffer_t* input, int kernelSize, bool bayer, halide_buffer_t* output);
+int AotMedianGate(halide_buffer_t* input, float varianceThreshold, halide_buffer_t* output);
+int AotLocalStatistics(halide_buffer_t* input, int radius, halide_buffer_t* mean, halide_buffer_t* variance);
+int AotBrighten(halide_buffer_t* input, int factor, halide_buffer_t* output);
@@ -0,0 +1,344 @@
+// Benchmark.cpp : Benchmark harness for the kernels in speedtests.cpp.
+
+#include "Benchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+SampleStats SampleStats::From(std::vector<double> samples) {
+    SampleStats stats;
+    stats.count = static_cast<int>(samples.size());
+    if (samples.empty()) {
+        return stats;
+    }
+    std::sort(samples.begin(), samples.end());
+
+    auto rank = [&](double percent) {
+        size_t index = static_cast<size_t>(std::ceil(percent / 100.0 * samples.size()));
+        return samples[std::min(std::max<size_t>(index, 1), samples.size()) - 1];
+    };
+
+    double total = 0.0;
+    for (double sample : samples) {
+        total += sample;
+    }
+    stats.min = samples.front();
+    stats.median = (samples.size() % 2) ? samples[samples.size() / 2]
+                                        : 0.5 * (samples[samples.size() / 2 - 1] + samples[samples.size() / 2]);
+    stats.mean = total / samples.size();
+    stats.p95 = rank(95.0);
+    stats.p99 = rank(99.0);
+    return stats;
+}
+
+double BenchResult::MPixPerSec() const {
+    return execute.median > 0.0 ? double(width) * height * frames / execute.median / 1e6 : 0.0;
+}
+
+double BenchResult::GBPerSec() const {
+    return execute.median > 0.0 ? double(bytes) / execute.median / 1e9 : 0.0;
+}
+
+double BenchResult::CountedGBPerSec() const {
+    return (counters.valid && execute.median > 0.0) ? counters.Bytes() / execute.median / 1e9 : 0.0;
+}
+
+BenchResult RunBenchCase(BenchCase& bench, const BenchOptions& options) {
+    BenchPhases& phases = bench.phases;
+    std::vector<double> load, compile, execute, store;
+
+    // The first load gives compile and warm-up something to work on.
+    if (phases.load) {
+        load.push_back(TimeSeconds(phases.load));
+    }
+    if (phases.compile) {
+        compile.push_back(TimeSeconds(phases.compile));
+    }
+    for (int i = 0; i < options.warmup; i++) {
+        phases.execute();
+    }
+    if (phases.profile) {
+        phases.profile();
+    }
+
+    // The counters are opened outside the timed call: there is one per thread.
+    HardwareCounters counters;
+    for (int i = 0; i < options.reps; i++) {
+        if (phases.load && i > 0) {
+            load.push_back(TimeSeconds(phases.load));
+        }
+        PerfCounters perf;
+        bool counting = options.counters && perf.Start();
+        execute.push_back(TimeSeconds(phases.execute));
+        if (counting) {
+            counters += perf.Stop();
+        }
+        if (phases.store) {
+            store.push_back(TimeSeconds(phases.store));
+        }
+    }
+
+    BenchResult result;
+    result.kernel = bench.kernel;
+    result.impl = bench.impl;
+    result.width = bench.width;
+    result.height = bench.height;
+    result.frames = bench.frames;
+    result.bytes = bench.bytes;
+    result.load = SampleStats::From(load);
+    result.compile = SampleStats::From(compile);
+    result.execute = SampleStats::From(execute);
+    result.store = SampleStats::From(store);
+    result.counters = counters.Scaled(1.0 / std::max(1, options.reps));
+    if (phases.profile) {
+        result.profile = phases.profile();
+    }
+    return result;
+}
+
+bool ParseBenchFormat(const std::string& name, BenchFormat& format) {
+    if (name == "table") {
+        format = BenchFormat::Table;
+    }
+    else if (name == "json") {
+        format = BenchFormat::Json;
+    }
+    else if (name == "csv") {
+        format = BenchFormat::Csv;
+    }
+    else {
+        return false;
+    }
+    return true;
+}
+
+static void writeStatsJson(std::ostream& out, const char* name, const SampleStats& stats) {
+    char line[256];
+    snprintf(line, sizeof(line),
+             "\"%s\": {\"count\": %d, \"min_ms\": %.4f, \"median_ms\": %.4f, \"mean_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f}",
+             name, stats.count, stats.min * 1e3, stats.median * 1e3, stats.mean * 1e3, stats.p95 * 1e3, stats.p99 * 1e3);
+    out << line;
+}
+
+static void writeCountersJson(std::ostream& out, const BenchResult& r) {
+    const HardwareCounters& c = r.counters;
+    char line[320];
+    snprintf(line, sizeof(line),
+             "\"counters\": {\"cycles\": %.0f, \"instructions\": %.0f, \"ipc\": %.3f, \"llc_references\": %.0f, "
+             "\"llc_misses\": %.0f, \"memory_bytes\": %.0f, \"memory_gb_per_s\": %.3f}",
+             c.cycles, c.instructions, c.IPC(), c.llcReferences, c.llcMisses, c.Bytes(), r.CountedGBPerSec());
+    out << line;
+}
+
+// Func names are Halide identifiers (letters, digits, '_', '.', '$'), so need no escaping.
+static void writeProfileJson(std::ostream& out, const PipelineProfile& profile) {
+    char line[320];
+    snprintf(line, sizeof(line), "\"profile\": {\"runs\": %d, \"ms\": %.4f, \"threads\": %.2f, \"peak_heap_bytes\": %.0f, \"funcs\": [",
+             profile.runs, profile.ms, profile.threads, profile.peakHeapBytes);
+    out << line;
+    for (size_t i = 0; i < profile.funcs.size(); i++) {
+        const FuncProfile& f = profile.funcs[i];
+        snprintf(line, sizeof(line),
+                 "%s\n     {\"name\": \"%s\", \"ms\": %.4f, \"percent\": %.1f, \"threads\": %.2f, \"peak_bytes\": %.0f, "
+                 "\"allocations\": %.1f, \"stack_bytes\": %.0f}",
+                 i ? "," : "", f.name.c_str(), f.ms, f.percent, f.threads, f.peakBytes, f.allocations, f.stackBytes);
+        out << line;
+    }
+    out << "]}";
+}
+
+static void writeJson(std::ostream& out, const std::vector<BenchResult>& results) {
+    out << "[\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        char line[256];
+        // Kernel and implementation names are plain identifiers, so need no escaping.
+        snprintf(line, sizeof(line),
+                 "  {\"kernel\": \"%s\", \"impl\": \"%s\", \"width\": %d, \"height\": %d, \"frames\": %d, "
+                 "\"bytes\": %llu, \"mpix_per_s\": %.2f, \"gb_per_s\": %.3f,\n   ",
+                 r.kernel.c_str(), r.impl.c_str(), r.width, r.height, r.frames, (unsigned long long)r.bytes,
+                 r.MPixPerSec(), r.GBPerSec());
+        out << line;
+        writeStatsJson(out, "load", r.load);
+        out << ",\n   ";
+        writeStatsJson(out, "compile", r.compile);
+        out << ",\n   ";
+        writeStatsJson(out, "execute", r.execute);
+        out << ",\n   ";
+        writeStatsJson(out, "store", r.store);
+        if (r.counters.valid) {
+            out << ",\n   ";
+            writeCountersJson(out, r);
+        }
+        if (!r.profile.empty()) {
+            out << ",\n   ";
+            writeProfileJson(out, r.profile);
+        }
+        out << (i + 1 < results.size() ? "},\n" : "}\n");
+    }
+    out << "]\n";
+}
+
+static void writeCsv(std::ostream& out, const std::vector<BenchResult>& results) {
+    bool counters = std::any_of(results.begin(), results.end(), [](const BenchResult& r) { return r.counters.valid; });
+    out << "kernel,impl,width,height,frames,bytes,mpix_per_s,gb_per_s";
+    for (const char* phase : { "load", "compile", "execute", "store" }) {
+        for (const char* stat : { "min_ms", "median_ms", "p95_ms", "p99_ms" }) {
+            out << "," << phase << "_" << stat;
+        }
+    }
+    if (counters) {
+        out << ",cycles,instructions,ipc,llc_references,llc_misses,memory_gb_per_s";
+    }
+    out << "\n";
+
+    for (const BenchResult& r : results) {
+        char line[128];
+        snprintf(line, sizeof(line), "%s,%s,%d,%d,%d,%llu,%.2f,%.3f", r.kernel.c_str(), r.impl.c_str(), r.width,
+                 r.height, r.frames, (unsigned long long)r.bytes, r.MPixPerSec(), r.GBPerSec());
+        out << line;
+        for (const SampleStats* stats : { &r.load, &r.compile, &r.execute, &r.store }) {
+            snprintf(line, sizeof(line), ",%.4f,%.4f,%.4f,%.4f", stats->min * 1e3, stats->median * 1e3, stats->p95 * 1e3,
+                     stats->p99 * 1e3);
+            out << line;
+        }
+        if (counters) {
+            const HardwareCounters& c = r.counters;
+            snprintf(line, sizeof(line), ",%.0f,%.0f,%.3f,%.0f,%.0f,%.3f", c.cycles, c.instructions, c.IPC(),
+                     c.llcReferences, c.llcMisses, r.CountedGBPerSec());
+            out << line;
+        }
+        out << "\n";
+    }
+}
+
+static void writeTable(std::ostream& out, const std::vector<BenchResult>& results) {
+    char line[256];
+    snprintf(line, sizeof(line), "%-22s %-5s %11s %9s %9s %9s %9s %9s %9s %10s\n", "kernel", "impl", "size", "load ms",
+             "compile", "min ms", "median", "p95", "p99", "MP/s");
+    out << line;
+    for (const BenchResult& r : results) {
+        char size[32];
+        if (r.frames > 1) {
+            snprintf(size, sizeof(size), "%dx%d*%d", r.width, r.height, r.frames);
+        }
+        else {
+            snprintf(size, sizeof(size), "%dx%d", r.width, r.height);
+        }
+        snprintf(line, sizeof(line), "%-22s %-5s %11s %9.3f %9.1f %9.3f %9.3f %9.3f %9.3f %10.1f  (%.2f GB/s)\n",
+                 r.kernel.c_str(), r.impl.c_str(), size, r.load.median * 1e3, r.compile.median * 1e3,
+                 r.execute.min * 1e3, r.execute.median * 1e3, r.execute.p95 * 1e3, r.execute.p99 * 1e3, r.MPixPerSec(),
+                 r.GBPerSec());
+        out << line;
+        if (r.counters.valid) {
+            snprintf(line, sizeof(line), "    IPC %.2f, %.1fM LLC misses (%.1f%% of references), %.2f GB/s from memory\n",
+                     r.counters.IPC(), r.counters.llcMisses / 1e6,
+                     r.counters.llcReferences > 0.0 ? 100.0 * r.counters.llcMisses / r.counters.llcReferences : 0.0,
+                     r.CountedGBPerSec());
+            out << line;
+        }
+        for (const FuncProfile& f : r.profile.funcs) {
+            snprintf(line, sizeof(line), "    %-28s %9.3f ms %5.1f%%  threads %5.2f  peak %.1f MB\n", f.name.c_str(), f.ms,
+                     f.percent, f.threads, f.peakBytes / 1e6);
+            out << line;
+        }
+    }
+}
+
+void WriteBenchResults(std::ostream& out, const std::vector<BenchResult>& results, BenchFormat format) {
+    switch (format) {
+    case BenchFormat::Json:
+        writeJson(out, results);
+        break;
+    case BenchFormat::Csv:
+        writeCsv(out, results);
+        break;
+    default:
+        writeTable(out, results);
+        break;
+    }
+}
+
+static std::vector<std::string> splitCsv(const std::string& line) {
+    std::vector<std::string> fields;
+    std::stringstream row(line);
+    std::string field;
+    while (std::getline(row, field, ',')) {
+        fields.push_back(field);
+    }
+    return fields;
+}
+
+bool ReadBenchResultsCsv(std::istream& in, std::vector<BenchResult>& results) {
+    std::string line;
+    if (!std::getline(in, line) || line.compare(0, 12, "kernel,impl,") != 0) {
+        return false;
+    }
+    std::vector<std::string> header = splitCsv(line);
+    auto column = [&](const std::string& name) {
+        return int(std::find(header.begin(), header.end(), name) - header.begin());
+    };
+    const int width = column("width"), height = column("height"), frames = column("frames"), bytes = column("bytes");
+    const char* phaseNames[] = { "load", "compile", "execute", "store" };
+    const char* statNames[] = { "min_ms", "median_ms", "p95_ms", "p99_ms" };
+    int stats[4][4];
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            stats[i][j] = column(std::string(phaseNames[i]) + "_" + statNames[j]);
+        }
+    }
+
+    while (std::getline(in, line)) {
+        std::vector<std::string> fields = splitCsv(line);
+        if (fields.size() != header.size()) {
+            continue;
+        }
+        auto number = [&](int index) { return index < int(fields.size()) ? atof(fields[index].c_str()) : 0.0; };
+        BenchResult r;
+        r.kernel = fields[0];
+        r.impl = fields[1];
+        r.width = int(number(width));
+        r.height = int(number(height));
+        r.frames = frames < int(fields.size()) ? std::max(1, atoi(fields[frames].c_str())) : 1;
+        r.bytes = bytes < int(fields.size()) ? strtoull(fields[bytes].c_str(), nullptr, 10) : 0;
+        SampleStats* phases[] = { &r.load, &r.compile, &r.execute, &r.store };
+        for (int i = 0; i < 4; i++) {
+            phases[i]->min = number(stats[i][0]) / 1e3;
+            phases[i]->median = number(stats[i][1]) / 1e3;
+            phases[i]->p95 = number(stats[i][2]) / 1e3;
+            phases[i]->p99 = number(stats[i][3]) / 1e3;
+        }
+        results.push_back(r);
+    }
+    return true;
+}
+
+int CompareBenchBaseline(std::ostream& out, const std::vector<BenchResult>& results,
+                         const std::vector<BenchResult>& baseline, double margin) {
+    char line[200];
+    int regressions = 0;
+    snprintf(line, sizeof(line), "%-24s %-14s %11s %11s %8s\n", "kernel", "impl", "baseline ms", "median ms", "change");
+    out << line;
+    for (const BenchResult& r : results) {
+        auto found = std::find_if(baseline.begin(), baseline.end(), [&](const BenchResult& b) {
+            return b.kernel == r.kernel && b.impl == r.impl && b.width == r.width && b.height == r.height &&
+                   b.frames == r.frames;
+        });
+        if (found == baseline.end() || found->execute.median <= 0.0) {
+            snprintf(line, sizeof(line), "%-24s %-14s %11s %11.3f %8s  not in baseline\n", r.kernel.c_str(),
+                     r.impl.c_str(), "-", r.execute.median * 1e3, "-");
+            out << line;
+            continue;
+        }
+        double change = r.execute.median / found->execute.median - 1.0;
+        bool regressed = change > margin;
+        regressions += regressed ? 1 : 0;
+        snprintf(line, sizeof(line), "%-24s %-14s %11.3f %11.3f %+7.1f%%%s\n", r.kernel.c_str(), r.impl.c_str(),
+                 found->execute.median * 1e3, r.execute.median * 1e3, 100.0 * change, regressed ? "  REGRESSED" : "");
+        out << line;
+    }
+    return regressions;
+}
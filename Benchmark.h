@@ -0,0 +1,120 @@
+// Benchmark.h : Benchmark harness for the kernels in speedtests.cpp.
+//
+// A BenchCase splits one kernel run into load, compile, execute and store
+// phases. RunBenchCase() compiles once, does warm-up runs, then times each
+// phase over N repetitions and summarizes the samples.
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "PerfCounters.h"
+#include "PipelineProfile.h"
+
+// Wall time of one call, in seconds.
+template <typename Fn>
+double TimeSeconds(Fn&& fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    return duration.count();
+}
+
+// One execute's output, widened to double so every pixel type compares alike.
+struct BenchImage {
+    int width = 0;
+    int height = 0;
+    int channels = 0;
+    std::vector<double> values;     ///< x fastest, then y, then channel
+
+    double operator()(int x, int y, int c) const { return values[(size_t(c) * height + y) * width + x]; }
+};
+
+// Phases of one kernel run. Empty phases are skipped and reported as zero samples.
+struct BenchPhases {
+    std::function<void()> load;     ///< bring the input into memory
+    std::function<void()> compile;  ///< build the code; run once before warm-up
+    std::function<void()> execute;  ///< the kernel itself
+    std::function<void()> store;    ///< write the output out
+    std::function<PipelineProfile()> profile;   ///< per-stage profile of the executes since the last call
+    std::function<BenchImage()> output;         ///< what the last execute wrote, for cross-checks
+    std::function<BenchImage(int)> frame;       ///< frame f of what a batched execute wrote
+};
+
+struct BenchCase {
+    std::string kernel;
+    std::string impl;               ///< "jit", "aot", "cpp", ...
+    int width = 0;
+    int height = 0;
+    int frames = 1;                 ///< frames of width x height per execute
+    uint64_t bytes = 0;             ///< bytes read plus written by one execute
+    BenchPhases phases;
+};
+
+struct BenchOptions {
+    int warmup = 2;
+    int reps = 10;
+    bool counters = false;          ///< count hardware events around each timed execute
+};
+
+// Summary of a set of samples, in seconds. Percentiles use the nearest rank.
+struct SampleStats {
+    int count = 0;
+    double min = 0.0;
+    double median = 0.0;
+    double mean = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+
+    static SampleStats From(std::vector<double> samples);
+};
+
+struct BenchResult {
+    std::string kernel;
+    std::string impl;
+    int width = 0;
+    int height = 0;
+    int frames = 1;
+    uint64_t bytes = 0;
+    SampleStats load;
+    SampleStats compile;
+    SampleStats execute;
+    SampleStats store;
+    HardwareCounters counters;      ///< per execute, when measured
+    PipelineProfile profile;        ///< per execute, for profiled pipelines
+
+    // Throughput at the median execute time, over all frames.
+    double MPixPerSec() const;
+    double GBPerSec() const;
+
+    // Bytes from memory per second at the median execute time, from the counters.
+    double CountedGBPerSec() const;
+};
+
+BenchResult RunBenchCase(BenchCase& bench, const BenchOptions& options);
+
+enum class BenchFormat { Table, Json, Csv };
+
+// Parse "table", "json" or "csv"; returns false for anything else.
+bool ParseBenchFormat(const std::string& name, BenchFormat& format);
+
+void WriteBenchResults(std::ostream& out, const std::vector<BenchResult>& results, BenchFormat format);
+
+// Read results back from WriteBenchResults() CSV, appending them to results.
+// Columns are found by name, so files from before a column was added still
+// read. Sample counts and means are not in the CSV and stay zero. Returns
+// false if the header is missing.
+bool ReadBenchResultsCsv(std::istream& in, std::vector<BenchResult>& results);
+
+// Check results against a baseline read back with ReadBenchResultsCsv(). A
+// result regresses when its median execute time is more than margin (0.1 for
+// 10%) above the baseline's for the same kernel, implementation, size and frames.
+// Prints one line per result and returns how many regressed.
+int CompareBenchBaseline(std::ostream& out, const std::vector<BenchResult>& results,
+                         const std::vector<BenchResult>& baseline, double margin);
@@ -0,0 +1,76 @@
+// CfaPattern.h : The four 2x2 Bayer color filter array layouts.
+//
+// Each pattern is named by its top-left quad read row by row, so RGGB has red
+// at (0, 0) and blue at (1, 1). Every layout is RGGB shifted by the position
+// of its red pixel, which is how the demosaics specialize on it.
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+enum class CfaPattern {
+    RGGB,
+    BGGR,
+    GRBG,
+    GBRG,
+};
+
+const CfaPattern kCfaPatterns[] = { CfaPattern::RGGB, CfaPattern::BGGR, CfaPattern::GRBG, CfaPattern::GBRG };
+
+// Column and row of the red pixel within each 2x2 quad.
+inline int CfaRedX(CfaPattern pattern) {
+    return (pattern == CfaPattern::BGGR || pattern == CfaPattern::GRBG) ? 1 : 0;
+}
+
+inline int CfaRedY(CfaPattern pattern) {
+    return (pattern == CfaPattern::BGGR || pattern == CfaPattern::GBRG) ? 1 : 0;
+}
+
+// "rggb", "bggr", "grbg" or "gbrg".
+inline const char* CfaPatternName(CfaPattern pattern) {
+    switch (pattern) {
+    case CfaPattern::BGGR:
+        return "bggr";
+    case CfaPattern::GRBG:
+        return "grbg";
+    case CfaPattern::GBRG:
+        return "gbrg";
+    default:
+        return "rggb";
+    }
+}
+
+// Parse a name as printed by CfaPatternName(), in either case.
+inline bool ParseCfaPattern(const char* name, CfaPattern& pattern) {
+    for (CfaPattern candidate : kCfaPatterns) {
+        const char* expected = CfaPatternName(candidate);
+        size_t i = 0;
+        while (i < 4 && name[i] != '\0' && (name[i] | 0x20) == expected[i]) {
+            i++;
+        }
+        if (i == 4 && name[4] == '\0') {
+            pattern = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Pattern of a 2x2 quad given as TIFF/EP CFAPattern colors, row by row
+// (0 = red, 1 = green, 2 = blue). Returns false for anything but a Bayer quad.
+inline bool CfaPatternFromColors(const uint8_t colors[4], CfaPattern& pattern) {
+    for (CfaPattern candidate : kCfaPatterns) {
+        int rx = CfaRedX(candidate), ry = CfaRedY(candidate);
+        uint8_t expected[4];
+        expected[ry * 2 + rx] = 0;
+        expected[ry * 2 + (1 - rx)] = 1;
+        expected[(1 - ry) * 2 + rx] = 1;
+        expected[(1 - ry) * 2 + (1 - rx)] = 2;
+        if (memcmp(colors, expected, 4) == 0) {
+            pattern = candidate;
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,72 @@
+#include "CpuFeatures.h"
+
+#if defined(TOC_X86)
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(TOC_X86)
+static void cpuid(int leaf, int subLeaf, unsigned regs[4]) {
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuidex(info, leaf, subLeaf);
+	for (int i = 0; i < 4; i++) {
+		regs[i] = static_cast<unsigned>(info[i]);
+	}
+#else
+	__cpuid_count(leaf, subLeaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// Register state the OS saves on context switch (XCR0).
+static unsigned long long xgetbv0() {
+#if defined(_MSC_VER)
+	return _xgetbv(0);
+#else
+	unsigned lo, hi;
+	__asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+	return (static_cast<unsigned long long>(hi) << 32) | lo;
+#endif
+}
+#endif
+
+static CpuFeatures detectCpuFeatures() {
+	CpuFeatures features;
+#if defined(TOC_X86)
+	unsigned regs[4];
+	cpuid(0, 0, regs);
+	unsigned maxLeaf = regs[0];
+
+	cpuid(1, 0, regs);
+	features.ssse3 = (regs[2] & (1u << 9)) != 0;
+	features.sse41 = (regs[2] & (1u << 19)) != 0;
+	features.fma = (regs[2] & (1u << 12)) != 0;
+	features.f16c = (regs[2] & (1u << 29)) != 0;
+	bool osxsave = (regs[2] & (1u << 27)) != 0;
+	bool avxCpu = (regs[2] & (1u << 28)) != 0;
+
+	// AVX needs the OS to save the YMM state, AVX-512 also the opmask and ZMM state.
+	unsigned long long xcr0 = osxsave ? xgetbv0() : 0;
+	bool ymmSaved = (xcr0 & 0x6) == 0x6;
+	bool zmmSaved = (xcr0 & 0xE6) == 0xE6;
+
+	features.avx = avxCpu && ymmSaved;
+	features.fma = features.fma && features.avx;
+	features.f16c = features.f16c && features.avx;
+	if (maxLeaf >= 7) {
+		cpuid(7, 0, regs);
+		features.avx2 = features.avx && (regs[1] & (1u << 5)) != 0;
+		const unsigned avx512Bits = (1u << 16) | (1u << 17) | (1u << 28) | (1u << 30) | (1u << 31);	// F, DQ, CD, BW, VL
+		features.avx512 = features.avx2 && zmmSaved && (regs[1] & avx512Bits) == avx512Bits;
+	}
+#endif
+	return features;
+}
+
+const CpuFeatures& GetCpuFeatures() {
+	static const CpuFeatures features = detectCpuFeatures();
+	return features;
+}
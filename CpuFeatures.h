@@ -0,0 +1,28 @@
+#pragma once
+// Runtime detection of the x86 vector extensions our hand-written kernels use.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TOC_X86 1
+#endif
+
+// GCC and Clang only emit intrinsics for ISAs enabled on the function; MSVC always does.
+#if defined(TOC_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TOC_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define TOC_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TOC_TARGET_SSSE3
+#define TOC_TARGET_AVX2
+#endif
+
+struct CpuFeatures {
+	bool ssse3 = false;
+	bool sse41 = false;
+	bool avx = false;
+	bool avx2 = false;
+	bool fma = false;
+	bool f16c = false;
+	bool avx512 = false;	///< AVX-512 F, CD, VL, BW and DQ (Skylake server level)
+};
+
+// Features of the host CPU, detected once. All false on non-x86 hosts.
+const CpuFeatures& GetCpuFeatures();
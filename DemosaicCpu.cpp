@@ -0,0 +1,269 @@
+// DemosaicCpu.cpp : Hand-written bilinear demosaic.
+
+#include "DemosaicCpu.h"
+#include "CpuFeatures.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#if defined(TOC_X86)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// The four kinds of CFA site. Gr is a green on a row with red, Gb a green on
+// a row with blue.
+enum class Site { R, Gr, Gb, B };
+
+// Source rows above, at and below the output row, already mirrored at the
+// top and bottom edges, and the three output rows.
+struct RowPtrs {
+    const uint16_t* up;
+    const uint16_t* mid;
+    const uint16_t* dn;
+    uint16_t* out[3];
+};
+
+// Exact rounded averages, as Average2()/Average4() in HalideAverages.h.
+inline uint16_t avg2(uint32_t a, uint32_t b) {
+    return uint16_t((a + b + 1) / 2);
+}
+
+inline uint16_t avg4(uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    return uint16_t((a + b + c + d + 2) / 4);
+}
+
+// RGB at column x of a kSite pixel; xl and xr are its (mirrored) neighbours.
+template <Site kSite>
+inline void pixel(const RowPtrs& rows, int xl, int x, int xr) {
+    uint16_t c = rows.mid[x];
+    uint16_t r, g, b;
+    if (kSite == Site::R || kSite == Site::B) {
+        uint16_t cross = avg4(rows.mid[xl], rows.mid[xr], rows.up[x], rows.dn[x]);
+        uint16_t diag = avg4(rows.up[xl], rows.up[xr], rows.dn[xl], rows.dn[xr]);
+        r = (kSite == Site::R) ? c : diag;
+        g = cross;
+        b = (kSite == Site::R) ? diag : c;
+    }
+    else {
+        uint16_t h2 = avg2(rows.mid[xl], rows.mid[xr]);
+        uint16_t v2 = avg2(rows.up[x], rows.dn[x]);
+        r = (kSite == Site::Gr) ? h2 : v2;
+        g = c;
+        b = (kSite == Site::Gr) ? v2 : h2;
+    }
+    rows.out[0][x] = r;
+    rows.out[1][x] = g;
+    rows.out[2][x] = b;
+}
+
+// Columns [x0, x1) of a row whose even columns are kEven sites and odd
+// columns kOdd sites. Only columns 0 and width - 1 need mirroring.
+template <Site kEven, Site kOdd>
+void scalarRow(const RowPtrs& rows, int x0, int x1, int width) {
+    int x = x0;
+    if (x == 0) {
+        pixel<kEven>(rows, 1, 0, 1);
+        x++;
+    }
+    int interiorEnd = std::min(x1, width - 1);
+    if (x < interiorEnd && (x & 1)) {
+        pixel<kOdd>(rows, x - 1, x, x + 1);
+        x++;
+    }
+    for (; x + 1 < interiorEnd; x += 2) {
+        pixel<kEven>(rows, x - 1, x, x + 1);
+        pixel<kOdd>(rows, x, x + 1, x + 2);
+    }
+    if (x < interiorEnd) {
+        pixel<kEven>(rows, x - 1, x, x + 1);
+        x++;
+    }
+    if (x < x1 && x == width - 1) {
+        if (x & 1) {
+            pixel<kOdd>(rows, x - 1, x, x - 1);
+        }
+        else {
+            pixel<kEven>(rows, x - 1, x, x - 1);
+        }
+    }
+}
+
+#if defined(TOC_X86)
+
+TOC_TARGET_AVX2 inline __m256i load(const uint16_t* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+// (a + b + c + d + 2) / 4 per lane, kept in 16 bits as Average4() does: three
+// rounding averages, less one where a pair average rounded up and the two pair
+// averages have an odd sum.
+TOC_TARGET_AVX2 inline __m256i avg4(__m256i a, __m256i b, __m256i c, __m256i d) {
+    const __m256i one = _mm256_set1_epi16(1);
+    __m256i ab = _mm256_avg_epu16(a, b);
+    __m256i cd = _mm256_avg_epu16(c, d);
+    __m256i overshoot = _mm256_and_si256(_mm256_or_si256(_mm256_xor_si256(a, b), _mm256_xor_si256(c, d)),
+                                         _mm256_xor_si256(ab, cd));
+    return _mm256_sub_epi16(_mm256_avg_epu16(ab, cd), _mm256_and_si256(overshoot, one));
+}
+
+// Every candidate value for 16 pixels; each site picks three of them.
+struct Candidates {
+    __m256i c, cross, diag, h2, v2;
+};
+
+template <Site kSite>
+TOC_TARGET_AVX2 inline __m256i pick(const Candidates& v, int plane) {
+    switch (kSite) {
+    case Site::R:
+        return plane == 0 ? v.c : plane == 1 ? v.cross : v.diag;
+    case Site::Gr:
+        return plane == 0 ? v.h2 : plane == 1 ? v.c : v.v2;
+    case Site::Gb:
+        return plane == 0 ? v.v2 : plane == 1 ? v.c : v.h2;
+    default:
+        return plane == 0 ? v.diag : plane == 1 ? v.cross : v.c;
+    }
+}
+
+// Columns [x0, x1) of the row, x0 even. The first vector starts at column 2
+// so that lane parity is column parity and no load crosses the left edge;
+// the scalar loop finishes both ends.
+template <Site kEven, Site kOdd>
+TOC_TARGET_AVX2 void avx2Row(const RowPtrs& rows, int x0, int x1, int width) {
+    int x = std::max(x0, 2);
+    int vectorEnd = std::min(x1, width - 1);
+    if (x0 < x) {
+        scalarRow<kEven, kOdd>(rows, x0, std::min(x, x1), width);
+    }
+    for (; x + 16 <= vectorEnd; x += 16) {
+        Candidates v;
+        __m256i left = load(rows.mid + x - 1), right = load(rows.mid + x + 1);
+        __m256i up = load(rows.up + x), dn = load(rows.dn + x);
+        v.c = load(rows.mid + x);
+        v.h2 = _mm256_avg_epu16(left, right);
+        v.v2 = _mm256_avg_epu16(up, dn);
+        v.cross = avg4(left, right, up, dn);
+        v.diag = avg4(load(rows.up + x - 1), load(rows.up + x + 1), load(rows.dn + x - 1), load(rows.dn + x + 1));
+        for (int plane = 0; plane < 3; plane++) {
+            // 0xAA takes the odd lanes from the second operand.
+            __m256i out = _mm256_blend_epi16(pick<kEven>(v, plane), pick<kOdd>(v, plane), 0xAA);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(rows.out[plane] + x), out);
+        }
+    }
+    if (x < x1) {
+        scalarRow<kEven, kOdd>(rows, x, x1, width);
+    }
+}
+
+#endif
+
+using RowFn = void (*)(const RowPtrs&, int, int, int);
+
+// Even rows hold kEven0 and kOdd0 sites, odd rows kEven1 and kOdd1. Each
+// pattern instantiates its own rows, so the loops never test the pattern.
+template <Site kEven0, Site kOdd0, Site kEven1, Site kOdd1>
+void patternRows(bool avx2, RowFn& evenRow, RowFn& oddRow) {
+#if defined(TOC_X86)
+    if (avx2) {
+        evenRow = avx2Row<kEven0, kOdd0>;
+        oddRow = avx2Row<kEven1, kOdd1>;
+        return;
+    }
+#endif
+    evenRow = scalarRow<kEven0, kOdd0>;
+    oddRow = scalarRow<kEven1, kOdd1>;
+}
+
+void selectRows(CfaPattern pattern, bool avx2, RowFn& evenRow, RowFn& oddRow) {
+    switch (pattern) {
+    case CfaPattern::BGGR:
+        patternRows<Site::B, Site::Gb, Site::Gr, Site::R>(avx2, evenRow, oddRow);
+        break;
+    case CfaPattern::GRBG:
+        patternRows<Site::Gr, Site::R, Site::B, Site::Gb>(avx2, evenRow, oddRow);
+        break;
+    case CfaPattern::GBRG:
+        patternRows<Site::Gb, Site::B, Site::R, Site::Gr>(avx2, evenRow, oddRow);
+        break;
+    default:
+        patternRows<Site::R, Site::Gr, Site::Gb, Site::B>(avx2, evenRow, oddRow);
+        break;
+    }
+}
+
+int mirror(int i, int n) {
+    return i < 0 ? -i : (i >= n ? 2 * (n - 1) - i : i);
+}
+
+}  // namespace
+
+const char* CpuKernelName(CpuKernel kernel) {
+    if (kernel == CpuKernel::Auto) {
+        kernel = GetCpuFeatures().avx2 ? CpuKernel::Avx2 : CpuKernel::Scalar;
+    }
+    return kernel == CpuKernel::Avx2 ? "avx2" : "scalar";
+}
+
+bool BayerDemosaicBilinear(const uint16_t* src, ptrdiff_t srcStride, uint16_t* dst, ptrdiff_t dstStride,
+                           ptrdiff_t dstPlaneStride, uint32_t width, uint32_t height, CfaPattern pattern,
+                           unsigned nThreads, CpuKernel kernel) {
+    if (width < 2 || height < 2) {
+        return false;
+    }
+    if (kernel == CpuKernel::Auto) {
+        kernel = GetCpuFeatures().avx2 ? CpuKernel::Avx2 : CpuKernel::Scalar;
+    }
+
+    if (kernel == CpuKernel::Avx2) {
+#if defined(TOC_X86)
+        if (!GetCpuFeatures().avx2) {
+            return false;
+        }
+#else
+        return false;
+#endif
+    }
+    RowFn evenRow, oddRow;
+    selectRows(pattern, kernel == CpuKernel::Avx2, evenRow, oddRow);
+
+    int w = int(width), h = int(height);
+    int nBands = (h + kDemosaicBandRows - 1) / kDemosaicBandRows;
+    std::atomic<int> nextBand(0);
+
+    auto worker = [&]() {
+        for (int band = nextBand++; band < nBands; band = nextBand++) {
+            int y1 = std::min(h, (band + 1) * kDemosaicBandRows);
+            for (int y = band * kDemosaicBandRows; y < y1; y++) {
+                RowPtrs rows;
+                rows.up = src + mirror(y - 1, h) * srcStride;
+                rows.mid = src + y * srcStride;
+                rows.dn = src + mirror(y + 1, h) * srcStride;
+                for (int c = 0; c < 3; c++) {
+                    rows.out[c] = dst + c * dstPlaneStride + y * dstStride;
+                }
+                ((y & 1) ? oddRow : evenRow)(rows, 0, w, w);
+            }
+        }
+    };
+
+    if (nThreads == 0) {
+        nThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    nThreads = std::min<unsigned>(nThreads, nBands);
+    if (nThreads <= 1) {
+        worker();
+        return true;
+    }
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < nThreads; i++) {
+        threads.emplace_back(worker);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    return true;
+}
@@ -0,0 +1,37 @@
+// DemosaicCpu.h : Hand-written bilinear demosaic, the C++ counterpart of
+// DefineBayerDemosaic() in HalidePipelines.h.
+//
+// Same interpolation, rounding and mirror_interior edges as the Halide pipeline,
+// so the two outputs are identical bit for bit. The inner loops are AVX2
+// intrinsics (16 pixels per vector) with a scalar fallback. Row bands are
+// handed out to the threads through an atomic counter.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "CfaPattern.h"
+
+// Which inner loops to run. Auto picks AVX2 when the CPU has it.
+enum class CpuKernel {
+    Auto,
+    Scalar,
+    Avx2,
+};
+
+// Rows per band handed to a thread.
+const int kDemosaicBandRows = 32;
+
+// Bilinear demosaic of a Bayer mosaic into planar RGB. Strides are in pixels;
+// plane c of the output starts at dst + c * dstPlaneStride. Each CFA pattern
+// runs its own template instantiation of the row loops. Runs on nThreads
+// threads (0 = all cores). Returns false for images smaller than 2 x 2, or
+// when AVX2 is requested on a CPU without it.
+bool BayerDemosaicBilinear(const uint16_t* src, ptrdiff_t srcStride, uint16_t* dst, ptrdiff_t dstStride,
+                           ptrdiff_t dstPlaneStride, uint32_t width, uint32_t height,
+                           CfaPattern pattern = CfaPattern::RGGB, unsigned nThreads = 0,
+                           CpuKernel kernel = CpuKernel::Auto);
+
+// Name of the kernel Auto resolves to on this CPU: "avx2" or "scalar".
+const char* CpuKernelName(CpuKernel kernel);
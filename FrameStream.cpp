@@ -0,0 +1,198 @@
+// FrameStream.cpp : Overlapped read -> process -> write over a sequence of frames.
+
+#include "FrameStream.h"
+#include "Benchmark.h"
+#include "PGMImage.h"
+#include "TiffSrcFile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+StreamFrame::StreamFrame() = default;
+StreamFrame::~StreamFrame() = default;
+
+static std::string lowerExtension(const std::filesystem::path& path) {
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char ch) { return char(tolower(ch)); });
+    return ext;
+}
+
+static bool hasFrameExtension(const std::filesystem::path& path) {
+    std::string ext = lowerExtension(path);
+    return ext == ".tif" || ext == ".tiff" || ext == ".pgm";
+}
+
+std::vector<std::string> ListStreamFrames(const std::string& dirOrList) {
+    std::vector<std::string> names;
+    std::error_code error;
+    if (std::filesystem::is_directory(dirOrList, error)) {
+        for (const auto& entry : std::filesystem::directory_iterator(dirOrList, error)) {
+            if (entry.is_regular_file() && hasFrameExtension(entry.path())) {
+                names.push_back(entry.path().string());
+            }
+        }
+        std::sort(names.begin(), names.end());
+        return names;
+    }
+
+    std::ifstream list(dirOrList);
+    std::string line;
+    while (std::getline(list, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty()) {
+            names.push_back(line);
+        }
+    }
+    return names;
+}
+
+// Read one TIFF or PGM mosaic into frame.raw, reusing its block. A PGM is
+// mapped rather than read and swapped straight into the block's rows.
+static bool readFrame(StreamFrame& frame) {
+    if (lowerExtension(frame.inputName) == ".pgm") {
+        PGMImage image(frame.inputName, PGMImage::LoadMode::MapView);
+        if (image.view() == nullptr) {
+            return false;
+        }
+        frame.width = image.width();
+        frame.height = image.height();
+        if (frame.raw.Alloc(frame.width, frame.height) != kNoError) {
+            return false;
+        }
+        for (uint32_t y = 0; y < frame.height; y++) {
+            image.copyRow(y, frame.raw.GetRowPtr(y));
+        }
+        return true;
+    }
+
+    TiffSrcFile tiff;
+    if (tiff.OpenFile(frame.inputName.c_str()) != kNoError) {
+        return false;
+    }
+    bool ok = tiff.ReadMonochromeStrips(frame.raw) == kNoError;
+    frame.width = tiff.getWidth();
+    frame.height = tiff.getHeight();
+    tiff.CloseFile();
+    return ok;
+}
+
+static std::string outputNameFor(const std::string& inputName, const std::string& outputDir) {
+    std::filesystem::path stem = std::filesystem::path(inputName).stem();
+    return (std::filesystem::path(outputDir) / (stem.string() + "_rgb.pgm")).string();
+}
+
+double StreamReport::FramesPerSecond() const {
+    return wallSeconds > 0.0 ? frames / wallSeconds : 0.0;
+}
+
+void StreamReport::Print(std::ostream& out) const {
+    char line[160];
+    snprintf(line, sizeof(line), "Streamed %zu frames (%zu failed) in %.2f s: %.2f frames/s, %.1f MP/s\n", frames,
+        failed, wallSeconds, FramesPerSecond(), wallSeconds > 0.0 ? pixels / wallSeconds / 1e6 : 0.0);
+    out << line;
+    snprintf(line, sizeof(line), "  %zu mosaic buffers allocated\n", allocations);
+    out << line;
+
+    const StageStats* slowest = &stages[0];
+    for (const StageStats& stage : stages) {
+        double utilization = wallSeconds > 0.0 ? 100.0 * stage.busySeconds / wallSeconds : 0.0;
+        double perFrame = stage.frames ? 1e3 * stage.busySeconds / stage.frames : 0.0;
+        snprintf(line, sizeof(line), "  %-8s busy %5.1f%%  %8.2f ms/frame\n", stage.name.c_str(), utilization, perFrame);
+        out << line;
+        if (stage.busySeconds > slowest->busySeconds) {
+            slowest = &stage;
+        }
+    }
+    double serial = stages[0].busySeconds + stages[1].busySeconds + stages[2].busySeconds;
+    snprintf(line, sizeof(line), "  bound by: %s; the stages sum to %.2f s run one after another\n",
+        slowest->name.c_str(), serial);
+    out << line;
+}
+
+StreamReport RunFrameStream(const std::vector<std::string>& inputs, const FrameProcessor& process,
+                            const StreamOptions& options) {
+    using FramePtr = std::unique_ptr<StreamFrame>;
+    size_t depth = std::max(1u, options.queueDepth);
+
+    // Every frame is always in exactly one queue or held by one stage. The
+    // pool is declared first so it outlives the frames' mosaics.
+    CTocFramePool pool;
+    BoundedQueue<FramePtr> freeFrames(depth), toCompute(depth), toWrite(depth);
+    for (size_t i = 0; i < depth; i++) {
+        FramePtr frame(new StreamFrame());
+        frame->raw.SetPool(&pool);
+        freeFrames.Push(std::move(frame));
+    }
+
+    StreamReport report;
+    report.stages[0].name = "read";
+    report.stages[1].name = "compute";
+    report.stages[2].name = "write";
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread reader([&]() {
+        StageStats& stats = report.stages[0];
+        for (size_t i = 0; i < inputs.size(); i++) {
+            FramePtr frame;
+            if (!freeFrames.Pop(frame)) {
+                break;
+            }
+            frame->index = i;
+            frame->inputName = inputs[i];
+            stats.busySeconds += TimeSeconds([&]() { frame->ok = readFrame(*frame); });
+            stats.frames++;
+            toCompute.Push(std::move(frame));
+        }
+        toCompute.Close();
+    });
+
+    std::thread computer([&]() {
+        StageStats& stats = report.stages[1];
+        FramePtr frame;
+        while (toCompute.Pop(frame)) {
+            if (frame->ok) {
+                stats.busySeconds += TimeSeconds([&]() { frame->ok = process(*frame); });
+                stats.frames++;
+            }
+            toWrite.Push(std::move(frame));
+        }
+        toWrite.Close();
+    });
+
+    // The writer runs here and hands each frame back to the reader.
+    StageStats& writeStats = report.stages[2];
+    FramePtr frame;
+    while (toWrite.Pop(frame)) {
+        if (frame->ok && !options.outputDir.empty()) {
+            frame->outputName = outputNameFor(frame->inputName, options.outputDir);
+            writeStats.busySeconds += TimeSeconds([&]() { frame->ok = frame->output->Write(frame->outputName); });
+            writeStats.frames++;
+        }
+        if (frame->ok) {
+            report.frames++;
+            report.pixels += uint64_t(frame->width) * frame->height;
+        }
+        else {
+            report.failed++;
+            fprintf(stderr, "Frame %zu (%s) failed\n", frame->index, frame->inputName.c_str());
+        }
+        freeFrames.Push(std::move(frame));
+    }
+
+    freeFrames.Close();
+    reader.join();
+    computer.join();
+
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+    report.wallSeconds = wall.count();
+    report.allocations = pool.GetAllocCount();
+    return report;
+}
@@ -0,0 +1,119 @@
+// FrameStream.h : Overlapped read -> process -> write over a sequence of frames.
+//
+// A reader, a compute and a writer thread run concurrently, connected by
+// bounded queues. A fixed pool of frames circulates through them, so the
+// buffers are reused and at most queueDepth frames are in flight. A batch then
+// runs at the rate of its slowest stage instead of the sum of all three.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "TocMatrix.h"
+
+class PGMImage;
+
+// Blocking FIFO with a fixed capacity. Close() wakes every waiter; Pop() then
+// drains what is left and returns false once the queue is empty.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) : mCapacity(capacity) {}
+
+    // Returns false if the queue was closed.
+    bool Push(T item) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNotFull.wait(lock, [&]() { return mClosed || mItems.size() < mCapacity; });
+        if (mClosed) {
+            return false;
+        }
+        mItems.push_back(std::move(item));
+        mNotEmpty.notify_one();
+        return true;
+    }
+
+    bool Pop(T& item) {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mNotEmpty.wait(lock, [&]() { return mClosed || !mItems.empty(); });
+        if (mItems.empty()) {
+            return false;
+        }
+        item = std::move(mItems.front());
+        mItems.pop_front();
+        mNotFull.notify_one();
+        return true;
+    }
+
+    void Close() {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mClosed = true;
+        mNotEmpty.notify_all();
+        mNotFull.notify_all();
+    }
+
+private:
+    std::mutex mMutex;
+    std::condition_variable mNotEmpty;
+    std::condition_variable mNotFull;
+    std::deque<T> mItems;
+    size_t mCapacity;
+    bool mClosed = false;
+};
+
+// One frame in flight. The buffers keep their capacity from frame to frame.
+struct StreamFrame {
+    size_t index = 0;
+    std::string inputName;
+    std::string outputName;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    CTocMatrix<uint16_t> raw;           ///< the mosaic, width x height, aligned rows
+    std::unique_ptr<PGMImage> output;   ///< planar RGB stacked vertically: width x (3 * height)
+    bool ok = false;                    ///< cleared by any stage that fails
+
+    StreamFrame();
+    ~StreamFrame();
+};
+
+struct StreamOptions {
+    unsigned queueDepth = 3;            ///< frames in flight, one per stage at minimum
+    std::string outputDir;              ///< empty: processed frames are not written
+};
+
+// Time one stage spent working, as opposed to waiting on its queues.
+struct StageStats {
+    std::string name;
+    double busySeconds = 0.0;
+    size_t frames = 0;
+};
+
+struct StreamReport {
+    size_t frames = 0;
+    size_t failed = 0;
+    double wallSeconds = 0.0;
+    uint64_t pixels = 0;
+    StageStats stages[3];               ///< read, compute, write
+    size_t allocations = 0;             ///< mosaic buffers allocated; stays at the queue depth in steady state
+
+    double FramesPerSecond() const;
+    void Print(std::ostream& out) const;
+};
+
+// Fills frame.output from frame.raw; returns false on failure. frame.raw may
+// have padded rows: see CTocMatrix::GetStride().
+using FrameProcessor = std::function<bool(StreamFrame& frame)>;
+
+// The frames of a capture: the TIFF and PGM files in a directory, sorted by
+// name, or the lines of a text file listing one frame per line.
+std::vector<std::string> ListStreamFrames(const std::string& dirOrList);
+
+StreamReport RunFrameStream(const std::vector<std::string>& inputs, const FrameProcessor& process,
+                            const StreamOptions& options);
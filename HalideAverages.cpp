@@ -0,0 +1,67 @@
+// HalideAverages.cpp : Exact, rounded averages of integer pixels as Halide expressions.
+
+#include "HalideAverages.h"
+
+using namespace Halide;
+
+Expr Average2(Expr a, Expr b) {
+    if (a.type().is_float()) {
+        return (a + b) / 2;
+    }
+    return rounding_halving_add(a, b);
+}
+
+Expr Average4(Expr a, Expr b, Expr c, Expr d) {
+    if (a.type().is_float()) {
+        return (a + b + c + d) / 4;
+    }
+    // ab and cd each round up when their pair's sum is odd. Rounding ab + cd
+    // up again overshoots by one exactly when one of them did and ab + cd is odd.
+    Expr ab = rounding_halving_add(a, b);
+    Expr cd = rounding_halving_add(c, d);
+    Expr overshoot = ((a ^ b) | (c ^ d)) & (ab ^ cd) & 1;
+    return rounding_halving_add(ab, cd) - overshoot;
+}
+
+Expr WeightedAverage(const std::vector<WeightedTaps>& taps) {
+    Type type = taps.front().values.front().type();
+    bool negative = false;
+    int total = 0;
+    for (const WeightedTaps& tap : taps) {
+        negative = negative || tap.weight < 0;
+        total += tap.weight * int(tap.values.size());
+    }
+    Type wide = (negative || type.is_int()) ? Int(2 * type.bits()) : UInt(2 * type.bits());
+    if (type.is_float()) {
+        wide = type;
+    }
+
+    Expr sum;
+    for (const WeightedTaps& tap : taps) {
+        Expr group;
+        for (const Expr& value : tap.values) {
+            group = group.defined() ? group + cast(wide, value) : cast(wide, value);
+        }
+        Expr term = (tap.weight == 1) ? group : group * tap.weight;
+        sum = sum.defined() ? sum + term : term;
+    }
+
+    if (type.is_float()) {
+        return sum / total;
+    }
+    Expr average;
+    if ((total & (total - 1)) == 0) {
+        int shift = 0;
+        while ((1 << shift) < total) {
+            shift++;
+        }
+        average = (shift == 0) ? sum : rounding_shift_right(sum, cast(wide, shift));
+    }
+    else {
+        average = (sum + total / 2) / total;
+    }
+    if (negative) {
+        average = clamp(average, cast(wide, type.min()), cast(wide, type.max()));
+    }
+    return cast(type, average);
+}
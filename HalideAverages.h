@@ -0,0 +1,34 @@
+// HalideAverages.h : Exact, rounded averages of integer pixels as Halide
+// expressions, for the interpolating kernels in HalidePipelines.cpp.
+//
+// Each result equals the sum taken in unbounded integers, rounded half up and
+// divided, so bright 16-bit pixels never wrap. They are built from Halide's
+// halving and widening intrinsics rather than by widening every lane: the
+// 2- and 4-tap averages stay in the input type (pavgb/pavgw on x86, urhadd on
+// ARM), and the weighted sums use widening multiplies and a rounding, narrowing
+// shift.
+
+#pragma once
+
+#include <vector>
+
+#include "Halide.h"
+
+// (a + b + 1) / 2.
+Halide::Expr Average2(Halide::Expr a, Halide::Expr b);
+
+// (a + b + c + d + 2) / 4, from three rounding halving adds and a correction
+// of the lowest bit where two of them rounded up.
+Halide::Expr Average4(Halide::Expr a, Halide::Expr b, Halide::Expr c, Halide::Expr d);
+
+// Values sharing one weight in a WeightedAverage().
+struct WeightedTaps {
+    int weight;
+    std::vector<Halide::Expr> values;
+};
+
+// sum(weight * value) / sum(weight), rounded half up, summed in a type twice as
+// wide as the values. Weights may be negative, in which case the sum is signed
+// and the result is clamped to the value type; their total must be positive.
+// A power-of-two total divides with a rounding shift.
+Halide::Expr WeightedAverage(const std::vector<WeightedTaps>& taps);
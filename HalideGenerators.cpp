@@ -0,0 +1,249 @@
+// HalideGenerators.cpp : Generators for compiling the pipelines in
+// HalidePipelines.cpp ahead of time. See add_halide_library() in CMakeLists.txt.
+//
+// Each generator applies its hand schedule unless it is run with an
+// autoscheduler (autoscheduler=Adams2019, Li2018 or Mullapudi2016), which then
+// schedules the pipeline for inputs of estimate_width x estimate_height.
+
+#include "Halide.h"
+#include "HalidePipelines.h"
+
+using namespace Halide;
+
+template <typename T>
+class SpeedtestsGenerator : public Generator<T> {
+public:
+    GeneratorParam<int> estimate_width{ "estimate_width", 4096 };
+    GeneratorParam<int> estimate_height{ "estimate_height", 3072 };
+
+protected:
+    // The estimated image region, with 3 channels when there are 3 dimensions.
+    Region EstimatedRegion(int dimensions) const {
+        Region region = { { 0, int(estimate_width) }, { 0, int(estimate_height) } };
+        if (dimensions > 2) {
+            region.push_back({ 0, 3 });
+        }
+        return region;
+    }
+};
+
+class BoxAverageGenerator : public SpeedtestsGenerator<BoxAverageGenerator> {
+public:
+    GeneratorParam<int> radius{ "radius", 3 };
+
+    Input<Buffer<uint16_t, 2>> input{ "input" };
+    Output<Buffer<uint16_t, 2>> output{ "output" };
+
+    void generate() {
+        output = DefineBoxAverage(input, input.width(), input.height(), radius);
+    }
+
+    void schedule() {
+        if (using_autoscheduler()) {
+            input.set_estimates(EstimatedRegion(2));
+            output.set_estimates(EstimatedRegion(2));
+            return;
+        }
+        Var x = output.args()[0], y = output.args()[1];
+        output.parallel(y).vectorize(x, natural_vector_size<uint16_t>());
+    }
+};
+
+class BoxAverageIntegralGenerator : public SpeedtestsGenerator<BoxAverageIntegralGenerator> {
+public:
+    // uint64 accumulators, for windows of more than 65536 pixels (radius > 127)
+    GeneratorParam<bool> wide{ "wide", false };
+
+    Input<Buffer<uint16_t, 2>> input{ "input" };
+    Input<int> radius{ "radius" };
+    Output<Buffer<uint16_t, 2>> output{ "output" };
+
+    void generate() {
+        mBox = DefineBoxAverageIntegral(input, input.width(), input.height(), radius, wide ? UInt(64) : UInt(32));
+        output = mBox.output;
+    }
+
+    void schedule() {
+        if (using_autoscheduler()) {
+            input.set_estimates(EstimatedRegion(2));
+            radius.set_estimate(3);
+            output.set_estimates(EstimatedRegion(2));
+            return;
+        }
+        ScheduleBoxAverageIntegral(mBox, output, get_target());
+    }
+
+private:
+    BoxAverageIntegral mBox;
+};
+
+class BoxDemosaicGenerator : public SpeedtestsGenerator<BoxDemosaicGenerator> {
+public:
+    Input<Buffer<uint16_t, 2>> input{ "input" };
+    Output<Buffer<uint16_t, 2>> output{ "output" };
+
+    void generate() {
+        output = DefineBoxDemosaic(input, input.width(), input.height());
+    }
+
+    void schedule() {
+        if (using_autoscheduler()) {
+            input.set_estimates(EstimatedRegion(2));
+            output.set_estimates(EstimatedRegion(2));
+            return;
+        }
+        Var x = output.args()[0], y = output.args()[1];
+        output.parallel(y, 8).vectorize(x, natural_vector_size<uint16_t>());
+    }
+};
+
+class BayerDemosaicGenerator : public SpeedtestsGenerator<BayerDemosaicGenerator> {
+public:
+    // Malvar-He-Cutler rather than bilinear interpolation
+    GeneratorParam<bool> mhc{ "mhc", false };
+    // CFA layout; one library per pattern, so none of them tests it per pixel
+    GeneratorParam<CfaPattern> pattern{ "pattern", CfaPattern::RGGB,
+                                        { { "rggb", CfaPattern::RGGB }, { "bggr", CfaPattern::BGGR },
+                                          { "grbg", CfaPattern::GRBG }, { "gbrg", CfaPattern::GBRG } } };
+
+    Input<Buffer<uint16_t, 2>> input{ "input" };
+    Output<Buffer<uint16_t, 3>> output{ "output" };
+
+    void generate() {
+        mDemosaic = mhc ? DefineBayerDemosaicMHC(input, input.width(), input.height(), pattern)
+                        : DefineBayerDemosaic(input, input.width(), input.height(), pattern);
+        output = mDemosaic.output;
+    }
+
+    void schedule() {
+        if (using_autoscheduler()) {
+            input.set_estimates(EstimatedRegion(2));
+            output.set_estimates(EstimatedRegion(3));
+            return;
+        }
+        ScheduleBayerDemosaic(mDemosaic, output, get_target());
+    }
+
+private:
+    BayerDemosaic mDemosaic;
+};
+
+class MedianGenerator : public SpeedtestsGenerator<MedianGenerator> {
+public:
+    GeneratorParam<int> kernel_size{ "kernel_size", 3 };
+    GeneratorParam<bool> bayer{ "bayer", false };
+
+    Input<Buffer<uint16_t, 2>> input{ "input" };
+    Output<Buffer<uint16_t, 2>> output{ "output" };
+
+    void generate() {
+        if (bayer) {
+            mBayerMedian = DefineBayerMedian(input, input.width(), input.height(), kernel_size);
+            output = mBayerMedian.output;
+        }
+        else {
+            mMedian = DefineMedian(input, input.width(), input.height(), kernel_size);
+            output = mMedian.output;
+        }
+    }
+
+    void schedule() {
+        if (using_autoscheduler()) {
+            input.set_estimates(EstimatedRegion(2));
+            output.set_estimates(EstimatedRegion(2));
+        }
+        else if (bayer) {
+            ScheduleBayerMedian(mBayerMedian, output, get_target());
+        }
+        else {
+            ScheduleMedian(mMedian, output, get_target());
+        }
+    }
+
+private:
+    Median mMedian;
+    BayerMedian mBayerMedian;
+};
+
+class MedianGateGenerator : public SpeedtestsGenerator<MedianGateGenerator> {
+public:
+    GeneratorParam<int> kernel_size{ "kernel_size", 3 };
+
+    Input<Buffer<uint8_t, 3>> input{ "input" };
+    Input<float> variance_threshold{ "variance_threshold" };
+    Output<Buffer<uint8_t, 3>> output{ "output" };
+
+    void generate() {
+        mGate = DefineMedianGate(input, input.width(), input.height(), kernel_size, variance_threshold);
+        output = mGate.output;
+    }
+
+    void schedule() {
+        if (using_autoscheduler()) {
+            input.set_estimates(EstimatedRegion(3));
+            variance_threshold.set_estimate(80.0f);
+            output.set_estimates(EstimatedRegion(3));
+            return;
+        }
+        ScheduleMedianGate(mGate, output, get_target());
+    }
+
+private:
+    MedianGate mGate;
+};
+
+class LocalStatisticsGenerator : public SpeedtestsGenerator<LocalStatisticsGenerator> {
+public:
+    Input<Buffer<uint16_t, 2>> input{ "input" };
+    Input<int> radius{ "radius" };
+    Output<Func> output{ "output", { Float(32), Float(32) }, 2 };   ///< (mean, variance)
+
+    void generate() {
+        mStats = DefineLocalStatistics(input, input.width(), input.height(), radius);
+        output = mStats.output;
+    }
+
+    void schedule() {
+        if (using_autoscheduler()) {
+            input.set_estimates(EstimatedRegion(2));
+            radius.set_estimate(3);
+            output.set_estimates(EstimatedRegion(2));
+            return;
+        }
+        ScheduleLocalStatistics(mStats, output, get_target());
+    }
+
+private:
+    LocalStatistics mStats;
+};
+
+class BrightenGenerator : public SpeedtestsGenerator<BrightenGenerator> {
+public:
+    Input<Buffer<uint8_t, 3>> input{ "input" };
+    Input<int> factor{ "factor" };
+    Output<Buffer<uint8_t, 3>> output{ "output" };
+
+    void generate() {
+        output = DefineBrighten(input, factor);
+    }
+
+    void schedule() {
+        if (using_autoscheduler()) {
+            input.set_estimates(EstimatedRegion(3));
+            factor.set_estimate(50);
+            output.set_estimates(EstimatedRegion(3));
+            return;
+        }
+        Var x = output.args()[0], y = output.args()[1];
+        output.vectorize(x, natural_vector_size<uint8_t>()).parallel(y);
+    }
+};
+
+HALIDE_REGISTER_GENERATOR(BoxAverageGenerator, box_average)
+HALIDE_REGISTER_GENERATOR(BoxAverageIntegralGenerator, box_average_integral)
+HALIDE_REGISTER_GENERATOR(BoxDemosaicGenerator, box_demosaic)
+HALIDE_REGISTER_GENERATOR(BayerDemosaicGenerator, bayer_demosaic)
+HALIDE_REGISTER_GENERATOR(MedianGenerator, median)
+HALIDE_REGISTER_GENERATOR(MedianGateGenerator, median_gate)
+HALIDE_REGISTER_GENERATOR(LocalStatisticsGenerator, local_statistics)
+HALIDE_REGISTER_GENERATOR(BrightenGenerator, brighten)
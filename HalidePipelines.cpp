@@ -0,0 +1,515 @@
+// HalidePipelines.cpp : Halide algorithm definitions and CPU schedules.
+
+#include "HalidePipelines.h"
+
+#include "HalideAverages.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace Halide;
+
+// Split the mosaic into its four phases on the half-resolution quad grid. Quad
+// (x, y) starts at the red pixel, so every pattern is an RGGB mosaic offset by
+// (CfaRedX, CfaRedY). Mirroring (not clamping) keeps the CFA phase of the
+// pixels beyond the edge, which the offset and the filters reach into.
+static void defineBayerPhases(BayerDemosaic& p, Func input, Expr width, Expr height, CfaPattern pattern) {
+    Var x("x"), y("y");
+    const int rx = CfaRedX(pattern), ry = CfaRedY(pattern);
+    p.raw = BoundaryConditions::mirror_interior(input, { { 0, width }, { 0, height } });
+    p.phase[0] = Func("r_r");
+    p.phase[1] = Func("g_gr");
+    p.phase[2] = Func("g_gb");
+    p.phase[3] = Func("b_b");
+    for (int i = 0; i < 4; i++) {
+        p.phase[i](x, y) = p.raw(2 * x + rx + i % 2, 2 * y + ry + i / 2);
+    }
+}
+
+// Interleave the per-phase RGB back to full resolution. The pattern's offset
+// is a constant, and with even output mins the parity is known per vector
+// lane, so this lowers to shuffles rather than selects.
+static Func interleaveBayerPhases(const std::string& name, Func rgb_r, Func rgb_gr, Func rgb_gb, Func rgb_b,
+                                  CfaPattern pattern) {
+    Var x("x"), y("y"), c("c");
+    const int rx = CfaRedX(pattern), ry = CfaRedY(pattern);
+    Expr qx = (x - rx) / 2, qy = (y - ry) / 2;
+    Func output(name);
+    output(x, y, c) = select((y - ry) % 2 == 0,
+                             select((x - rx) % 2 == 0, rgb_r(qx, qy, c), rgb_gr(qx, qy, c)),
+                             select((x - rx) % 2 == 0, rgb_gb(qx, qy, c), rgb_b(qx, qy, c)));
+    return output;
+}
+
+BayerDemosaic DefineBayerDemosaic(Func input, Expr width, Expr height, CfaPattern pattern) {
+    BayerDemosaic p;
+    Var x("x"), y("y"), c("c");
+
+    defineBayerPhases(p, input, width, height, pattern);
+    Func r = p.phase[0], gr = p.phase[1], gb = p.phase[2], b = p.phase[3];
+
+    // Missing colors at each phase, averaged from the neighbouring quads.
+    Expr g_at_r = Average4(gr(x - 1, y), gr(x, y), gb(x, y - 1), gb(x, y));
+    Expr b_at_r = Average4(b(x - 1, y - 1), b(x, y - 1), b(x - 1, y), b(x, y));
+    Expr r_at_gr = Average2(r(x, y), r(x + 1, y));
+    Expr b_at_gr = Average2(b(x, y - 1), b(x, y));
+    Expr r_at_gb = Average2(r(x, y), r(x, y + 1));
+    Expr b_at_gb = Average2(b(x - 1, y), b(x, y));
+    Expr r_at_b = Average4(r(x, y), r(x + 1, y), r(x, y + 1), r(x + 1, y + 1));
+    Expr g_at_b = Average4(gr(x, y), gr(x, y + 1), gb(x, y), gb(x + 1, y));
+
+    // Full RGB per phase; c is unrolled by the schedule so mux folds away.
+    Func rgb_r("rgb_r"), rgb_gr("rgb_gr"), rgb_gb("rgb_gb"), rgb_b("rgb_b");
+    rgb_r(x, y, c) = mux(c, { r(x, y), g_at_r, b_at_r });
+    rgb_gr(x, y, c) = mux(c, { r_at_gr, gr(x, y), b_at_gr });
+    rgb_gb(x, y, c) = mux(c, { r_at_gb, gb(x, y), b_at_gb });
+    rgb_b(x, y, c) = mux(c, { r_at_b, g_at_b, b(x, y) });
+
+    p.output = interleaveBayerPhases("bayer_demosaic", rgb_r, rgb_gr, rgb_gb, rgb_b, pattern);
+    return p;
+}
+
+BayerDemosaic DefineBayerDemosaicMHC(Func input, Expr width, Expr height, CfaPattern pattern) {
+    BayerDemosaic p;
+    Var x("x"), y("y"), c("c");
+
+    defineBayerPhases(p, input, width, height, pattern);
+
+    // The pixel (dx, dy) away from the site at phase (px, py) of quad (x, y).
+    auto at = [&](int px, int py, int dx, int dy) {
+        int fx = px + dx, fy = py + dy;
+        int qx = (fx >= 0) ? fx / 2 : -((1 - fx) / 2), qy = (fy >= 0) ? fy / 2 : -((1 - fy) / 2);
+        return p.phase[(fy & 1) * 2 + (fx & 1)](x + qx, y + qy);
+    };
+
+    // The four filters, in sixteenths, at the site of phase (px, py).
+    auto greenAtRB = [&](int px, int py) {
+        return WeightedAverage({ { 8, { at(px, py, 0, 0) } },
+                                 { 4, { at(px, py, -1, 0), at(px, py, 1, 0), at(px, py, 0, -1), at(px, py, 0, 1) } },
+                                 { -2, { at(px, py, -2, 0), at(px, py, 2, 0), at(px, py, 0, -2), at(px, py, 0, 2) } } });
+    };
+    auto diagonals = [&](int px, int py) {
+        return std::vector<Expr>{ at(px, py, -1, -1), at(px, py, 1, -1), at(px, py, -1, 1), at(px, py, 1, 1) };
+    };
+    // Red or blue at a green whose same-row neighbours are that color.
+    auto rowNeighbours = [&](int px, int py) {
+        std::vector<Expr> minus = diagonals(px, py);
+        minus.insert(minus.end(), { at(px, py, -2, 0), at(px, py, 2, 0) });
+        return WeightedAverage({ { 10, { at(px, py, 0, 0) } }, { 8, { at(px, py, -1, 0), at(px, py, 1, 0) } },
+                                 { -2, minus }, { 1, { at(px, py, 0, -2), at(px, py, 0, 2) } } });
+    };
+    // Red or blue at a green whose same-column neighbours are that color.
+    auto columnNeighbours = [&](int px, int py) {
+        std::vector<Expr> minus = diagonals(px, py);
+        minus.insert(minus.end(), { at(px, py, 0, -2), at(px, py, 0, 2) });
+        return WeightedAverage({ { 10, { at(px, py, 0, 0) } }, { 8, { at(px, py, 0, -1), at(px, py, 0, 1) } },
+                                 { -2, minus }, { 1, { at(px, py, -2, 0), at(px, py, 2, 0) } } });
+    };
+    // Blue at red, or red at blue.
+    auto opposite = [&](int px, int py) {
+        return WeightedAverage({ { 12, { at(px, py, 0, 0) } }, { 4, diagonals(px, py) },
+                                 { -3, { at(px, py, -2, 0), at(px, py, 2, 0), at(px, py, 0, -2), at(px, py, 0, 2) } } });
+    };
+    auto known = [&](int px, int py) { return p.phase[py * 2 + px](x, y); };
+
+    Func rgb_r("rgb_r"), rgb_gr("rgb_gr"), rgb_gb("rgb_gb"), rgb_b("rgb_b");
+    rgb_r(x, y, c) = mux(c, { known(0, 0), greenAtRB(0, 0), opposite(0, 0) });
+    rgb_gr(x, y, c) = mux(c, { rowNeighbours(1, 0), known(1, 0), columnNeighbours(1, 0) });
+    rgb_gb(x, y, c) = mux(c, { columnNeighbours(0, 1), known(0, 1), rowNeighbours(0, 1) });
+    rgb_b(x, y, c) = mux(c, { opposite(1, 1), greenAtRB(1, 1), known(1, 1) });
+
+    p.output = interleaveBayerPhases("bayer_demosaic_mhc", rgb_r, rgb_gr, rgb_gb, rgb_b, pattern);
+    return p;
+}
+
+void ScheduleBayerDemosaic(BayerDemosaic& p, Func out, const Target& target) {
+    Var x = out.args()[0], y = out.args()[1], c = out.args()[2];
+    Var xo("xo"), xi("xi"), yo("yo"), yi("yi"), yii("yii");
+    const int vec = target.natural_vector_size<uint16_t>();
+    const int stripRows = 32;
+
+    // Keep the quad grid aligned with the output so x % 2 and y % 2 fold.
+    OutputImageParam outBuf = out.output_buffer();
+    outBuf.dim(0).set_min((outBuf.dim(0).min() / 2) * 2);
+    outBuf.dim(1).set_min((outBuf.dim(1).min() / 2) * 2);
+
+    // Strips of rows in parallel, two rows (one quad row) per inner iteration,
+    // 2*vec output pixels per vector. GuardWithIf keeps tails on the same parity.
+    out.bound(c, 0, 3)
+        .reorder(c, x, y)
+        .split(y, yo, yi, stripRows, TailStrategy::GuardWithIf)
+        .split(yi, yi, yii, 2, TailStrategy::GuardWithIf)
+        .split(x, xo, xi, 2 * vec, TailStrategy::GuardWithIf)
+        .reorder(xi, c, yii, xo, yi, yo)
+        .vectorize(xi)
+        .unroll(c)
+        .unroll(yii)
+        .parallel(yo);
+
+    // Deinterleave each phase once per strip; the interpolation stays inline.
+    for (Func& phase : p.phase) {
+        phase.compute_at(out, yo).vectorize(phase.args()[0], vec);
+    }
+}
+
+Func DefineBoxAverage(Func input, Expr width, Expr height, int radius) {
+    Var x("x"), y("y");
+
+    // Define the boundary condition to set pixels outside the image to 0
+    Func clamped = BoundaryConditions::constant_exterior(input, cast(input.type(), 0), { { 0, width }, { 0, height } });
+
+    // Compute the clamped coordinates for the averaging and use them to compute the area of the averaging region.
+    Expr clamped_minX = clamp(x - radius, 0, width - 1);
+    Expr clamped_maxX = clamp(x + radius, 0, width - 1);
+    Expr clamped_minY = clamp(y - radius, 0, height - 1);
+    Expr clamped_maxY = clamp(y + radius, 0, height - 1);
+    Expr area = (clamped_maxX - clamped_minX + 1) * (clamped_maxY - clamped_minY + 1);
+
+    Func avg("avg");
+    RDom d(-radius, 2 * radius + 1, -radius, 2 * radius + 1);
+    avg(x, y) = cast<uint16_t>(0); ///< Needed because you can't use a domain in a pure function definition
+    avg(x, y) += cast<uint16_t>(clamped(x + d.x, y + d.y) / area);
+    avg.update(0).unscheduled(); ///< This squashes a JIT compiler warning about the update being scheduled
+    return avg;
+}
+
+// Element-wise sum of two calls to the same Tuple-valued Func.
+static Tuple AddElements(FuncRef a, FuncRef b, int n) {
+    std::vector<Expr> sum;
+    for (int i = 0; i < n; i++) {
+        sum.push_back(Expr(a[i]) + Expr(b[i]));
+    }
+    return Tuple(sum);
+}
+
+IntegralImage DefineIntegralImage(Func values, Expr width, Expr height) {
+    IntegralImage ii;
+    Var x("x"), y("y");
+    int n = values.outputs();
+
+    // Dimensions after x and y ride along as implicit ones.
+    ii.rowSum = Func("row_sum");
+    ii.rowSum(x, y, _) = values(x, y, _);
+    RDom rx(1, width - 1, "rx");
+    if (n == 1) {
+        ii.rowSum(rx, y, _) += ii.rowSum(rx - 1, y, _);
+    }
+    else {
+        ii.rowSum(rx, y, _) = AddElements(ii.rowSum(rx, y, _), ii.rowSum(rx - 1, y, _), n);
+    }
+
+    ii.sat = Func("sat");
+    ii.sat(x, y, _) = ii.rowSum(x, y, _);
+    ii.columnScan = RDom(1, height - 1, "ry");
+    if (n == 1) {
+        ii.sat(x, ii.columnScan, _) += ii.sat(x, ii.columnScan - 1, _);
+    }
+    else {
+        ii.sat(x, ii.columnScan, _) = AddElements(ii.sat(x, ii.columnScan, _), ii.sat(x, ii.columnScan - 1, _), n);
+    }
+    return ii;
+}
+
+void ScheduleIntegralImage(IntegralImage& ii, const Target& target) {
+    Var x = ii.sat.args()[0], y = ii.sat.args()[1];
+    Var xo("xo"), xi("xi");
+    const int vec = target.natural_vector_size(ii.sat.output_types()[0]);
+
+    // The row scan is serial along x, so spread the rows across threads.
+    ii.rowSum.compute_root().parallel(y, 8).vectorize(x, vec);
+    ii.rowSum.update().parallel(y, 8);
+
+    // The column scan is serial along y; each thread takes a band of columns.
+    ii.sat.compute_root().parallel(y, 8).vectorize(x, vec);
+    ii.sat.update()
+        .split(x, xo, xi, 16 * vec, TailStrategy::GuardWithIf)
+        .reorder(xi, ii.columnScan, xo)
+        .parallel(xo)
+        .vectorize(xi, vec);
+}
+
+Type BoxSumType(int radius) {
+    return (2 * radius + 1) * (2 * radius + 1) <= 65536 ? UInt(32) : UInt(64);
+}
+
+BoxAverageIntegral DefineBoxAverageIntegral(Func input, Expr width, Expr height, Expr radius, Type accum) {
+    BoxAverageIntegral p;
+    Var x("x"), y("y");
+
+    Func values("box_values");
+    values(x, y) = cast(accum, input(x, y));
+    p.ii = DefineIntegralImage(values, width, height);
+
+    // Exclusive corners: corner(x, y) is the sum over [0, x) x [0, y).
+    Func corner("corner");
+    corner(x, y) = select(x > 0 && y > 0, p.ii.sat(max(x, 1) - 1, max(y, 1) - 1), cast(accum, 0));
+
+    // The window clipped to the image, as half-open ranges.
+    Expr x0 = clamp(x - radius, 0, width), x1 = clamp(x + radius + 1, 0, width);
+    Expr y0 = clamp(y - radius, 0, height), y1 = clamp(y + radius + 1, 0, height);
+    Expr total = corner(x1, y1) - corner(x0, y1) - corner(x1, y0) + corner(x0, y0);
+    Expr area = cast(accum, (x1 - x0) * (y1 - y0));
+
+    p.output = Func("box_average_integral");
+    p.output(x, y) = cast(input.type(), (total + area / 2) / area);
+    return p;
+}
+
+void ScheduleBoxAverageIntegral(BoxAverageIntegral& p, Func out, const Target& target) {
+    Var x = out.args()[0], y = out.args()[1];
+    ScheduleIntegralImage(p.ii, target);
+    out.parallel(y, 8).vectorize(x, target.natural_vector_size(p.ii.sat.type()));
+}
+
+LocalStatistics DefineLocalStatistics(Func input, Expr width, Expr height, Expr radius) {
+    LocalStatistics p;
+    Var x("x"), y("y");
+
+    // Sums and sums of squares in one scan; uint64 keeps both exact.
+    Func moments("moments");
+    Expr v = cast<uint64_t>(input(x, y, _));
+    moments(x, y, _) = { v, v * v };
+    p.ii = DefineIntegralImage(moments, width, height);
+
+    // Exclusive corners, as in DefineBoxAverageIntegral().
+    Func corner("moment_corner");
+    Expr inside = x > 0 && y > 0;
+    Expr cx = max(x, 1) - 1, cy = max(y, 1) - 1;
+    corner(x, y, _) = { select(inside, p.ii.sat(cx, cy, _)[0], cast<uint64_t>(0)),
+                        select(inside, p.ii.sat(cx, cy, _)[1], cast<uint64_t>(0)) };
+
+    Expr x0 = clamp(x - radius, 0, width), x1 = clamp(x + radius + 1, 0, width);
+    Expr y0 = clamp(y - radius, 0, height), y1 = clamp(y + radius + 1, 0, height);
+    Expr window[2];
+    for (int i = 0; i < 2; i++) {
+        window[i] = cast<double>(corner(x1, y1, _)[i] - corner(x0, y1, _)[i] - corner(x1, y0, _)[i] + corner(x0, y0, _)[i]);
+    }
+
+    // The integer window sums are exact, so the double arithmetic only rounds once or twice.
+    Expr area = cast<double>((x1 - x0) * (y1 - y0));
+    Expr mean = window[0] / area;
+    Expr variance = max((window[1] - window[0] * mean) / area, 0.0);
+
+    p.output = Func("local_statistics");
+    p.output(x, y, _) = { cast<float>(mean), cast<float>(variance) };
+    return p;
+}
+
+void ScheduleLocalStatistics(LocalStatistics& p, Func out, const Target& target) {
+    Var x = out.args()[0], y = out.args()[1];
+    ScheduleIntegralImage(p.ii, target);
+    out.parallel(y, 8).vectorize(x, target.natural_vector_size<double>());
+}
+
+Func DefineBoxDemosaic(Func input, Expr width, Expr height) {
+    Var x("x"), y("y");
+    Func demosaic("demosaic");
+
+    // Apply boundary conditions
+    Func clamped = BoundaryConditions::repeat_edge(input, { { 0, width }, { 0, height } });
+
+    // Rounded mean of each 2x2 block
+    demosaic(x, y) = Average4(clamped(x, y), clamped(x + 1, y), clamped(x, y + 1), clamped(x + 1, y + 1));
+    return demosaic;
+}
+
+// Comparators (i, j), i < j, of Batcher's odd-even merge sort for n values.
+// Built for the next power of two; comparators touching the padding are
+// dropped, as if it held the maximum value.
+static std::vector<std::pair<int, int>> SortingNetwork(int n) {
+    std::vector<std::pair<int, int>> network;
+    int n2 = 1;
+    while (n2 < n) {
+        n2 *= 2;
+    }
+    for (int p = 1; p < n2; p *= 2) {
+        for (int k = p; k >= 1; k /= 2) {
+            for (int j = k % p; j + k < n2; j += 2 * k) {
+                for (int i = 0; i < std::min(k, n2 - j - k); i++) {
+                    if ((i + j) / (2 * p) == (i + j + k) / (2 * p) && i + j + k < n) {
+                        network.emplace_back(i + j, i + j + k);
+                    }
+                }
+            }
+        }
+    }
+    return network;
+}
+
+// Median of an odd number of values through a min/max sorting network. Only
+// the comparators the middle output depends on survive into the pipeline.
+static Expr MedianOf(std::vector<Expr> values) {
+    for (const std::pair<int, int>& c : SortingNetwork(int(values.size()))) {
+        Expr lo = min(values[c.first], values[c.second]);
+        Expr hi = max(values[c.first], values[c.second]);
+        values[c.first] = lo;
+        values[c.second] = hi;
+    }
+    return values[values.size() / 2];
+}
+
+static Expr Median3(Expr a, Expr b, Expr c) {
+    return max(min(a, b), min(max(a, b), c));
+}
+
+Median DefineMedian(Func input, Expr width, Expr height, int kernelSize) {
+    Median p;
+    Var x("x"), y("y");
+    int radius = kernelSize / 2;
+
+    p.raw = BoundaryConditions::mirror_interior(input, { { 0, width }, { 0, height } });
+    p.output = Func("median");
+
+    if (kernelSize == 3) {
+        // Sort each column once; neighbouring outputs share it. The median of
+        // the nine is the median of the largest low, middle mid and smallest high.
+        Expr a = p.raw(x, y - 1), b = p.raw(x, y), c = p.raw(x, y + 1);
+        p.columns = Func("median_columns");
+        p.columns(x, y) = { min(min(a, b), c), Median3(a, b, c), max(max(a, b), c) };
+        Expr lo = max(max(p.columns(x - 1, y)[0], p.columns(x, y)[0]), p.columns(x + 1, y)[0]);
+        Expr mid = Median3(p.columns(x - 1, y)[1], p.columns(x, y)[1], p.columns(x + 1, y)[1]);
+        Expr hi = min(min(p.columns(x - 1, y)[2], p.columns(x, y)[2]), p.columns(x + 1, y)[2]);
+        p.output(x, y) = Median3(lo, mid, hi);
+    }
+    else {
+        std::vector<Expr> values;
+        for (int dy = -radius; dy <= radius; dy++) {
+            for (int dx = -radius; dx <= radius; dx++) {
+                values.push_back(p.raw(x + dx, y + dy));
+            }
+        }
+        p.output(x, y) = MedianOf(values);
+    }
+    return p;
+}
+
+void ScheduleMedian(Median& p, Func out, const Target& target) {
+    Var x = out.args()[0], y = out.args()[1];
+    Var xo("xo"), yo("yo"), xi("xi"), yi("yi");
+    int vec = target.natural_vector_size(out.output_types()[0]);
+
+    out.tile(x, y, xo, yo, xi, yi, 8 * vec, 32, TailStrategy::GuardWithIf)
+        .vectorize(xi, vec)
+        .parallel(yo);
+    if (p.columns.defined()) {
+        p.columns.compute_at(out, xo).vectorize(p.columns.args()[0], vec);
+    }
+}
+
+BayerMedian DefineBayerMedian(Func input, Expr width, Expr height, int kernelSize) {
+    BayerMedian p;
+    Var x("x"), y("y");
+
+    // Each phase is a plane of its own, with its own mirrored edges.
+    for (int i = 0; i < 4; i++) {
+        int px = i % 2, py = i / 2;
+        Func plane("bayer_plane_" + std::to_string(i));
+        plane(x, y) = input(2 * x + px, 2 * y + py);
+        p.phase[i] = DefineMedian(plane, (width - px + 1) / 2, (height - py + 1) / 2, kernelSize);
+    }
+
+    Expr qx = x / 2, qy = y / 2;
+    p.output = Func("bayer_median");
+    p.output(x, y) = select(y % 2 == 0,
+                            select(x % 2 == 0, p.phase[0].output(qx, qy), p.phase[1].output(qx, qy)),
+                            select(x % 2 == 0, p.phase[2].output(qx, qy), p.phase[3].output(qx, qy)));
+    return p;
+}
+
+void ScheduleBayerMedian(BayerMedian& p, Func out, const Target& target) {
+    Var x = out.args()[0], y = out.args()[1];
+    Var yo("yo"), yi("yi");
+    int vec = target.natural_vector_size(out.output_types()[0]);
+
+    // Even mins, as for the demosaic, so the interleave folds into shuffles.
+    out.output_buffer().dim(0).set_min((out.output_buffer().dim(0).min() / 2) * 2);
+    out.output_buffer().dim(1).set_min((out.output_buffer().dim(1).min() / 2) * 2);
+    out.split(y, yo, yi, 32, TailStrategy::GuardWithIf)
+        .vectorize(x, 2 * vec, TailStrategy::GuardWithIf)
+        .parallel(yo);
+    for (Median& phase : p.phase) {
+        phase.output.compute_at(out, yo).vectorize(phase.output.args()[0], vec);
+        if (phase.columns.defined()) {
+            phase.columns.compute_at(out, yo).vectorize(phase.columns.args()[0], vec);
+        }
+    }
+}
+
+MedianGate DefineMedianGate(Func input, Expr width, Expr height, int kernelSize, Expr varianceThreshold) {
+    MedianGate p;
+    Var x("x"), y("y"), c("c");
+    Func clamped = BoundaryConditions::repeat_edge(input, { { 0, width }, { 0, height } });
+    Func median("median");
+
+    int half_kernel = kernelSize / 2;
+
+    // Window variance from the integral images: four lookups, whatever the kernel size
+    p.stats = DefineLocalStatistics(input, width, height, half_kernel);
+    Expr variance = p.stats.output(x, y, c)[1];
+
+    // Collect the values in the neighborhood
+    std::vector<Expr> values;
+    for (int dy = -half_kernel; dy <= half_kernel; dy++) {
+        for (int dx = -half_kernel; dx <= half_kernel; dx++) {
+            values.push_back(clamped(x + dx, y + dy, c));
+        }
+    }
+
+    // Apply the median filter if the variance is below the threshold
+    median(x, y, c) = select(variance < varianceThreshold, MedianOf(values), clamped(x, y, c));
+    p.output = median;
+    return p;
+}
+
+void ScheduleMedianGate(MedianGate& p, Func out, const Target& target) {
+    Var x = out.args()[0], y = out.args()[1];
+    ScheduleIntegralImage(p.stats.ii, target);
+    out.vectorize(x, target.natural_vector_size(out.output_types()[0])).parallel(y);
+}
+
+Func DefineBrighten(Func input, Expr factor) {
+    Var x("x"), y("y"), c("c");
+    Func brighter("brighter");
+
+    Expr value = input(x, y, c);
+
+    value = value + factor;
+    value = min(value, 255.0f);
+
+    value = cast<uint8_t>(value);
+
+    brighter(x, y, c) = value;
+    return brighter;
+}
+
+Func DefineBayerDemosaicSelect(Func input, CfaPattern pattern) {
+    Var x("x"), y("y"), c("c");
+    Func demosaic("demosaic");
+
+    // Parities are taken from the red pixel, so (0, 0) below is red in every layout.
+    Expr xr = x - CfaRedX(pattern), yr = y - CfaRedY(pattern);
+
+    // Define the Bayer pattern
+    Expr R = select((xr % 2 == 0) && (yr % 2 == 0), input(x, y),
+        (xr % 2 == 1) && (yr % 2 == 0), Average2(input(x - 1, y), input(x + 1, y)),
+        (xr % 2 == 0) && (yr % 2 == 1), Average2(input(x, y - 1), input(x, y + 1)),
+        Average4(input(x - 1, y - 1), input(x + 1, y - 1), input(x - 1, y + 1), input(x + 1, y + 1)));
+
+    // Green sites are where the parities differ; red and blue ones take
+    // their four green neighbours.
+    Expr G = select((xr % 2) != (yr % 2), input(x, y),
+        Average4(input(x - 1, y), input(x + 1, y), input(x, y - 1), input(x, y + 1)));
+
+    Expr B = select((xr % 2 == 1) && (yr % 2 == 1), input(x, y),
+        (xr % 2 == 0) && (yr % 2 == 1), Average2(input(x - 1, y), input(x + 1, y)),
+        (xr % 2 == 1) && (yr % 2 == 0), Average2(input(x, y - 1), input(x, y + 1)),
+        Average4(input(x - 1, y - 1), input(x + 1, y - 1), input(x - 1, y + 1), input(x + 1, y + 1)));
+
+    // Combine the channels
+    demosaic(x, y, c) = select(c == 0, R,
+        c == 1, G,
+        B);
+    return demosaic;
+}
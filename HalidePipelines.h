@@ -0,0 +1,139 @@
+// HalidePipelines.h : Halide algorithm definitions and CPU schedules shared by
+// the JIT entry points in speedtests.cpp.
+
+#pragma once
+
+#include "Halide.h"
+#include "CfaPattern.h"
+
+// Stages of the per-phase bilinear demosaic, exposed for scheduling.
+struct BayerDemosaic {
+    Halide::Func raw;           ///< input with a parity-preserving boundary
+    Halide::Func phase[4];      ///< phases on the quad grid: R, Gr (green beside red), Gb, B
+    Halide::Func output;        ///< planar RGB (x, y, c), same type as the input
+};
+
+// Bilinear demosaic of a Bayer mosaic. The input is split into its four Bayer
+// phases, each phase interpolates its missing colors with fixed (branch-free)
+// neighbour averages, and the results are interleaved back to full resolution.
+// The CFA pattern is fixed when the pipeline is defined, so each pattern
+// compiles to its own code with no per-pixel pattern tests.
+BayerDemosaic DefineBayerDemosaic(Halide::Func input, Halide::Expr width, Halide::Expr height,
+                                  CfaPattern pattern = CfaPattern::RGGB);
+
+// Malvar-He-Cutler demosaic of a Bayer mosaic: bilinear interpolation corrected
+// by the Laplacian of the known channel, from the 5x5 filters of Malvar, He and
+// Cutler (2004). The filters are exact in sixteenths and evaluated with
+// WeightedAverage(), so the output is rounded and clamped to the input type. It has the same stages
+// as DefineBayerDemosaic(); the filters are evaluated inline from the phases,
+// so the whole pipeline is one fused pass.
+BayerDemosaic DefineBayerDemosaicMHC(Halide::Func input, Halide::Expr width, Halide::Expr height,
+                                     CfaPattern pattern = CfaPattern::RGGB);
+
+// Tiled, vectorized and parallel CPU schedule, for either demosaic. out is the
+// pipeline output; it is p.output itself for JIT use. Its x and y mins are
+// constrained to be even.
+void ScheduleBayerDemosaic(BayerDemosaic& p, Halide::Func out, const Halide::Target& target);
+
+// Average over a (2 * radius + 1)^2 window, dividing each tap by the number of
+// in-bounds pixels. Has an update stage, so it must be computed, not inlined.
+Halide::Func DefineBoxAverage(Halide::Func input, Halide::Expr width, Halide::Expr height, int radius);
+
+// Summed-area table: sat(x, y) is the sum of values over [0, x] x [0, y].
+// values must already be of the accumulator type. Dimensions past y are
+// carried through, and a Tuple-valued input is summed element by element.
+struct IntegralImage {
+    Halide::Func rowSum;        ///< running sums along each row
+    Halide::Func sat;           ///< running sums of rowSum down each column
+    Halide::RDom columnScan;    ///< the serial y loop of sat's update
+};
+
+IntegralImage DefineIntegralImage(Halide::Func values, Halide::Expr width, Halide::Expr height);
+
+// Both scans computed at root: rows in parallel, then columns in parallel vectors.
+void ScheduleIntegralImage(IntegralImage& ii, const Halide::Target& target);
+
+// Accumulator that keeps box sums of 16-bit data over a (2 * radius + 1)^2
+// window exact: uint32 sums wrap, but box differences stay exact while the
+// window holds fewer than 65537 pixels; larger windows need uint64.
+Halide::Type BoxSumType(int radius);
+
+// Exact, rounded average of the in-bounds pixels in a (2 * radius + 1)^2
+// window, from four integral-image lookups per pixel whatever the radius.
+struct BoxAverageIntegral {
+    IntegralImage ii;
+    Halide::Func output;        ///< same type as the input
+};
+
+BoxAverageIntegral DefineBoxAverageIntegral(Halide::Func input, Halide::Expr width, Halide::Expr height,
+                                            Halide::Expr radius, Halide::Type accum);
+
+void ScheduleBoxAverageIntegral(BoxAverageIntegral& p, Halide::Func out, const Halide::Target& target);
+
+// Mean and population variance of the in-bounds pixels in a (2 * radius + 1)^2
+// window, for every pixel in one pass: one integral image of (sum, sum of
+// squares) in uint64, then four lookups per pixel evaluated in double.
+// Dimensions past y (e.g. channels) are carried through.
+struct LocalStatistics {
+    IntegralImage ii;           ///< Tuple-valued: (sum, sum of squares)
+    Halide::Func output;        ///< Tuple (mean, variance), both float
+};
+
+LocalStatistics DefineLocalStatistics(Halide::Func input, Halide::Expr width, Halide::Expr height,
+                                      Halide::Expr radius);
+
+void ScheduleLocalStatistics(LocalStatistics& p, Halide::Func out, const Halide::Target& target);
+
+// Rounded average of each 2x2 block, edges repeated. Every 2x2 block holds one
+// red, two green and one blue sample whatever the CFA layout, so this needs no
+// pattern.
+Halide::Func DefineBoxDemosaic(Halide::Func input, Halide::Expr width, Halide::Expr height);
+
+// Median over an odd kernelSize^2 window of a single-channel image of any
+// type, edges mirrored. 3x3 sorts each column once and shares it between
+// neighbours; larger kernels use a Batcher min/max network pruned to the
+// middle output, so it is only practical up to about 7x7. For larger windows
+// see MedianFilterHistogram() in MedianFilter.h.
+struct Median {
+    Halide::Func raw;           ///< input with a mirrored boundary
+    Halide::Func columns;       ///< 3x3 only: each column sorted, as a (low, mid, high) tuple
+    Halide::Func output;
+};
+
+Median DefineMedian(Halide::Func input, Halide::Expr width, Halide::Expr height, int kernelSize);
+
+// Tiled, vectorized and parallel CPU schedule; out is p.output or a wrapper of it.
+void ScheduleMedian(Median& p, Halide::Func out, const Halide::Target& target);
+
+// Median of a Bayer mosaic, each CFA phase filtered as its own plane.
+struct BayerMedian {
+    Median phase[4];            ///< R, Gr, Gb, B for an RGGB mosaic
+    Halide::Func output;
+};
+
+BayerMedian DefineBayerMedian(Halide::Func input, Halide::Expr width, Halide::Expr height, int kernelSize);
+
+// Row strips in parallel; x and y mins of out are constrained to be even.
+void ScheduleBayerMedian(BayerMedian& p, Halide::Func out, const Halide::Target& target);
+
+// Variance-gated median over a kernelSize^2 window of a 3-channel image. The
+// window variance comes from LocalStatistics, over the in-bounds pixels.
+struct MedianGate {
+    LocalStatistics stats;
+    Halide::Func output;
+};
+
+MedianGate DefineMedianGate(Halide::Func input, Halide::Expr width, Halide::Expr height, int kernelSize,
+                            Halide::Expr varianceThreshold);
+
+void ScheduleMedianGate(MedianGate& p, Halide::Func out, const Halide::Target& target);
+
+// Add factor to an 8-bit (x, y, c) image, saturating at 255.
+Halide::Func DefineBrighten(Halide::Func input, Halide::Expr factor);
+
+// The original demosaic: nested select on x % 2 and y % 2 for every pixel, no
+// boundary condition. Only valid one pixel inside the input. Its averages are
+// the exact ones of HalideAverages.h, so it no longer wraps on bright pixels.
+// The pattern offsets the parity tests, as in DefineBayerDemosaic(). Its
+// interior matches DefineBayerDemosaic() exactly, which --verify checks.
+Halide::Func DefineBayerDemosaicSelect(Halide::Func input, CfaPattern pattern = CfaPattern::RGGB);
@@ -0,0 +1,358 @@
+// MedianFilter.cpp : Histogram median filters.
+
+#include "MedianFilter.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// Output tiles: column strips keep the column histograms cache-sized, row
+// bands amortize building them.
+const int kStripWidth = 256;
+const int kMinBandHeight = 64;
+
+// A strided view of one plane; steps and strides are in pixels.
+template <typename T>
+struct Plane {
+    const T* src;
+    T* dst;
+    ptrdiff_t srcStep, srcStride;
+    ptrdiff_t dstStep, dstStride;
+    int width, height;
+
+    T at(int x, int y) const { return src[y * srcStride + x * srcStep]; }
+    T& out(int x, int y) const { return dst[y * dstStride + x * dstStep]; }
+};
+
+// Halide's mirror_interior: reflect about the edge pixels, periodic beyond.
+inline int mirrorInterior(int coord, int extent) {
+    if (extent == 1) {
+        return 0;
+    }
+    int limit = extent - 1;
+    int m = coord % (2 * limit);
+    if (m < 0) {
+        m += 2 * limit;
+    }
+    return limit - std::abs(m - limit);
+}
+
+// Split of a value into a coarse bucket (high bits) and a fine bin within it.
+struct HistogramLayout {
+    int fineBits;
+    int nCoarse;
+    int nFine;
+
+    explicit HistogramLayout(int bits)
+        : fineBits(bits / 2), nCoarse(1 << (bits - bits / 2)), nFine(1 << (bits / 2)) {}
+
+    int coarse(unsigned v) const { return int(v >> fineBits); }
+    int fine(unsigned v) const { return int(v & (nFine - 1)); }
+};
+
+// count[i] += add[i] - sub[i]; written so the compiler vectorizes it.
+inline void slide(uint16_t* count, const uint16_t* add, const uint16_t* sub, int n) {
+    for (int i = 0; i < n; i++) {
+        count[i] = uint16_t(count[i] + add[i] - sub[i]);
+    }
+}
+
+// Index of the bin holding the element of the given rank; rank is reduced to
+// the rank within that bin.
+inline int findRank(const uint16_t* count, int n, int& rank) {
+    int i = 0;
+    while (i < n - 1 && rank >= count[i]) {
+        rank -= count[i];
+        i++;
+    }
+    return i;
+}
+
+// Perreault-Hebert over one tile. The window histogram's coarse counts are
+// updated for every pixel; a fine bucket is only brought up to date when the
+// median falls in it.
+template <typename T>
+void medianTileColumns(const Plane<T>& p, const HistogramLayout& h, int radius, int x0, int x1, int y0, int y1) {
+    const int diameter = 2 * radius + 1;
+    const int rank = diameter * diameter / 2;
+    const int nCols = (x1 - x0) + 2 * radius;
+    const int colSize = h.nCoarse + h.nCoarse * h.nFine;
+
+    // Column i holds source column mirror(x0 - radius + i); coarse counts first, then fine.
+    std::vector<uint16_t> columns(size_t(nCols) * colSize, 0);
+    std::vector<int> srcCol(nCols);
+    for (int i = 0; i < nCols; i++) {
+        srcCol[i] = mirrorInterior(x0 - radius + i, p.width);
+    }
+    auto column = [&](int i) { return columns.data() + size_t(i) * colSize; };
+    auto update = [&](int i, unsigned v, int delta) {
+        uint16_t* col = column(i);
+        col[h.coarse(v)] += uint16_t(delta);
+        col[h.nCoarse + h.coarse(v) * h.nFine + h.fine(v)] += uint16_t(delta);
+    };
+
+    for (int dy = -radius; dy <= radius; dy++) {
+        int sy = mirrorInterior(y0 + dy, p.height);
+        for (int i = 0; i < nCols; i++) {
+            update(i, p.at(srcCol[i], sy), 1);
+        }
+    }
+
+    std::vector<uint16_t> coarse(h.nCoarse);
+    std::vector<uint16_t> fine(size_t(h.nCoarse) * h.nFine);
+    std::vector<int> synced(h.nCoarse);
+
+    for (int y = y0; y < y1; y++) {
+        if (y > y0) {
+            int syOut = mirrorInterior(y - radius - 1, p.height);
+            int syIn = mirrorInterior(y + radius, p.height);
+            for (int i = 0; i < nCols; i++) {
+                update(i, p.at(srcCol[i], syOut), -1);
+                update(i, p.at(srcCol[i], syIn), 1);
+            }
+        }
+
+        // The window for x covers columns [x - x0, x - x0 + 2 * radius].
+        std::fill(coarse.begin(), coarse.end(), uint16_t(0));
+        for (int i = 0; i < diameter; i++) {
+            const uint16_t* col = column(i);
+            for (int b = 0; b < h.nCoarse; b++) {
+                coarse[b] = uint16_t(coarse[b] + col[b]);
+            }
+        }
+        std::fill(synced.begin(), synced.end(), x0 - diameter - 1);
+
+        for (int x = x0; x < x1; x++) {
+            int first = x - x0;
+            if (x > x0) {
+                slide(coarse.data(), column(first + 2 * radius), column(first - 1), h.nCoarse);
+            }
+
+            int k = rank;
+            int c = findRank(coarse.data(), h.nCoarse, k);
+            uint16_t* bucket = fine.data() + size_t(c) * h.nFine;
+
+            // Catch the bucket up column by column, or rebuild it when that is cheaper.
+            if (x - synced[c] > diameter) {
+                std::fill(bucket, bucket + h.nFine, uint16_t(0));
+                for (int i = first; i < first + diameter; i++) {
+                    const uint16_t* col = column(i) + h.nCoarse + size_t(c) * h.nFine;
+                    for (int b = 0; b < h.nFine; b++) {
+                        bucket[b] = uint16_t(bucket[b] + col[b]);
+                    }
+                }
+            }
+            else {
+                for (int xs = synced[c] + 1; xs <= x; xs++) {
+                    int i = xs - x0;
+                    slide(bucket, column(i + 2 * radius) + h.nCoarse + size_t(c) * h.nFine,
+                          column(i - 1) + h.nCoarse + size_t(c) * h.nFine, h.nFine);
+                }
+            }
+            synced[c] = x;
+
+            int f = findRank(bucket, h.nFine, k);
+            p.out(x, y) = T((c << h.fineBits) | f);
+        }
+    }
+}
+
+// Huang's sliding window over one tile, for data too wide for column histograms.
+template <typename T>
+void medianTileSliding(const Plane<T>& p, const HistogramLayout& h, int radius, int x0, int x1, int y0, int y1) {
+    const int diameter = 2 * radius + 1;
+    const int rank = diameter * diameter / 2;
+
+    std::vector<uint16_t> coarse(h.nCoarse);
+    std::vector<uint16_t> fine(size_t(h.nCoarse) * h.nFine);
+    std::vector<int> srcRow(diameter);
+
+    for (int y = y0; y < y1; y++) {
+        for (int dy = -radius; dy <= radius; dy++) {
+            srcRow[dy + radius] = mirrorInterior(y + dy, p.height);
+        }
+        auto addColumn = [&](int sx, int delta) {
+            for (int sy : srcRow) {
+                unsigned v = p.at(sx, sy);
+                coarse[h.coarse(v)] += uint16_t(delta);
+                fine[size_t(h.coarse(v)) * h.nFine + h.fine(v)] += uint16_t(delta);
+            }
+        };
+
+        std::fill(coarse.begin(), coarse.end(), uint16_t(0));
+        std::fill(fine.begin(), fine.end(), uint16_t(0));
+        for (int dx = -radius; dx <= radius; dx++) {
+            addColumn(mirrorInterior(x0 + dx, p.width), 1);
+        }
+
+        for (int x = x0; x < x1; x++) {
+            if (x > x0) {
+                addColumn(mirrorInterior(x - radius - 1, p.width), -1);
+                addColumn(mirrorInterior(x + radius, p.width), 1);
+            }
+            int k = rank;
+            int c = findRank(coarse.data(), h.nCoarse, k);
+            int f = findRank(fine.data() + size_t(c) * h.nFine, h.nFine, k);
+            p.out(x, y) = T((c << h.fineBits) | f);
+        }
+    }
+}
+
+template <typename T>
+int significantBits(const Plane<T>& p) {
+    unsigned maxValue = 0;
+    for (int y = 0; y < p.height; y++) {
+        for (int x = 0; x < p.width; x++) {
+            maxValue = std::max<unsigned>(maxValue, p.at(x, y));
+        }
+    }
+    int bits = 1;
+    while (bits < int(8 * sizeof(T)) && (maxValue >> bits) != 0) {
+        bits++;
+    }
+    return bits;
+}
+
+// Filter one plane, tiles handed out to the threads through an atomic counter.
+template <typename T>
+void medianPlane(const Plane<T>& p, int radius, int bits, unsigned nThreads) {
+    if (p.width == 0 || p.height == 0) {
+        return;
+    }
+    HistogramLayout layout(bits);
+    bool columnHistograms = bits <= kMedianColumnHistogramBits;
+
+    int bandHeight = std::max(kMinBandHeight, 2 * (2 * radius + 1));
+    int nStrips = (p.width + kStripWidth - 1) / kStripWidth;
+    int nBands = (p.height + bandHeight - 1) / bandHeight;
+    int nTiles = nStrips * nBands;
+    std::atomic<int> nextTile(0);
+
+    auto worker = [&]() {
+        for (int tile = nextTile++; tile < nTiles; tile = nextTile++) {
+            int x0 = (tile % nStrips) * kStripWidth, x1 = std::min(p.width, x0 + kStripWidth);
+            int y0 = (tile / nStrips) * bandHeight, y1 = std::min(p.height, y0 + bandHeight);
+            if (columnHistograms) {
+                medianTileColumns(p, layout, radius, x0, x1, y0, y1);
+            }
+            else {
+                medianTileSliding(p, layout, radius, x0, x1, y0, y1);
+            }
+        }
+    };
+
+    if (nThreads == 0) {
+        nThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    nThreads = std::min<unsigned>(nThreads, nTiles);
+    if (nThreads <= 1) {
+        worker();
+        return;
+    }
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < nThreads; i++) {
+        threads.emplace_back(worker);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// The four CFA phases of a mosaic as half-resolution planes.
+template <typename T>
+std::vector<Plane<T>> bayerPlanes(const T* src, ptrdiff_t srcStride, T* dst, ptrdiff_t dstStride, uint32_t width,
+                                  uint32_t height) {
+    std::vector<Plane<T>> planes;
+    for (int py = 0; py < 2; py++) {
+        for (int px = 0; px < 2; px++) {
+            Plane<T> p;
+            p.src = src + py * srcStride + px;
+            p.dst = dst + py * dstStride + px;
+            p.srcStep = 2;
+            p.srcStride = 2 * srcStride;
+            p.dstStep = 2;
+            p.dstStride = 2 * dstStride;
+            p.width = int(width - px + 1) / 2;
+            p.height = int(height - py + 1) / 2;
+            planes.push_back(p);
+        }
+    }
+    return planes;
+}
+
+template <typename T>
+Plane<T> wholePlane(const T* src, ptrdiff_t srcStride, T* dst, ptrdiff_t dstStride, uint32_t width, uint32_t height) {
+    return Plane<T>{ src, dst, 1, srcStride, 1, dstStride, int(width), int(height) };
+}
+
+template <typename T>
+void referencePlane(const Plane<T>& p, int radius) {
+    std::vector<T> window;
+    for (int y = 0; y < p.height; y++) {
+        for (int x = 0; x < p.width; x++) {
+            window.clear();
+            for (int dy = -radius; dy <= radius; dy++) {
+                for (int dx = -radius; dx <= radius; dx++) {
+                    window.push_back(p.at(mirrorInterior(x + dx, p.width), mirrorInterior(y + dy, p.height)));
+                }
+            }
+            std::nth_element(window.begin(), window.begin() + window.size() / 2, window.end());
+            p.out(x, y) = window[window.size() / 2];
+        }
+    }
+}
+
+} // namespace
+
+template <typename T>
+bool MedianFilterHistogram(const T* src, ptrdiff_t srcStride, T* dst, ptrdiff_t dstStride, uint32_t width,
+                           uint32_t height, int radius, int bits, unsigned nThreads) {
+    if (radius < 0 || radius > kMedianMaxRadius) {
+        return false;
+    }
+    Plane<T> p = wholePlane(src, srcStride, dst, dstStride, width, height);
+    medianPlane(p, radius, bits > 0 ? bits : significantBits(p), nThreads);
+    return true;
+}
+
+template <typename T>
+bool MedianFilterBayerHistogram(const T* src, ptrdiff_t srcStride, T* dst, ptrdiff_t dstStride, uint32_t width,
+                                uint32_t height, int radius, int bits, unsigned nThreads) {
+    if (radius < 0 || radius > kMedianMaxRadius) {
+        return false;
+    }
+    for (const Plane<T>& p : bayerPlanes(src, srcStride, dst, dstStride, width, height)) {
+        medianPlane(p, radius, bits > 0 ? bits : significantBits(p), nThreads);
+    }
+    return true;
+}
+
+template <typename T>
+void MedianFilterReference(const T* src, ptrdiff_t srcStride, T* dst, ptrdiff_t dstStride, uint32_t width,
+                           uint32_t height, int radius, bool bayer) {
+    if (bayer) {
+        for (const Plane<T>& p : bayerPlanes(src, srcStride, dst, dstStride, width, height)) {
+            referencePlane(p, radius);
+        }
+    }
+    else {
+        referencePlane(wholePlane(src, srcStride, dst, dstStride, width, height), radius);
+    }
+}
+
+template bool MedianFilterHistogram<uint8_t>(const uint8_t*, ptrdiff_t, uint8_t*, ptrdiff_t, uint32_t, uint32_t,
+                                             int, int, unsigned);
+template bool MedianFilterHistogram<uint16_t>(const uint16_t*, ptrdiff_t, uint16_t*, ptrdiff_t, uint32_t, uint32_t,
+                                              int, int, unsigned);
+template bool MedianFilterBayerHistogram<uint8_t>(const uint8_t*, ptrdiff_t, uint8_t*, ptrdiff_t, uint32_t,
+                                                  uint32_t, int, int, unsigned);
+template bool MedianFilterBayerHistogram<uint16_t>(const uint16_t*, ptrdiff_t, uint16_t*, ptrdiff_t, uint32_t,
+                                                   uint32_t, int, int, unsigned);
+template void MedianFilterReference<uint8_t>(const uint8_t*, ptrdiff_t, uint8_t*, ptrdiff_t, uint32_t, uint32_t,
+                                             int, bool);
+template void MedianFilterReference<uint16_t>(const uint16_t*, ptrdiff_t, uint16_t*, ptrdiff_t, uint32_t, uint32_t,
+                                              int, bool);
@@ -0,0 +1,39 @@
+// MedianFilter.h : Histogram median filters for windows too large for a
+// sorting network.
+//
+// Data with at most kMedianColumnHistogramBits significant bits uses Perreault
+// and Hebert's constant-time median: one histogram per column, with the window
+// histogram updated by adding and removing whole columns. Wider data uses
+// Huang's sliding window, which costs O(radius) per pixel. Both keep
+// two-level (coarse/fine) histograms and mirror the edges like Halide's
+// BoundaryConditions::mirror_interior, so they match DefineMedian() exactly.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Widest data that gets per-column histograms; beyond this they cost too much memory.
+const int kMedianColumnHistogramBits = 12;
+
+// Largest radius supported: window counts are kept in 16 bits.
+const int kMedianMaxRadius = 127;
+
+// Median of the (2 * radius + 1)^2 window around each pixel of a single-channel
+// image. Strides are in pixels. bits is the number of significant bits in the
+// data; 0 scans the image for it. Runs on nThreads threads (0 = all cores).
+// Returns false for an unsupported radius.
+template <typename T>
+bool MedianFilterHistogram(const T* src, ptrdiff_t srcStride, T* dst, ptrdiff_t dstStride, uint32_t width,
+                           uint32_t height, int radius, int bits = 0, unsigned nThreads = 0);
+
+// The same for a Bayer mosaic: each of the four CFA phases is filtered as its
+// own half-resolution plane, so colors are never mixed.
+template <typename T>
+bool MedianFilterBayerHistogram(const T* src, ptrdiff_t srcStride, T* dst, ptrdiff_t dstStride, uint32_t width,
+                                uint32_t height, int radius, int bits = 0, unsigned nThreads = 0);
+
+// Straightforward sort-based median, single-threaded. For checking the others.
+template <typename T>
+void MedianFilterReference(const T* src, ptrdiff_t srcStride, T* dst, ptrdiff_t dstStride, uint32_t width,
+                           uint32_t height, int radius, bool bayer = false);
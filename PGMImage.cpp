@@ -1,8 +1,26 @@
 #include "PGMImage.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <filesystem>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
+#if defined(TOC_X86)
+#include <immintrin.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 static bool isBigEndian() {
   union {
     uint32_t i;
@@ -12,15 +30,59 @@ static bool isBigEndian() {
   return testUnion.c[0] == 1;
 }
 
-static void fixEndian(std::vector<uint16_t> &data) {
+// Byte-swap count values from src into dst. dst may equal src.
+static void swapBytesScalar(uint16_t *dst, const uint16_t *src, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    dst[i] = (src[i] >> 8) | (src[i] << 8);
+  }
+}
+
+#if defined(TOC_X86)
+TOC_TARGET_SSSE3 static void swapBytesSSSE3(uint16_t *dst, const uint16_t *src, size_t count) {
+  const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_shuffle_epi8(v, mask));
+  }
+  swapBytesScalar(dst + i, src + i, count - i);
+}
+
+TOC_TARGET_AVX2 static void swapBytesAVX2(uint16_t *dst, const uint16_t *src, size_t count) {
+  const __m256i mask = _mm256_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+                                        1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  size_t i = 0;
+  for (; i + 32 <= count; i += 32) {
+    __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+    __m256i v1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 16));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_shuffle_epi8(v0, mask));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 16), _mm256_shuffle_epi8(v1, mask));
+  }
+  swapBytesSSSE3(dst + i, src + i, count - i);
+}
+#endif
+
+static void swapBytes(uint16_t *dst, const uint16_t *src, size_t count) {
+#if defined(TOC_X86)
+  static const auto kernel = GetCpuFeatures().avx2 ? swapBytesAVX2
+                           : GetCpuFeatures().ssse3 ? swapBytesSSSE3 : swapBytesScalar;
+  kernel(dst, src, count);
+#else
+  swapBytesScalar(dst, src, count);
+#endif
+}
+
+static void fixEndian(uint16_t *data, size_t count) {
   if (!isBigEndian()) {
-    for (uint16_t &value : data) {
-      value = (value >> 8) | (value << 8);
-    }
+    swapBytes(data, data, count);
   }
 }
 
-PGMImage::PGMImage(std::string fileName)
+static void fixEndian(std::vector<uint16_t> &data) {
+  fixEndian(data.data(), data.size());
+}
+
+PGMImage::PGMImage(std::string fileName, LoadMode mode)
 {
   std::ifstream file(fileName, std::ios::binary);
   if (!file) {
@@ -52,15 +114,143 @@ PGMImage::PGMImage(std::string fileName)
     return;
   }
 
+  // Map the payload in place when asked to. The mapping starts on a page boundary, so a header
+  // of odd length would leave the pixels misaligned; read those files instead.
+  size_t offset = static_cast<size_t>(file.tellg());
+  if (mode != LoadMode::Read && offset % sizeof(uint16_t) == 0) {
+    file.close();
+    if (mapFile(fileName, offset, mode == LoadMode::MapPrivate)) {
+      return;
+    }
+    file.open(fileName, std::ios::binary);
+    file.seekg(offset);
+  }
+
   // Read the specified number of 16-bit unsigned values into the data array, swapping endianness
   // if needed.
-  m_data.resize(m_width * m_height);
-  file.read(reinterpret_cast<char*>(m_data.data()), m_width * m_height * sizeof(uint16_t));
+  m_data.resize(size());
+  file.read(reinterpret_cast<char*>(m_data.data()), size() * sizeof(uint16_t));
   fixEndian(m_data);
+  m_pixels = m_data.data();
+}
+
+PGMImage::~PGMImage()
+{
+  unmapFile();
+}
+
+uint16_t* PGMImage::data()
+{
+  if (m_width == 0 || m_height == 0) {
+    return nullptr;
+  }
+  if (m_fileOrder) {
+    if (m_readOnly) {
+      return nullptr;
+    }
+    // First write access to a private mapping: swap in place, which copies only the touched pages.
+    fixEndian(m_pixels, size());
+    m_fileOrder = false;
+  }
+  return m_pixels;
+}
+
+uint16_t PGMImage::pixel(uint32_t x, uint32_t y) const
+{
+  uint16_t value = m_pixels[size_t(y) * m_width + x];
+  return m_fileOrder ? uint16_t((value >> 8) | (value << 8)) : value;
+}
+
+void PGMImage::copyRow(uint32_t y, uint16_t* dst) const
+{
+  const uint16_t* row = m_pixels + size_t(y) * m_width;
+  if (m_fileOrder) {
+    swapBytes(dst, row, m_width);
+  }
+  else {
+    std::copy_n(row, m_width, dst);
+  }
+}
+
+bool PGMImage::mapFile(const std::string& fileName, size_t offset, bool privateCopy)
+{
+  size_t payload = size() * sizeof(uint16_t);
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    return false;
+  }
+  LARGE_INTEGER fileSize;
+  HANDLE mapping = nullptr;
+  if (GetFileSizeEx(file, &fileSize) && size_t(fileSize.QuadPart) >= offset + payload) {
+    mapping = CreateFileMappingA(file, nullptr, privateCopy ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, nullptr);
+  }
+  CloseHandle(file);
+  if (mapping == nullptr) {
+    return false;
+  }
+  void* view = MapViewOfFile(mapping, privateCopy ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+  if (view == nullptr) {
+    CloseHandle(mapping);
+    return false;
+  }
+  m_mapHandle = mapping;
+  m_mapLength = size_t(fileSize.QuadPart);
+#else
+  int fd = open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat fileStat;
+  void* view = MAP_FAILED;
+  if (fstat(fd, &fileStat) == 0 && size_t(fileStat.st_size) >= offset + payload) {
+    view = mmap(nullptr, size_t(fileStat.st_size), privateCopy ? (PROT_READ | PROT_WRITE) : PROT_READ,
+                MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (view == MAP_FAILED) {
+    return false;
+  }
+  m_mapLength = size_t(fileStat.st_size);
+#endif
+
+  m_map = view;
+  m_mapName = fileName;
+  m_pixels = reinterpret_cast<uint16_t*>(static_cast<char*>(view) + offset);
+  m_fileOrder = !isBigEndian();
+  m_readOnly = !privateCopy;
+  return true;
+}
+
+void PGMImage::unmapFile()
+{
+  if (m_map == nullptr) {
+    return;
+  }
+#ifdef _WIN32
+  UnmapViewOfFile(m_map);
+  CloseHandle(m_mapHandle);
+  m_mapHandle = nullptr;
+#else
+  munmap(m_map, m_mapLength);
+#endif
+  m_map = nullptr;
+  m_mapLength = 0;
+  m_mapName.clear();
+  m_pixels = m_data.data();
+  m_fileOrder = false;
+  m_readOnly = false;
 }
 
 bool PGMImage::Write(std::string fileName)
 {
+  std::error_code error;
+  if (m_map != nullptr && std::filesystem::equivalent(fileName, m_mapName, error)) {
+    std::cerr << "PGMImage::Write(): Cannot overwrite the mapped source file: " + fileName << std::endl;
+    return false;
+  }
   std::ofstream file(fileName, std::ios::binary);
   if (!file) {
     std::cerr << "PGMImage::Write(): Could not open file: " + fileName << std::endl;
@@ -70,14 +260,18 @@ bool PGMImage::Write(std::string fileName)
   file << "P5\n";
   file << m_width << " " << m_height << "\n";
   file << "65535\n";
-  // Write the data to the file after swapping endianness if needed.
-  std::vector<uint16_t> *dataToSend = &m_data;
-  std::vector<uint16_t> dataCopy;
-  if (!isBigEndian()) {
-    dataCopy = m_data;
-    fixEndian(dataCopy);
-    dataToSend = &dataCopy;
+  // Write the data to the file, swapping endianness through a small staging buffer if needed.
+  // A mapping still in file order is written as it is.
+  if (isBigEndian() || m_fileOrder) {
+    file.write(reinterpret_cast<const char*>(m_pixels), size() * sizeof(uint16_t));
+    return bool(file);
   }
-  file.write(reinterpret_cast<char*>(dataToSend->data()), m_width * m_height * sizeof(uint16_t));
-  return true;
+  const size_t stagingCount = 32 * 1024;
+  std::vector<uint16_t> staging(std::min(stagingCount, size()));
+  for (size_t i = 0; i < size() && file; i += staging.size()) {
+    size_t count = std::min(staging.size(), size() - i);
+    swapBytes(staging.data(), m_pixels + i, count);
+    file.write(reinterpret_cast<const char*>(staging.data()), count * sizeof(uint16_t));
+  }
+  return bool(file);
 }
@@ -1,24 +1,72 @@
 #pragma once
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <vector>
 
 class PGMImage {
 public:
-	PGMImage(std::string fileName);
-	PGMImage(uint16_t width, uint16_t height) : m_width(width), m_height(height), m_data(width* height) {}
+	// How the pixel payload of a file is brought into memory.
+	enum class LoadMode {
+		Read,		///< Read into an owned vector and swap to host order.
+		MapView,	///< Read-only mapping; pixels stay in the file's big-endian order.
+		MapPrivate	///< Copy-on-write mapping; swapped to host order on the first data() call.
+	};
 
+	PGMImage(std::string fileName, LoadMode mode = LoadMode::Read);
+	PGMImage(uint32_t width, uint32_t height) : m_width(width), m_height(height), m_data(size_t(width) * height) { m_pixels = m_data.data(); }
+	~PGMImage();
+
+	PGMImage(const PGMImage&) = delete;
+	PGMImage& operator=(const PGMImage&) = delete;
+
+	// Write as a 16-bit PGM. Refuses (returns false) the file a mapped image was loaded from,
+	// since rewriting it would truncate the pages the pixels are read from.
 	bool Write(std::string fileName);
 
-	uint16_t width() const { return m_width; }
-	uint16_t height() const { return m_height; }
+	uint32_t width() const { return m_width; }
+	uint32_t height() const { return m_height; }
+	size_t size() const { return size_t(m_width) * m_height; }
+
+	// Host-order pixels. Returns nullptr for an empty image and for a MapView image still in file order.
+	uint16_t* data();
+
+	// Pixels as currently held, without forcing a swap. See fileOrder().
+	const uint16_t* view() const { return m_pixels; }
 
-	uint16_t* data() { if (m_width && m_height) { return m_data.data(); } else { return nullptr; } }
+	// True while view() points at a mapping that is still in big-endian file order.
+	bool fileOrder() const { return m_fileOrder; }
 
-	uint16_t& operator()(uint16_t x, uint16_t y) { return m_data.data()[y * m_width + x]; }
+	// Unchecked access to a host-order pixel. The image must not be in file order: call data()
+	// once first for a MapPrivate image, and use pixel() to read a MapView image.
+	uint16_t& operator()(uint32_t x, uint32_t y) {
+		assert(!m_fileOrder);
+		return m_pixels[size_t(y) * m_width + x];
+	}
+
+	// Host-order value of one pixel; works in every load mode.
+	uint16_t pixel(uint32_t x, uint32_t y) const;
+
+	// Copy row y to dst in host order, swapping a mapping in file order on the way. Works in
+	// every load mode and leaves the image as it is.
+	void copyRow(uint32_t y, uint16_t* dst) const;
 
 protected:
-	uint16_t m_width = 0;
-	uint16_t m_height = 0;
+	bool mapFile(const std::string& fileName, size_t offset, bool privateCopy);
+	void unmapFile();
+
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
 	std::vector<uint16_t> m_data;
+
+	uint16_t* m_pixels = nullptr;	///< m_data.data() or the payload inside m_map
+	bool m_fileOrder = false;		///< payload of a mapping not yet swapped to host order
+	bool m_readOnly = false;		///< payload is a read-only mapping
+	void* m_map = nullptr;			///< start of the mapped file
+	size_t m_mapLength = 0;
+	std::string m_mapName;			///< file behind m_map, which Write() refuses
+#ifdef _WIN32
+	void* m_mapHandle = nullptr;	///< file-mapping object backing m_map
+#endif
 };
@@ -0,0 +1,131 @@
+// PerfCounters.cpp : Hardware event counts around a piece of code.
+
+#include "PerfCounters.h"
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#endif
+
+HardwareCounters& HardwareCounters::operator+=(const HardwareCounters& other) {
+    valid = valid || other.valid;
+    cycles += other.cycles;
+    instructions += other.instructions;
+    llcReferences += other.llcReferences;
+    llcMisses += other.llcMisses;
+    return *this;
+}
+
+HardwareCounters HardwareCounters::Scaled(double factor) const {
+    HardwareCounters scaled = *this;
+    scaled.cycles *= factor;
+    scaled.instructions *= factor;
+    scaled.llcReferences *= factor;
+    scaled.llcMisses *= factor;
+    return scaled;
+}
+
+PerfCounters::~PerfCounters() {
+    Close();
+}
+
+#ifdef __linux__
+
+static const uint64_t kEvents[] = { PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_REFERENCES,
+                                    PERF_COUNT_HW_CACHE_MISSES };
+static const size_t kEventCount = sizeof(kEvents) / sizeof(kEvents[0]);
+
+static int openCounter(uint64_t event, pid_t tid) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = event;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return int(syscall(__NR_perf_event_open, &attr, tid, -1, -1, 0));
+}
+
+bool PerfCounters::Start() {
+    Close();
+    DIR* tasks = opendir("/proc/self/task");
+    if (tasks == nullptr) {
+        return false;
+    }
+    while (dirent* entry = readdir(tasks)) {
+        pid_t tid = pid_t(atoi(entry->d_name));
+        if (tid <= 0) {
+            continue;
+        }
+        for (uint64_t event : kEvents) {
+            mFds.push_back(openCounter(event, tid));
+        }
+    }
+    closedir(tasks);
+
+    bool any = false;
+    for (int fd : mFds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+            any = true;
+        }
+    }
+    return any;
+}
+
+HardwareCounters PerfCounters::Stop() {
+    HardwareCounters counters;
+    double* totals[kEventCount] = { &counters.cycles, &counters.instructions, &counters.llcReferences,
+                                    &counters.llcMisses };
+    for (int fd : mFds) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    for (size_t i = 0; i < mFds.size(); i++) {
+        uint64_t values[3];     // value, time enabled, time running
+        if (mFds[i] < 0 || read(mFds[i], values, sizeof(values)) != ssize_t(sizeof(values))) {
+            continue;
+        }
+        double scale = (values[2] > 0) ? double(values[1]) / double(values[2]) : 0.0;
+        *totals[i % kEventCount] += double(values[0]) * scale;
+        counters.valid = true;
+    }
+    Close();
+    return counters;
+}
+
+void PerfCounters::Close() {
+    for (int fd : mFds) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+    mFds.clear();
+}
+
+#else
+
+bool PerfCounters::Start() {
+    return false;
+}
+
+HardwareCounters PerfCounters::Stop() {
+    return HardwareCounters();
+}
+
+void PerfCounters::Close() {
+    mFds.clear();
+}
+
+#endif
@@ -0,0 +1,51 @@
+// PerfCounters.h : Hardware event counts around a piece of code.
+//
+// On Linux the counts come from perf_event_open(2), one counter per event for
+// every thread of the process, so work done on Halide's or our own worker
+// threads is included. Elsewhere, or where perf events are not permitted
+// (see /proc/sys/kernel/perf_event_paranoid), Stop() returns invalid counts.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+struct HardwareCounters {
+    bool valid = false;
+    double cycles = 0.0;
+    double instructions = 0.0;
+    double llcReferences = 0.0;     ///< last-level cache accesses
+    double llcMisses = 0.0;         ///< last-level cache misses
+
+    // Instructions per cycle.
+    double IPC() const { return cycles > 0.0 ? instructions / cycles : 0.0; }
+
+    // Bytes brought in from memory, estimated as one 64-byte line per LLC miss.
+    // Hardware prefetches and write-backs are not counted, so this is a lower bound.
+    double Bytes() const { return llcMisses * 64.0; }
+
+    HardwareCounters& operator+=(const HardwareCounters& other);
+    HardwareCounters Scaled(double factor) const;
+};
+
+class PerfCounters {
+public:
+    PerfCounters() = default;
+    ~PerfCounters();
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // Start counting on every thread the process has now (and any they start).
+    // Returns false if no counter could be opened.
+    bool Start();
+
+    // Stop counting and return the totals since Start(), scaled up where the
+    // kernel had to multiplex the counters.
+    HardwareCounters Stop();
+
+private:
+    void Close();
+
+    std::vector<int> mFds;          ///< kEvents per thread, in event order
+};
@@ -0,0 +1,138 @@
+// PipelineCache.cpp : Compile-once cache for the JIT pipelines.
+
+#include "PipelineCache.h"
+#include "PipelineProfile.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <set>
+#include <thread>
+#include <tuple>
+
+const char* const kAutoschedulers[3] = { "Adams2019", "Li2018", "Mullapudi2016" };
+
+static std::string lowerCase(std::string text) {
+    std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+    return text;
+}
+
+std::string PipelineSchedule::Name() const {
+    return IsManual() ? std::string("manual") : lowerCase(autoscheduler);
+}
+
+bool ParseSchedule(const std::string& name, PipelineSchedule& schedule) {
+    std::string lower = lowerCase(name);
+    if (lower == "manual") {
+        schedule.autoscheduler.clear();
+        return true;
+    }
+    for (const char* autoscheduler : kAutoschedulers) {
+        if (lower == lowerCase(autoscheduler)) {
+            schedule.autoscheduler = autoscheduler;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool PipelineKey::operator<(const PipelineKey& other) const {
+    return std::make_tuple(kernel, type.code(), type.bits(), type.lanes(), params, target.to_string(),
+                           schedule.autoscheduler, schedule.estimateWidth, schedule.estimateHeight,
+                           schedule.estimateFrames) <
+           std::make_tuple(other.kernel, other.type.code(), other.type.bits(), other.type.lanes(), other.params,
+                           other.target.to_string(), other.schedule.autoscheduler, other.schedule.estimateWidth,
+                           other.schedule.estimateHeight, other.schedule.estimateFrames);
+}
+
+// The autoschedulers are plugins (autoschedule_adams2019 and so on) that Halide
+// loads on first use.
+static void loadAutoscheduler(const std::string& name) {
+    static std::set<std::string> loaded;
+    if (loaded.count(name) == 0) {
+        Halide::load_plugin("autoschedule_" + lowerCase(name));
+        loaded.insert(name);
+    }
+}
+
+// Estimate the input and output as the schedule's size, with 3 channels in
+// any dimension past y and, for a batched pipeline, estimateFrames in the
+// last, and let the autoscheduler schedule every stage.
+static void autoschedule(CachedPipeline& entry, Halide::Func output) {
+    const PipelineSchedule& schedule = entry.schedule;
+    auto estimates = [&](int dimensions) {
+        Halide::Region region = { { 0, schedule.estimateWidth }, { 0, schedule.estimateHeight } };
+        for (int d = 2; d < dimensions; d++) {
+            region.push_back({ 0, (entry.batched && d == dimensions - 1) ? schedule.estimateFrames : 3 });
+        }
+        return region;
+    };
+    Halide::Region input = estimates(entry.input.dimensions());
+    for (int d = 0; d < entry.input.dimensions(); d++) {
+        entry.input.dim(d).set_estimate(input[d].min, input[d].extent);
+    }
+    output.set_estimates(estimates(output.dimensions()));
+
+    loadAutoscheduler(schedule.autoscheduler);
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    Halide::AutoschedulerParams params(schedule.autoscheduler, { { "parallelism", std::to_string(threads) } });
+    entry.scheduleSource = entry.pipeline.apply_autoscheduler(entry.target, params).schedule_source;
+}
+
+CachedPipeline& PipelineCache::Get(const PipelineKey& key, const Builder& build) {
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    auto found = mEntries.find(key);
+    if (found != mEntries.end()) {
+        mStats.hits++;
+        return *found->second;
+    }
+
+    std::unique_ptr<CachedPipeline> entry(new CachedPipeline);
+    entry->target = key.target;
+    entry->schedule = key.schedule;
+    Halide::Func output = build(*entry);
+    entry->pipeline = Halide::Pipeline(output);
+    if (key.target.has_feature(Halide::Target::Profile)) {
+        CaptureProfilerReports(entry->pipeline);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    if (!key.schedule.IsManual()) {
+        autoschedule(*entry, output);
+    }
+    std::chrono::duration<double> scheduleTime = std::chrono::high_resolution_clock::now() - start;
+    entry->pipeline.compile_jit(key.target);
+    std::chrono::duration<double> compileTime = std::chrono::high_resolution_clock::now() - start;
+
+    mStats.misses++;
+    mStats.compileSeconds += compileTime.count();
+    mStats.autoscheduleSeconds += scheduleTime.count();
+    return *(mEntries[key] = std::move(entry));
+}
+
+PipelineCache::Stats PipelineCache::GetStats() const {
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+void PipelineCache::PrintStats(std::ostream& out) const {
+    Stats stats = GetStats();
+    out << "Pipeline cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+        << stats.compileSeconds << " s compiling";
+    if (stats.autoscheduleSeconds > 0.0) {
+        out << " (" << stats.autoscheduleSeconds << " s autoscheduling)";
+    }
+    out << std::endl;
+}
+
+void PipelineCache::Clear() {
+    std::lock_guard<std::mutex> lock(mMutex);
+    mEntries.clear();
+    mStats = Stats();
+}
+
+PipelineCache& GetPipelineCache() {
+    static PipelineCache cache;
+    return cache;
+}
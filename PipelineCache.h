@@ -0,0 +1,91 @@
+// PipelineCache.h : Compile-once cache for the JIT pipelines.
+//
+// Each entry is compiled against an ImageParam and Params, so later frames of
+// the same shape and kind only bind new inputs and run.
+
+#pragma once
+
+#include "Halide.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// How a pipeline is scheduled: by its hand-written schedule, or by one of
+// Halide's autoschedulers, tuned for an input of the estimated size.
+struct PipelineSchedule {
+    std::string autoscheduler;      ///< empty for the hand schedule, else "Adams2019", "Li2018" or "Mullapudi2016"
+    int estimateWidth = 4096;       ///< input (and output) size the autoscheduler tunes for
+    int estimateHeight = 3072;
+    int estimateFrames = 1;         ///< frames per realize, for batched pipelines
+
+    bool IsManual() const { return autoscheduler.empty(); }
+
+    // "manual", or the autoscheduler's name in lower case.
+    std::string Name() const;
+};
+
+// The autoschedulers ParseSchedule() knows, as Halide names them.
+extern const char* const kAutoschedulers[3];
+
+// Parse "manual" or an autoscheduler name in either case; false for anything else.
+bool ParseSchedule(const std::string& name, PipelineSchedule& schedule);
+
+// Everything that changes the generated code.
+struct PipelineKey {
+    std::string kernel;             ///< kernel name, e.g. "bayer_demosaic"
+    Halide::Type type;              ///< pixel type of the input
+    std::vector<int> params;        ///< compile-time parameters (radius, window size, ...)
+    Halide::Target target;
+    PipelineSchedule schedule;      ///< the hand schedule unless set
+
+    bool operator<(const PipelineKey& other) const;
+};
+
+// A compiled pipeline and the inputs to bind before each realize.
+struct CachedPipeline {
+    Halide::ImageParam input;
+    std::vector<Halide::Param<>> params;    ///< runtime scalars, in the order the builder created them
+    Halide::Pipeline pipeline;
+    Halide::Target target;
+    PipelineSchedule schedule;
+    std::string scheduleSource;     ///< the schedule an autoscheduler chose, as C++; empty for the hand schedule
+    bool batched = false;           ///< the input and output end in a frame dimension
+};
+
+class PipelineCache {
+public:
+    // Declares entry.input and entry.params, then defines the pipeline and
+    // returns its output Func. It applies the hand schedule only when
+    // entry.schedule.IsManual(), and gives every Param an estimate; otherwise
+    // the cache sets the input and output estimates and autoschedules it.
+    using Builder = std::function<Halide::Func(CachedPipeline& entry)>;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        double compileSeconds = 0.0;    ///< total JIT time spent on misses
+        double autoscheduleSeconds = 0.0;   ///< of which autoscheduling
+    };
+
+    // Look up key, building and compiling it on a miss. The returned entry lives
+    // as long as the cache. A CachedPipeline must not be realized from two
+    // threads at once, since its inputs are shared.
+    CachedPipeline& Get(const PipelineKey& key, const Builder& build);
+
+    Stats GetStats() const;
+    void PrintStats(std::ostream& out) const;
+    void Clear();
+
+private:
+    mutable std::mutex mMutex;
+    std::map<PipelineKey, std::unique_ptr<CachedPipeline>> mEntries;
+    Stats mStats;
+};
+
+// Cache shared by the JIT entry points in speedtests.cpp.
+PipelineCache& GetPipelineCache();
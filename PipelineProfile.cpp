@@ -0,0 +1,117 @@
+// PipelineProfile.cpp : Per-Func times and allocations from Halide's profiler.
+
+#include "PipelineProfile.h"
+
+#include "Halide.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+
+// The number after key in text, or 0 if key is not there.
+static double valueAfter(const std::string& text, const char* key) {
+    size_t at = text.find(key);
+    return at == std::string::npos ? 0.0 : strtod(text.c_str() + at + strlen(key), nullptr);
+}
+
+static bool startsWith(const std::string& text, const char* prefix) {
+    return text.compare(0, strlen(prefix), prefix) == 0;
+}
+
+// Reports look like
+//   pipeline_name
+//    total time: 12.3 ms  samples: 11  runs: 1  time/run: 12.3 ms
+//    average threads used: 7.9
+//    heap allocations: 4  peak heap usage: 65536 bytes
+//     stage:      1.2ms   (10%)    threads: 7.6  peak: 65536  num: 4  avg: 16384
+PipelineProfile ParseProfilerReports(const std::string& text) {
+    PipelineProfile profile;
+    std::vector<double> weights;    ///< runs summed into each func
+    std::istringstream lines(text);
+    std::string line;
+    int runs = 0;
+    while (std::getline(lines, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        if (line[0] != ' ') {
+            profile.pipeline = line;
+            runs = 0;
+        }
+        else if (startsWith(line, " total time:")) {
+            runs = std::max(1, int(valueAfter(line, "runs:")));
+            profile.runs += runs;
+            profile.ms += valueAfter(line, "time/run:") * runs;
+        }
+        else if (startsWith(line, " average threads used:")) {
+            profile.threads += valueAfter(line, "used:") * runs;
+        }
+        else if (startsWith(line, " heap allocations:")) {
+            profile.peakHeapBytes = std::max(profile.peakHeapBytes, valueAfter(line, "usage:"));
+        }
+        else if (startsWith(line, "  ") && runs > 0) {
+            size_t start = line.find_first_not_of(' ');
+            size_t colon = line.find(": ", start);
+            if (colon == std::string::npos) {
+                continue;
+            }
+            std::string name = line.substr(start, colon - start);
+            std::string rest = line.substr(colon + 1);
+            auto found = std::find_if(profile.funcs.begin(), profile.funcs.end(),
+                                      [&](const FuncProfile& f) { return f.name == name; });
+            if (found == profile.funcs.end()) {
+                profile.funcs.push_back(FuncProfile());
+                profile.funcs.back().name = name;
+                weights.push_back(0.0);
+                found = profile.funcs.end() - 1;
+            }
+            size_t index = size_t(found - profile.funcs.begin());
+            FuncProfile& func = *found;
+            func.ms += strtod(rest.c_str(), nullptr) * runs;
+            func.percent += valueAfter(rest, "(") * runs;
+            func.threads += valueAfter(rest, "threads:") * runs;
+            func.peakBytes = std::max(func.peakBytes, valueAfter(rest, "peak:"));
+            func.allocations += valueAfter(rest, "num:") * runs;
+            func.stackBytes = std::max(func.stackBytes, valueAfter(rest, "stack:"));
+            weights[index] += runs;
+        }
+    }
+
+    if (profile.runs > 0) {
+        profile.ms /= profile.runs;
+        profile.threads /= profile.runs;
+    }
+    for (size_t i = 0; i < profile.funcs.size(); i++) {
+        FuncProfile& func = profile.funcs[i];
+        if (weights[i] > 0.0) {
+            func.ms /= weights[i];
+            func.percent /= weights[i];
+            func.threads /= weights[i];
+            func.allocations /= weights[i];
+        }
+    }
+    return profile;
+}
+
+static std::mutex gCaptureMutex;
+static std::string gCaptured;
+
+static void capturePrint(Halide::JITUserContext*, const char* text) {
+    std::lock_guard<std::mutex> lock(gCaptureMutex);
+    gCaptured += text;
+}
+
+void CaptureProfilerReports(Halide::Pipeline& pipeline) {
+    pipeline.jit_handlers().custom_print = capturePrint;
+}
+
+PipelineProfile TakeProfilerReports() {
+    std::string text;
+    {
+        std::lock_guard<std::mutex> lock(gCaptureMutex);
+        text.swap(gCaptured);
+    }
+    return ParseProfilerReports(text);
+}
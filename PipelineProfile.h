@@ -0,0 +1,46 @@
+// PipelineProfile.h : Per-Func times and allocations from Halide's profiler.
+//
+// A JIT pipeline compiled for a target with Target::Profile prints a report
+// after every realize. CaptureProfilerReports() routes a pipeline's reports
+// into a buffer, and TakeProfilerReports() parses what has gathered there into
+// per-run averages.
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Halide {
+class Pipeline;
+}
+
+struct FuncProfile {
+    std::string name;
+    double ms = 0.0;                ///< time per run
+    double percent = 0.0;           ///< of the pipeline's time
+    double threads = 0.0;           ///< average threads working on it
+    double peakBytes = 0.0;         ///< largest heap allocation in use at once
+    double allocations = 0.0;       ///< heap allocations per run
+    double stackBytes = 0.0;
+};
+
+struct PipelineProfile {
+    std::string pipeline;
+    int runs = 0;
+    double ms = 0.0;                ///< time per run
+    double threads = 0.0;           ///< average threads in use
+    double peakHeapBytes = 0.0;
+    std::vector<FuncProfile> funcs; ///< in report order
+
+    bool empty() const { return runs == 0; }
+};
+
+// Parse one or more concatenated profiler reports, averaging over their runs.
+PipelineProfile ParseProfilerReports(const std::string& text);
+
+// Send the pipeline's profiler reports (and any other print) to the capture buffer.
+void CaptureProfilerReports(Halide::Pipeline& pipeline);
+
+// Parse and clear everything captured so far.
+PipelineProfile TakeProfilerReports();
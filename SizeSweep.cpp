@@ -0,0 +1,157 @@
+// SizeSweep.cpp : How the kernels' cost per pixel changes with image size.
+
+#include "SizeSweep.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <set>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+int CacheLevels::LevelFor(double bytes) const {
+    for (int level = 0; level < 3; level++) {
+        if (total[level] > 0 && bytes <= double(total[level])) {
+            return level + 1;
+        }
+    }
+    return 4;
+}
+
+#ifdef _WIN32
+
+static CacheLevels detectCacheLevels() {
+    CacheLevels caches;
+    DWORD length = 0;
+    GetLogicalProcessorInformation(nullptr, &length);
+    std::vector<SYSTEM_LOGICAL_PROCESSOR_INFORMATION> info(length / sizeof(SYSTEM_LOGICAL_PROCESSOR_INFORMATION));
+    if (info.empty() || !GetLogicalProcessorInformation(info.data(), &length)) {
+        return caches;
+    }
+    // One entry per cache instance.
+    for (const SYSTEM_LOGICAL_PROCESSOR_INFORMATION& entry : info) {
+        const CACHE_DESCRIPTOR& cache = entry.Cache;
+        if (entry.Relationship != RelationCache || cache.Level < 1 || cache.Level > 3 || cache.Type == CacheInstruction) {
+            continue;
+        }
+        caches.size[cache.Level - 1] = cache.Size;
+        caches.total[cache.Level - 1] += cache.Size;
+    }
+    return caches;
+}
+
+#else
+
+static std::string readLine(const std::string& path) {
+    std::ifstream file(path);
+    std::string line;
+    std::getline(file, line);
+    return line;
+}
+
+static CacheLevels detectCacheLevels() {
+    CacheLevels caches;
+    // Caches shared by several CPUs appear under each; count each instance once.
+    std::set<std::pair<int, std::string>> seen;
+    for (int cpu = 0;; cpu++) {
+        std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cache/";
+        if (readLine(dir + "index0/level").empty()) {
+            break;
+        }
+        for (int index = 0;; index++) {
+            std::string cache = dir + "index" + std::to_string(index) + "/";
+            std::string level = readLine(cache + "level");
+            if (level.empty()) {
+                break;
+            }
+            int n = atoi(level.c_str());
+            if (n < 1 || n > 3 || readLine(cache + "type") == "Instruction") {
+                continue;
+            }
+            // "48K", "2048K", "32M"
+            std::string text = readLine(cache + "size");
+            size_t bytes = size_t(strtoull(text.c_str(), nullptr, 10));
+            bytes <<= (text.find('M') != std::string::npos) ? 20 : (text.find('K') != std::string::npos) ? 10 : 0;
+            if (seen.insert({ n, readLine(cache + "shared_cpu_list") }).second) {
+                caches.size[n - 1] = bytes;
+                caches.total[n - 1] += bytes;
+            }
+        }
+    }
+    return caches;
+}
+
+#endif
+
+const CacheLevels& GetCacheLevels() {
+    static const CacheLevels caches = detectCacheLevels();
+    return caches;
+}
+
+std::vector<int> SweepSides(int minSide, int maxSide) {
+    std::vector<int> sides;
+    for (double side = std::max(16, minSide); side < maxSide; side *= std::sqrt(2.0)) {
+        int rounded = std::max(16, int(std::lround(side / 16.0)) * 16);
+        if (sides.empty() || rounded > sides.back()) {
+            sides.push_back(rounded);
+        }
+    }
+    if (sides.empty() || maxSide > sides.back()) {
+        sides.push_back(maxSide);
+    }
+    return sides;
+}
+
+// "12.0 KB", "3.0 MB", "1.5 GB"
+static std::string formatBytes(double bytes) {
+    const char* units[] = { "B", "KB", "MB", "GB", "TB" };
+    int unit = 0;
+    while (bytes >= 1024.0 && unit < 4) {
+        bytes /= 1024.0;
+        unit++;
+    }
+    char text[32];
+    snprintf(text, sizeof(text), "%.1f %s", bytes, units[unit]);
+    return text;
+}
+
+void SizeSweep::Print(std::ostream& out, const CacheLevels& caches) const {
+    const char* levelNames[] = { "L1", "L2", "L3", "DRAM" };
+    char line[200];
+    if (points.empty()) {
+        return;
+    }
+    double worst = 0.0;
+    for (const BenchResult& r : points) {
+        worst = std::max(worst, r.execute.median * 1e9 / (double(r.width) * r.height * r.frames));
+    }
+
+    snprintf(line, sizeof(line), "%s (%s)\n", kernel.c_str(), impl.c_str());
+    out << line;
+    snprintf(line, sizeof(line), "  %-13s %11s %5s %9s %8s\n", "size", "working set", "fits", "ns/pixel", "GB/s");
+    out << line;
+    double previous = 0.0;
+    for (const BenchResult& r : points) {
+        double nsPerPixel = r.execute.median * 1e9 / (double(r.width) * r.height * r.frames);
+        char size[32];
+        snprintf(size, sizeof(size), "%dx%d", r.width, r.height);
+        std::string bar(size_t(worst > 0.0 ? std::lround(30.0 * nsPerPixel / worst) : 0), '#');
+        char jump[32] = "";
+        if (previous > 0.0 && nsPerPixel >= 1.25 * previous) {
+            snprintf(jump, sizeof(jump), "  +%.0f%%", 100.0 * (nsPerPixel / previous - 1.0));
+        }
+        if (jump[0] != '\0') {
+            bar.resize(30, ' ');
+        }
+        snprintf(line, sizeof(line), "  %-13s %11s %5s %9.3f %8.2f  %s%s\n", size, formatBytes(double(r.bytes)).c_str(),
+                 levelNames[caches.LevelFor(double(r.bytes)) - 1], nsPerPixel, r.GBPerSec(), bar.c_str(), jump);
+        out << line;
+        previous = nsPerPixel;
+    }
+}
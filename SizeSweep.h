@@ -0,0 +1,43 @@
+// SizeSweep.h : How the kernels' cost per pixel changes with image size.
+//
+// A sweep runs a kernel on synthetic square inputs whose pixel count doubles
+// at each step, from a few kilobytes that stay in L1 up past the last-level
+// cache into DRAM. Plotting ns/pixel against the working set (bytes read plus
+// written by one run) shows the cliffs where the data falls out of a cache
+// level, which is where tile sizes and schedules need to change.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+
+// Data cache sizes of the host, 0 where unknown.
+struct CacheLevels {
+    size_t size[3] = {};        ///< L1 data, L2 and L3 of one instance (one core's, or one shared cache)
+    size_t total[3] = {};       ///< summed over every instance in the machine
+
+    // 1 to 3 for the first level whose total holds bytes, 4 for DRAM.
+    int LevelFor(double bytes) const;
+};
+
+// Read once, from sysfs on Linux and GetLogicalProcessorInformation on Windows.
+const CacheLevels& GetCacheLevels();
+
+// Sides from minSide to maxSide, each about sqrt(2) times the last so the
+// pixel count doubles, rounded to multiples of 16. maxSide is always included.
+std::vector<int> SweepSides(int minSide, int maxSide);
+
+struct SizeSweep {
+    std::string kernel;
+    std::string impl;
+    std::vector<BenchResult> points;    ///< in increasing size
+
+    // One row per size: working set, the cache level it fits in, ns/pixel and
+    // a bar of it, marking steps where ns/pixel jumps by a quarter or more.
+    void Print(std::ostream& out, const CacheLevels& caches) const;
+};
@@ -0,0 +1,194 @@
+// ThreadScaling.cpp : How the kernels scale with the number of worker threads.
+
+#include "ThreadScaling.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#define popen _popen
+#define pclose _pclose
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "TocMatrix.h"
+
+void SetWorkerThreads(unsigned threads) {
+    std::string value = std::to_string(std::max(1u, threads));
+#ifdef _WIN32
+    _putenv_s("HL_NUM_THREADS", value.c_str());
+#else
+    setenv("HL_NUM_THREADS", value.c_str(), 1);
+#endif
+}
+
+bool PinToCores(unsigned cores) {
+    cores = std::max(1u, cores);
+#ifdef _WIN32
+    DWORD_PTR mask = cores >= 8 * sizeof(DWORD_PTR) ? ~DWORD_PTR(0) : (DWORD_PTR(1) << cores) - 1;
+    return SetProcessAffinityMask(GetCurrentProcess(), mask) != 0;
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (unsigned i = 0; i < cores && i < CPU_SETSIZE; i++) {
+        CPU_SET(i, &set);
+    }
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+// Pin the calling thread to one logical processor.
+static void pinThread(unsigned cpu) {
+#ifdef _WIN32
+    if (cpu < 8 * sizeof(DWORD_PTR)) {
+        SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu);
+    }
+#elif defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % CPU_SETSIZE, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)cpu;
+#endif
+}
+
+std::vector<unsigned> ScalingThreadCounts(unsigned maxThreads) {
+    std::vector<unsigned> counts;
+    for (unsigned threads = 1; threads < maxThreads; threads *= 2) {
+        counts.push_back(threads);
+    }
+    counts.push_back(std::max(1u, maxThreads));
+    return counts;
+}
+
+bool RunBenchCommand(const std::string& command, std::vector<BenchResult>& results) {
+#ifdef _WIN32
+    // cmd.exe drops the first and last quote of a command that starts with one.
+    FILE* pipe = popen(("\"" + command + "\"").c_str(), "r");
+#else
+    FILE* pipe = popen(command.c_str(), "r");
+#endif
+    if (pipe == nullptr) {
+        return false;
+    }
+    std::string output;
+    char chunk[4096];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), pipe)) > 0) {
+        output.append(chunk, got);
+    }
+    pclose(pipe);
+
+    // The CSV may follow other lines the child printed first.
+    size_t header = output.find("kernel,impl,");
+    if (header == std::string::npos) {
+        return false;
+    }
+    std::istringstream csv(output.substr(header));
+    return ReadBenchResultsCsv(csv, results);
+}
+
+double MeasureCopyBandwidth(unsigned threads, bool pin, size_t bytes) {
+    threads = std::max(1u, threads);
+    size_t half = (bytes / 2) & ~(kTocAlign - 1);
+    std::unique_ptr<uint8_t, void (*)(void*)> block(static_cast<uint8_t*>(TocAlignedAlloc(2 * half)), TocAlignedFree);
+    if (!block || half == 0) {
+        return 0.0;
+    }
+    uint8_t* src = block.get();
+    uint8_t* dst = block.get() + half;
+    size_t share = (half / threads) & ~(kTocAlign - 1);
+
+    // Each thread touches its own share first, so pages land on its node.
+    auto run = [&](bool first) {
+        std::vector<std::thread> workers;
+        for (unsigned t = 0; t < threads; t++) {
+            workers.emplace_back([&, t]() {
+                if (pin) {
+                    pinThread(t);
+                }
+                size_t begin = t * share;
+                size_t size = (t + 1 == threads) ? half - begin : share;
+                if (first) {
+                    memset(src + begin, int(t), size);
+                    memset(dst + begin, 0, size);
+                }
+                else {
+                    memcpy(dst + begin, src + begin, size);
+                }
+            });
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+    };
+
+    run(true);
+    double best = 0.0;
+    for (int rep = 0; rep < 5; rep++) {
+        double seconds = TimeSeconds([&]() { run(false); });
+        best = std::max(best, seconds > 0.0 ? 2.0 * half / seconds / 1e9 : 0.0);
+    }
+    return best;
+}
+
+void ScalingCurve::Analyze() {
+    if (points.empty()) {
+        return;
+    }
+    double base = points.front().result.execute.median;
+    double best = 0.0;
+    for (ScalingPoint& point : points) {
+        double time = point.result.execute.median;
+        point.speedup = time > 0.0 ? base / time : 0.0;
+        point.efficiency = point.speedup * points.front().threads / point.threads;
+        best = std::max(best, point.result.GBPerSec());
+    }
+    for (const ScalingPoint& point : points) {
+        if (point.result.GBPerSec() >= 0.9 * best) {
+            saturationThreads = point.threads;
+            bandwidthBound = point.copyGBPerSec > 0.0 && point.result.GBPerSec() >= 0.7 * point.copyGBPerSec;
+            break;
+        }
+    }
+}
+
+void ScalingCurve::Print(std::ostream& out) const {
+    char line[200];
+    if (points.empty()) {
+        return;
+    }
+    const BenchResult& first = points.front().result;
+    snprintf(line, sizeof(line), "%s (%s) %dx%d\n", kernel.c_str(), impl.c_str(), first.width, first.height);
+    out << line;
+    snprintf(line, sizeof(line), "  %7s %10s %9s %8s %8s %6s %9s %7s\n", "threads", "median ms", "MP/s", "GB/s",
+             "speedup", "eff.", "copy GB/s", "of copy");
+    out << line;
+    for (const ScalingPoint& point : points) {
+        double ofCopy = point.copyGBPerSec > 0.0 ? 100.0 * point.result.GBPerSec() / point.copyGBPerSec : 0.0;
+        snprintf(line, sizeof(line), "  %7u %10.3f %9.1f %8.2f %7.2fx %5.0f%% %9.2f %6.0f%%\n", point.threads,
+                 point.result.execute.median * 1e3, point.result.MPixPerSec(), point.result.GBPerSec(), point.speedup,
+                 100.0 * point.efficiency, point.copyGBPerSec, ofCopy);
+        out << line;
+    }
+    if (saturationThreads == points.back().threads && points.size() > 1) {
+        snprintf(line, sizeof(line), "  still scaling at %u threads\n", saturationThreads);
+    }
+    else {
+        snprintf(line, sizeof(line), "  saturates at %u threads%s\n", saturationThreads,
+                 bandwidthBound ? ", near the copy bandwidth: memory bound" : "");
+    }
+    out << line;
+}
@@ -0,0 +1,57 @@
+// ThreadScaling.h : How the kernels scale with the number of worker threads.
+//
+// Halide sizes its thread pool once per process, from HL_NUM_THREADS, so a
+// scaling study measures each thread count in a child speedtests started with
+// --threads N (and, with --pin, confined to N cores). The children report CSV,
+// which is read back into one curve per kernel. Alongside, a multi-threaded
+// copy at the same thread counts gives the memory bandwidth the machine can
+// sustain, so a kernel whose curve flattens near it is bandwidth bound.
+
+#pragma once
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "Benchmark.h"
+
+// Set the Halide runtime's thread pool size (JIT and AOT) for this process.
+// Only takes effect before the first pipeline runs.
+void SetWorkerThreads(unsigned threads);
+
+// Confine this process, and every thread it starts, to the first `cores`
+// logical processors. Returns false where affinity is not supported.
+bool PinToCores(unsigned cores);
+
+// 1, 2, 4, ... up to maxThreads, always ending with maxThreads itself.
+std::vector<unsigned> ScalingThreadCounts(unsigned maxThreads);
+
+// Run a command that writes WriteBenchResults() CSV to stdout and read its
+// results. Returns false if it could not be started or printed no CSV.
+bool RunBenchCommand(const std::string& command, std::vector<BenchResult>& results);
+
+// Bytes read plus written per second by `threads` threads copying their
+// share of a `bytes` buffer, best of a few runs. With pin, thread i runs on
+// logical processor i.
+double MeasureCopyBandwidth(unsigned threads, bool pin, size_t bytes = size_t(512) << 20);
+
+struct ScalingPoint {
+    unsigned threads = 0;
+    BenchResult result;
+    double copyGBPerSec = 0.0;  ///< MeasureCopyBandwidth() at the same thread count; 0 if not measured
+    double speedup = 0.0;       ///< against one thread
+    double efficiency = 0.0;    ///< speedup / threads
+};
+
+struct ScalingCurve {
+    std::string kernel;
+    std::string impl;
+    std::vector<ScalingPoint> points;   ///< in increasing thread count
+    unsigned saturationThreads = 0;     ///< fewest threads reaching 90% of the best throughput
+    bool bandwidthBound = false;        ///< at saturation, at least 70% of the copy bandwidth
+
+    // Fill in speedup, efficiency and the saturation point.
+    void Analyze();
+    void Print(std::ostream& out) const;
+};
@@ -0,0 +1,636 @@
+/*
+Copyright(c) 2024 Transformative Optics.All rights reserved.
+
+This software and its documentation are considered to be
+proprietary and confidential information of Transformative Optics,
+and may not be disclosed to unauthorized individuals
+or used in any way not expressly authorized
+by the license agreement accompanying this product.
+
+Unauthorized copying of this file, via any medium,
+is strictly prohibited.Modification, reverse engineering, disassembly,
+or decompilation of this software is prohibited unless expressly permitted
+by a written agreement with Transformative Optics.
+
+----------------------------------------------------------
+Description:
+Configurable tiff write.
+
+libTiff encodes a strip inside TIFFWriteEncodedStrip() on the calling thread,
+so a compressed file is normally written at the speed of one core.  Here
+each strip (or tile) is encoded into a private in-memory TIFF on a worker,
+and the encoded bytes are appended to the real file with TIFFWriteRawStrip()
+in strip order.  Any codec libTiff was built with works this way.
+
+CTiffDstStream writes the same file a band of rows at a time: the chunks of
+each band are encoded and appended as the band arrives, so only one band of
+the image is ever in memory.
+
+*/
+#include "TiffDstFile.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+
+/**
+ *  Growable in-memory file behind a libTiff client handle.
+*/
+struct MemFile
+{
+    std::vector<uint8_t>	bytes;
+    uint64_t				nPos = 0;
+};
+
+static tmsize_t
+MemRead(thandle_t hFile, void * pBuf, tmsize_t nSize)
+{
+    MemFile *   pMem = static_cast<MemFile *>(hFile);
+    uint64_t    nAvail = pMem->nPos < pMem->bytes.size() ? pMem->bytes.size() - pMem->nPos : 0;
+    tmsize_t    nRead = static_cast<tmsize_t>(TMin<uint64_t>(nAvail, static_cast<uint64_t>(nSize)));
+
+    memcpy(pBuf, pMem->bytes.data() + pMem->nPos, nRead);
+    pMem->nPos += nRead;
+    return(nRead);
+}
+
+static tmsize_t
+MemWrite(thandle_t hFile, void * pBuf, tmsize_t nSize)
+{
+    MemFile *   pMem = static_cast<MemFile *>(hFile);
+
+    if (pMem->nPos + nSize > pMem->bytes.size()) {
+        pMem->bytes.resize(pMem->nPos + nSize);
+    }
+    memcpy(pMem->bytes.data() + pMem->nPos, pBuf, nSize);
+    pMem->nPos += nSize;
+    return(nSize);
+}
+
+static toff_t
+MemSeek(thandle_t hFile, toff_t nOffset, int nWhence)
+{
+    MemFile *   pMem = static_cast<MemFile *>(hFile);
+
+    switch (nWhence) {
+    case SEEK_SET:  pMem->nPos = nOffset; break;
+    case SEEK_CUR:  pMem->nPos += nOffset; break;
+    case SEEK_END:  pMem->nPos = pMem->bytes.size() + nOffset; break;
+    }
+    return(pMem->nPos);
+}
+
+static int
+MemClose(thandle_t)
+{
+    return(0);
+}
+
+static toff_t
+MemSize(thandle_t hFile)
+{
+    return(static_cast<MemFile *>(hFile)->bytes.size());
+}
+
+static int
+MemMap(thandle_t, void **, toff_t *)
+{
+    return(0);
+}
+
+static void
+MemUnmap(thandle_t, void *, toff_t)
+{
+}
+
+
+/**
+ *  Where each strip (or tile) of the image lies.
+ *
+ *  Chunks are numbered as libTiff numbers strips and tiles: across, then
+ *  down, then plane by plane for PLANARCONFIG_SEPARATE.  A band of a larger
+ *  file starts nFirstChunkY chunk rows down a file nFileChunksY chunk rows
+ *  high; FileChunk() maps its chunks to the file's numbering.
+*/
+struct ChunkLayout
+{
+    const TiffImageView *	pImage;
+    bool			bTiled;
+    bool			bSeparate;
+    uint32_t		nChunkWidth;		// tile width, or the image width
+    uint32_t		nChunkHeight;		// tile height, or rows per strip
+    uint32_t		nChunksX;
+    uint32_t		nChunksY;
+    uint16_t		nChunkSamples;		// samples per pixel within a chunk
+    size_t			nPixBytes;
+    uint32_t		nFirstChunkY;		// band offset, 0 for a whole image
+    uint32_t		nFileChunksY;		// chunk rows in the file
+
+    uint32_t Count() const {
+        return(nChunksX * nChunksY * (bSeparate ? pImage->nSampPerPixel : 1));
+    }
+
+    uint32_t FileChunk(uint32_t nChunk) const {
+        uint32_t    nPerPlane = nChunksX * nChunksY;
+        return((nChunk / nPerPlane) * nChunksX * nFileChunksY + nFirstChunkY * nChunksX + nChunk % nPerPlane);
+    }
+};
+
+
+static bool
+MakeLayout(const TiffImageView & image, const TiffWriteOptions & options, ChunkLayout & layout)
+{
+    if (image.nWidth == 0 || image.nHeight == 0 || image.nSampPerPixel == 0 ||
+        (image.nBitsPerSamp != 8 && image.nBitsPerSamp != 16)) {
+        return(false);
+    }
+
+    layout.pImage = &image;
+    layout.bTiled = (options.nTileWidth != 0 && options.nTileHeight != 0);
+    layout.bSeparate = (image.nPlaneStride != 0 && image.nSampPerPixel > 1);
+    layout.nChunkSamples = layout.bSeparate ? 1 : image.nSampPerPixel;
+    layout.nPixBytes = layout.nChunkSamples * (image.nBitsPerSamp / 8);
+
+    if (layout.bTiled) {
+        // The TIFF spec requires tile dimensions to be multiples of 16
+        if ((options.nTileWidth % 16) != 0 || (options.nTileHeight % 16) != 0) {
+            return(false);
+        }
+        layout.nChunkWidth = options.nTileWidth;
+        layout.nChunkHeight = options.nTileHeight;
+    }
+    else {
+        size_t      nRowBytes = image.nWidth * layout.nPixBytes;
+        uint32_t    nRows = options.nRowsPerStrip;
+
+        if (nRows == 0) {
+            nRows = static_cast<uint32_t>(TMax<size_t>(1, kTiffStripBytes / nRowBytes));
+        }
+        layout.nChunkWidth = image.nWidth;
+        layout.nChunkHeight = TMin(nRows, image.nHeight);
+    }
+    layout.nChunksX = (image.nWidth + layout.nChunkWidth - 1) / layout.nChunkWidth;
+    layout.nChunksY = (image.nHeight + layout.nChunkHeight - 1) / layout.nChunkHeight;
+    layout.nFirstChunkY = 0;
+    layout.nFileChunksY = layout.nChunksY;
+    return(true);
+}
+
+
+/**
+ * \brief Find chunk nChunk in the image, copying it into scratch if needed.
+ *
+ * A strip whose rows are packed is used in place unless bCopy is set.  Tiles
+ * are always copied; the part of an edge tile outside the image is zero.
+ *
+ * @param  pChunk = receives the packed chunk.
+ * @param  nBytes = receives its size.
+ * @param  nRows  = receives its height (short for the last strip).
+ */
+static void
+GatherChunk(const ChunkLayout & layout, uint32_t nChunk, bool bCopy, std::vector<uint8_t> & scratch,
+            const uint8_t *& pChunk, tmsize_t & nBytes, uint32_t & nRows)
+{
+    const TiffImageView &   image = *layout.pImage;
+    uint32_t    nPerPlane = layout.nChunksX * layout.nChunksY;
+    uint32_t    nPlane = nChunk / nPerPlane;
+    uint32_t    nX0 = (nChunk % nPerPlane % layout.nChunksX) * layout.nChunkWidth;
+    uint32_t    nY0 = (nChunk % nPerPlane / layout.nChunksX) * layout.nChunkHeight;
+    uint32_t    nValidRows = TMin(layout.nChunkHeight, image.nHeight - nY0);
+    size_t      nValidBytes = TMin(layout.nChunkWidth, image.nWidth - nX0) * layout.nPixBytes;
+    size_t      nRowBytes = layout.nChunkWidth * layout.nPixBytes;
+    const uint8_t * pSrc = static_cast<const uint8_t *>(image.pData) + nPlane * image.nPlaneStride +
+                           nY0 * image.nRowStride + nX0 * layout.nPixBytes;
+
+    nRows = layout.bTiled ? layout.nChunkHeight : nValidRows;
+    nBytes = static_cast<tmsize_t>(nRows * nRowBytes);
+
+    if (!layout.bTiled && !bCopy && image.nRowStride == nRowBytes) {
+        pChunk = pSrc;
+        return;
+    }
+
+    scratch.resize(nBytes);
+    if (nValidRows < nRows || nValidBytes < nRowBytes) {
+        memset(scratch.data(), 0, nBytes);
+    }
+    for (uint32_t nRow = 0; nRow < nValidRows; nRow++) {
+        memcpy(scratch.data() + nRow * nRowBytes, pSrc + nRow * image.nRowStride, nValidBytes);
+    }
+    pChunk = scratch.data();
+}
+
+
+/**
+ * \brief Compress chunk nChunk into encoded.
+ *
+ * The chunk is written as the only strip (or tile) of an in-memory TIFF with
+ * the same codec settings as the real file, and its encoded bytes are lifted
+ * out.  The chunk is always copied first since the predictor may difference
+ * its input in place.
+ */
+static bool
+EncodeChunk(const ChunkLayout & layout, const TiffWriteOptions & options, uint32_t nChunk,
+            std::vector<uint8_t> & scratch, MemFile & mem, std::vector<uint8_t> & encoded)
+{
+    const uint8_t * pChunk;
+    tmsize_t        nBytes;
+    uint32_t        nRows;
+    bool            bOk = false;
+
+    GatherChunk(layout, nChunk, true, scratch, pChunk, nBytes, nRows);
+
+    mem.bytes.clear();
+    mem.nPos = 0;
+    TIFF * pMem = TIFFClientOpen("chunk", "w", static_cast<thandle_t>(&mem), MemRead, MemWrite, MemSeek,
+                                 MemClose, MemSize, MemMap, MemUnmap);
+    if (pMem == NULL) {
+        return(false);
+    }
+
+    TIFFSetField(pMem, TIFFTAG_IMAGEWIDTH, layout.nChunkWidth);
+    TIFFSetField(pMem, TIFFTAG_IMAGELENGTH, nRows);
+    TIFFSetField(pMem, TIFFTAG_BITSPERSAMPLE, layout.pImage->nBitsPerSamp);
+    TIFFSetField(pMem, TIFFTAG_SAMPLESPERPIXEL, layout.nChunkSamples);
+    TIFFSetField(pMem, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(pMem, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(pMem, TIFFTAG_COMPRESSION, options.nCompression);
+    if (options.bPredictor) {
+        TIFFSetField(pMem, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+    }
+    if (options.nLevel >= 0) {
+        if (options.nCompression == COMPRESSION_ADOBE_DEFLATE) {
+            TIFFSetField(pMem, TIFFTAG_ZIPQUALITY, options.nLevel);
+        }
+#ifdef TIFFTAG_ZSTD_LEVEL
+        else if (options.nCompression == COMPRESSION_ZSTD) {
+            TIFFSetField(pMem, TIFFTAG_ZSTD_LEVEL, options.nLevel);
+        }
+#endif
+    }
+
+    void * pData = const_cast<uint8_t *>(pChunk);
+    tmsize_t nWritten;
+    if (layout.bTiled) {
+        TIFFSetField(pMem, TIFFTAG_TILEWIDTH, layout.nChunkWidth);
+        TIFFSetField(pMem, TIFFTAG_TILELENGTH, layout.nChunkHeight);
+        nWritten = TIFFWriteEncodedTile(pMem, 0, pData, nBytes);
+    }
+    else {
+        TIFFSetField(pMem, TIFFTAG_ROWSPERSTRIP, nRows);
+        nWritten = TIFFWriteEncodedStrip(pMem, 0, pData, nBytes);
+    }
+
+    if (nWritten == nBytes) {
+        uint64_t    nOffset = TIFFGetStrileOffset(pMem, 0);
+        uint64_t    nCount = TIFFGetStrileByteCount(pMem, 0);
+
+        if (nOffset + nCount <= mem.bytes.size()) {
+            encoded.assign(mem.bytes.begin() + nOffset, mem.bytes.begin() + nOffset + nCount);
+            bOk = true;
+        }
+    }
+
+    TIFFClose(pMem);
+    return(bOk);
+}
+
+
+static bool
+WriteRawChunk(TIFF * pTiff, const ChunkLayout & layout, uint32_t nChunk, const uint8_t * pData, tmsize_t nBytes)
+{
+    void *      pRaw = const_cast<uint8_t *>(pData);
+    uint32_t    nFileChunk = layout.FileChunk(nChunk);
+    tmsize_t    nWritten = layout.bTiled ? TIFFWriteRawTile(pTiff, nFileChunk, pRaw, nBytes)
+                                         : TIFFWriteRawStrip(pTiff, nFileChunk, pRaw, nBytes);
+    return(nWritten == nBytes);
+}
+
+
+/**
+ * \brief Encode the chunks on nThreads workers and write them in order.
+ *
+ * At most nWindow chunks are encoded ahead of the writer, which bounds the
+ * memory held in encoded chunks.  Slot n % nWindow is free for chunk n once
+ * chunk n - nWindow has been written.
+ */
+static bool
+WriteChunksParallel(TIFF * pTiff, const ChunkLayout & layout, const TiffWriteOptions & options, unsigned nThreads)
+{
+    struct EncodedChunk
+    {
+        std::vector<uint8_t>	bytes;
+        bool					bReady = false;
+        bool					bOk = false;
+    };
+
+    uint32_t                    nChunks = layout.Count();
+    uint32_t                    nWindow = 2 * nThreads;
+    std::vector<EncodedChunk>   slots(nWindow);
+    std::mutex                  mtx;
+    std::condition_variable     cvReady;
+    std::condition_variable     cvFree;
+    std::atomic<uint32_t>       nNextChunk(0);
+    uint32_t                    nWritten = 0;
+    bool                        bAbort = false;
+
+    auto worker = [&]() {
+        MemFile                 mem;
+        std::vector<uint8_t>    scratch;
+
+        for (uint32_t nChunk = nNextChunk++; nChunk < nChunks; nChunk = nNextChunk++) {
+            {
+                std::unique_lock<std::mutex>    lock(mtx);
+                cvFree.wait(lock, [&]() { return bAbort || nChunk < nWritten + nWindow; });
+                if (bAbort) {
+                    return;
+                }
+            }
+
+            // The slot belongs to this worker until it is marked ready
+            EncodedChunk &  slot = slots[nChunk % nWindow];
+            bool            bOk = EncodeChunk(layout, options, nChunk, scratch, mem, slot.bytes);
+            {
+                std::lock_guard<std::mutex>     lock(mtx);
+                slot.bOk = bOk;
+                slot.bReady = true;
+            }
+            cvReady.notify_all();
+        }
+    };
+
+    std::vector<std::thread>    threads;
+    for (unsigned nThread = 0; nThread < nThreads; nThread++) {
+        threads.emplace_back(worker);
+    }
+
+    bool bOk = true;
+    for (uint32_t nChunk = 0; nChunk < nChunks && bOk; nChunk++) {
+        EncodedChunk &  slot = slots[nChunk % nWindow];
+        {
+            std::unique_lock<std::mutex>    lock(mtx);
+            cvReady.wait(lock, [&]() { return slot.bReady; });
+        }
+
+        bOk = slot.bOk && WriteRawChunk(pTiff, layout, nChunk, slot.bytes.data(),
+                                        static_cast<tmsize_t>(slot.bytes.size()));
+        {
+            std::lock_guard<std::mutex>     lock(mtx);
+            slot.bReady = false;
+            nWritten++;
+            bAbort = !bOk;
+        }
+        cvFree.notify_all();
+    }
+
+    for (std::thread & thread : threads) {
+        thread.join();
+    }
+    return(bOk);
+}
+
+
+/**
+ *  Create the file for an image (whose pData is not used) and set its tags.
+ *
+ *  @return NULL on failure, with the reason in ec.
+*/
+static TIFF *
+CreateImageFile(const char * pFNameTiff, const TiffImageView & image, const TiffWriteOptions & options,
+                const ChunkLayout & layout, TocErr_t & ec)
+{
+    bool            bCompressed = (options.nCompression != COMPRESSION_NONE);
+
+    if (bCompressed && !TIFFIsCODECConfigured(options.nCompression)) {
+        ec = kErrTiff_Codec;
+        return(NULL);
+    }
+
+    // Classic TIFF offsets are 32 bits.  Leave room for codec overhead on
+    //  data that does not compress, and for the directory.
+    uint64_t    nRawBytes = uint64_t(image.nWidth) * image.nHeight * image.nSampPerPixel * (image.nBitsPerSamp / 8);
+    bool        bBigTiff = (options.eBigTiff == kTiffBigAlways) ||
+                           (options.eBigTiff == kTiffBigAuto && nRawBytes + nRawBytes / 64 + (1 << 20) > 0xFFFFFFFFull);
+
+    TIFF * pTiff = TIFFOpen(pFNameTiff, bBigTiff ? "w8" : "w");
+    if (pTiff == NULL) {
+        ec = kErrTiff_Create;
+        return(NULL);
+    }
+
+    TIFFSetField(pTiff, TIFFTAG_IMAGEWIDTH, image.nWidth);
+    TIFFSetField(pTiff, TIFFTAG_IMAGELENGTH, image.nHeight);
+    TIFFSetField(pTiff, TIFFTAG_BITSPERSAMPLE, image.nBitsPerSamp);
+    TIFFSetField(pTiff, TIFFTAG_SAMPLESPERPIXEL, image.nSampPerPixel);
+    TIFFSetField(pTiff, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
+    TIFFSetField(pTiff, TIFFTAG_PLANARCONFIG, layout.bSeparate ? PLANARCONFIG_SEPARATE : PLANARCONFIG_CONTIG);
+    TIFFSetField(pTiff, TIFFTAG_PHOTOMETRIC, image.nSampPerPixel == 3 ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK);
+    if (image.nSampPerPixel != 1 && image.nSampPerPixel != 3) {
+        std::vector<uint16_t>   extra(image.nSampPerPixel - (image.nSampPerPixel > 3 ? 3 : 1), EXTRASAMPLE_UNSPECIFIED);
+        TIFFSetField(pTiff, TIFFTAG_EXTRASAMPLES, static_cast<uint16_t>(extra.size()), extra.data());
+    }
+    TIFFSetField(pTiff, TIFFTAG_COMPRESSION, options.nCompression);
+    if (bCompressed && options.bPredictor) {
+        TIFFSetField(pTiff, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+    }
+    if (layout.bTiled) {
+        TIFFSetField(pTiff, TIFFTAG_TILEWIDTH, layout.nChunkWidth);
+        TIFFSetField(pTiff, TIFFTAG_TILELENGTH, layout.nChunkHeight);
+    }
+    else {
+        TIFFSetField(pTiff, TIFFTAG_ROWSPERSTRIP, layout.nChunkHeight);
+    }
+
+    ec = kNoError;
+    return(pTiff);
+}
+
+
+/**
+ *  Write every chunk of layout: straight from the image when uncompressed
+ *  (packed strips without a copy), encoded on options.nThreads workers
+ *  otherwise.
+*/
+static bool
+WriteChunks(TIFF * pTiff, const ChunkLayout & layout, const TiffWriteOptions & options)
+{
+    bool        bCompressed = (options.nCompression != COMPRESSION_NONE);
+    uint32_t    nChunks = layout.Count();
+    unsigned    nThreads = options.nThreads;
+    bool        bOk = true;
+
+    if (nThreads == 0) {
+        nThreads = TMax(1u, std::thread::hardware_concurrency());
+    }
+    nThreads = TMin(nThreads, nChunks);
+
+    if (bCompressed && nThreads > 1) {
+        bOk = WriteChunksParallel(pTiff, layout, options, nThreads);
+    }
+    else {
+        MemFile                 mem;
+        std::vector<uint8_t>    scratch;
+        std::vector<uint8_t>    encoded;
+
+        for (uint32_t nChunk = 0; nChunk < nChunks && bOk; nChunk++) {
+            if (bCompressed) {
+                bOk = EncodeChunk(layout, options, nChunk, scratch, mem, encoded) &&
+                      WriteRawChunk(pTiff, layout, nChunk, encoded.data(), static_cast<tmsize_t>(encoded.size()));
+            }
+            else {
+                const uint8_t * pChunk;
+                tmsize_t        nBytes;
+                uint32_t        nRows;
+
+                GatherChunk(layout, nChunk, false, scratch, pChunk, nBytes, nRows);
+                bOk = WriteRawChunk(pTiff, layout, nChunk, pChunk, nBytes);
+            }
+        }
+    }
+
+    return(bOk);
+}
+
+
+/**
+ *  Write a single-page TIFF.
+ *
+ *  @return Error Code
+*/
+TocErr_t
+TiffWriteImage(const char * pFNameTiff, const TiffImageView & image, const TiffWriteOptions & options)
+{
+    ChunkLayout     layout;
+    TocErr_t        ec;
+
+    if (image.pData == NULL) {
+        return(kErrSys_BadPtr);
+    }
+    if (!MakeLayout(image, options, layout)) {
+        return(kErrSys_BadArg);
+    }
+
+    TIFF * pTiff = CreateImageFile(pFNameTiff, image, options, layout, ec);
+    if (pTiff == NULL) {
+        return(ec);
+    }
+
+    bool bOk = WriteChunks(pTiff, layout, options);
+
+    TIFFClose(pTiff);
+    return(bOk ? kNoError : kErrTiff_Write);
+}
+
+
+/**
+ *  Create the file and write its tags.
+ *
+ *  @param  bPlanar = one plane per sample (PLANARCONFIG_SEPARATE)
+ *  @return Error Code
+*/
+TocErr_t
+CTiffDstStream::Open(const char * pFNameTiff, uint32_t nWidth, uint32_t nHeight, uint16_t nSampPerPixel,
+                     uint16_t nBitsPerSamp, bool bPlanar, const TiffWriteOptions & options)
+{
+    TiffImageView   image;
+    ChunkLayout     layout;
+    TocErr_t        ec;
+
+    Close();
+
+    // Only the shape matters here; the plane stride just has to be non-zero.
+    image.pData = NULL;
+    image.nWidth = nWidth;
+    image.nHeight = nHeight;
+    image.nSampPerPixel = nSampPerPixel;
+    image.nBitsPerSamp = nBitsPerSamp;
+    image.nRowStride = 0;
+    image.nPlaneStride = bPlanar ? 1 : 0;
+
+    if (!MakeLayout(image, options, layout)) {
+        return(kErrSys_BadArg);
+    }
+
+    mPTiff = CreateImageFile(pFNameTiff, image, options, layout, ec);
+    if (mPTiff == NULL) {
+        return(ec);
+    }
+
+    mOptions = options;
+    mWidth = nWidth;
+    mHeight = nHeight;
+    mSampPerPixel = nSampPerPixel;
+    mBitsPerSamp = nBitsPerSamp;
+    mbPlanar = bPlanar;
+    mChunkHeight = layout.nChunkHeight;
+    mRowsWritten = 0;
+    return(kNoError);
+}
+
+
+/**
+ *  Write the next band: rows GetRowsWritten() to GetRowsWritten() + band.nHeight.
+ *
+ *  The band must match the image's width, samples and layout, and must be a
+ *  whole number of chunk rows unless it ends the image.
+ *
+ *  @return Error Code
+*/
+TocErr_t
+CTiffDstStream::WriteBand(const TiffImageView & band)
+{
+    ChunkLayout         layout;
+    TiffWriteOptions    options = mOptions;
+
+    if (mPTiff == NULL) {
+        return(kErrTiff_PTiff);
+    }
+    if (band.pData == NULL || band.nWidth != mWidth || band.nSampPerPixel != mSampPerPixel ||
+        band.nBitsPerSamp != mBitsPerSamp || (band.nPlaneStride != 0) != (mbPlanar && mSampPerPixel > 1) ||
+        band.nHeight == 0 || band.nHeight > mHeight - mRowsWritten ||
+        (band.nHeight % mChunkHeight != 0 && mRowsWritten + band.nHeight != mHeight)) {
+        return(kErrSys_BadArg);
+    }
+
+    // Strips of the file's height; the last band may end in a short one
+    if (options.nTileWidth == 0 || options.nTileHeight == 0) {
+        options.nRowsPerStrip = mChunkHeight;
+    }
+    if (!MakeLayout(band, options, layout)) {
+        return(kErrSys_BadArg);
+    }
+    layout.nFirstChunkY = mRowsWritten / mChunkHeight;
+    layout.nFileChunksY = (mHeight + mChunkHeight - 1) / mChunkHeight;
+
+    if (!WriteChunks(mPTiff, layout, options)) {
+        return(kErrTiff_Write);
+    }
+    mRowsWritten += band.nHeight;
+    return(kNoError);
+}
+
+
+/**
+ *  Write the directory and close the file.  Fails if rows are missing.
+ *
+ *  @return Error Code
+*/
+TocErr_t
+CTiffDstStream::Close()
+{
+    TocErr_t    ec = kNoError;
+
+    if (mPTiff != NULL) {
+        if (mRowsWritten != mHeight) {
+            ec = kErrTiff_Write;
+        }
+        TIFFClose(mPTiff);
+        mPTiff = NULL;
+    }
+    mRowsWritten = 0;
+    return(ec);
+}
@@ -0,0 +1,152 @@
+/*
+Copyright(c) 2024 Transformative Optics.All rights reserved.
+
+This software and its documentation are considered to be
+proprietary and confidential information of Transformative Optics,
+and may not be disclosed to unauthorized individuals
+or used in any way not expressly authorized
+by the license agreement accompanying this product.
+
+Unauthorized copying of this file, via any medium,
+is strictly prohibited.Modification, reverse engineering, disassembly,
+or decompilation of this software is prohibited unless expressly permitted
+by a written agreement with Transformative Optics.
+
+----------------------------------------------------------
+Description:
+
+TiffDstFile.h - configurable TIFF writer: strip or tile layout, optional
+Deflate / LZW / ZSTD compression with a horizontal predictor, strips (or
+tiles) compressed on several threads and written in order, and BigTIFF.
+CTiffDstStream writes the same files a band of rows at a time.
+
+*/
+#ifndef __TIFFDSTFILE_H__
+#define __TIFFDSTFILE_H__   1
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "TiffSrcFile.h"
+
+
+// BigTIFF (64-bit offsets) selection
+enum TiffBigMode
+{
+    kTiffBigAuto = 0,       // BigTIFF only when the image could pass 4 GB
+    kTiffBigNever,
+    kTiffBigAlways
+};
+
+
+/**
+ * \brief How TiffWriteImage() lays out and encodes a file.
+ *
+ * Strips are used unless both tile dimensions are set; tile dimensions must
+ * be multiples of 16.  With compression each strip (or tile) is encoded on
+ * one of nThreads workers and the encoded chunks are written in file order.
+ */
+struct TiffWriteOptions
+{
+    uint16_t		nCompression = COMPRESSION_NONE;	// COMPRESSION_ADOBE_DEFLATE, _LZW or _ZSTD
+    bool			bPredictor = true;		// horizontal differencing when compressed
+    int				nLevel = -1;			// Deflate 1..9 / ZSTD 1..19, -1 for the codec default
+    uint32_t		nRowsPerStrip = 0;		// 0 picks about kTiffStripBytes per strip
+    uint32_t		nTileWidth = 0;			// tiled layout when both are set
+    uint32_t		nTileHeight = 0;
+    unsigned		nThreads = 0;			// encoding workers, 0 for hardware concurrency
+    TiffBigMode		eBigTiff = kTiffBigAuto;
+};
+
+// Default strip size: large enough to amortise the per-strip cost, small
+//  enough to give every worker several strips to compress.
+const size_t	kTiffStripBytes = 1 << 20;
+
+
+/**
+ * \brief An image in memory to be written.
+ *
+ * Samples are interleaved unless nPlaneStride is set, in which case each
+ * sample is a separate plane nPlaneStride bytes after the previous one and
+ * the file is written with PLANARCONFIG_SEPARATE (no interleaving copy).
+ */
+struct TiffImageView
+{
+    const void *	pData;
+    uint32_t		nWidth;
+    uint32_t		nHeight;
+    uint16_t		nSampPerPixel;
+    uint16_t		nBitsPerSamp;		// 8 or 16
+    size_t			nRowStride;			// bytes between rows
+    size_t			nPlaneStride;		// bytes between planes, 0 for interleaved
+};
+
+
+// Write a single-page TIFF.  A shape or layout the options cannot describe
+//  (e.g. tile dimensions that are not multiples of 16) is kErrSys_BadArg.
+TocErr_t TiffWriteImage(const char * pFNameTiff, const TiffImageView & image,
+                        const TiffWriteOptions & options = TiffWriteOptions());
+
+
+/**
+ * \brief A single-page TIFF written band by band, for images too large to
+ * hold in memory.
+ *
+ * Open() sets the tags for the whole image; WriteBand() then takes the rows
+ * from GetRowsWritten() on, in order, encoding each band's strips (or tiles)
+ * as it arrives.  Every band but the last must be a whole number of
+ * GetBandRowMultiple() rows.  Close() (or the destructor) finishes the file.
+ */
+class CTiffDstStream
+{
+    TIFF *				mPTiff;
+    TiffWriteOptions	mOptions;
+    uint32_t			mWidth;
+    uint32_t			mHeight;
+    uint16_t			mSampPerPixel;
+    uint16_t			mBitsPerSamp;
+    bool				mbPlanar;
+    uint32_t			mChunkHeight;		// rows per strip, or tile height
+    uint32_t			mRowsWritten;
+
+public:
+    CTiffDstStream() : mPTiff(NULL), mWidth(0), mHeight(0), mSampPerPixel(0), mBitsPerSamp(0),
+                       mbPlanar(false), mChunkHeight(1), mRowsWritten(0) {}
+    ~CTiffDstStream() { Close(); }
+
+    CTiffDstStream(const CTiffDstStream &) = delete;
+    CTiffDstStream & operator=(const CTiffDstStream &) = delete;
+
+    TocErr_t Open(const char * pFNameTiff, uint32_t nWidth, uint32_t nHeight, uint16_t nSampPerPixel,
+                  uint16_t nBitsPerSamp, bool bPlanar, const TiffWriteOptions & options = TiffWriteOptions());
+    TocErr_t WriteBand(const TiffImageView & band);
+    TocErr_t Close();
+
+    uint32_t GetBandRowMultiple() const     { return(mChunkHeight); }
+    uint32_t GetRowsWritten() const         { return(mRowsWritten); }
+};
+
+
+/**
+*  Write a multi-channel TIFF to the given file.
+*/
+template< class _TChan>
+TocErr_t
+TiffWriteMultiChan(CTocMatrix<_TChan> & tiffData, const char * pFNameTiff,
+                   const TiffWriteOptions & options = TiffWriteOptions())
+{
+    TiffImageView   image;
+
+    image.pData = tiffData.data();
+    image.nWidth = tiffData.getWidth();
+    image.nHeight = tiffData.getHeight();
+    image.nSampPerPixel = tiffData.GetSampsPerPixel();
+    image.nBitsPerSamp = tiffData.GetBitsPerSamp();
+    image.nRowStride = tiffData.GetStrideBytes();
+    image.nPlaneStride = tiffData.GetPlaneStride() * sizeof(_TChan);
+
+    return( TiffWriteImage(pFNameTiff, image, options) );
+}
+
+#endif // __TIFFDSTFILE_H__
@@ -20,9 +20,81 @@ Basic implementation of tiff read.
 #include "TiffSrcFile.h"
 
 #include <sstream>
+#include <atomic>
+#include <thread>
+#include <cstring>
+
+/**
+ *  Read a 2x2 CFAPattern tag.  libTiff versions disagree on whether the tag
+ *  has a fixed count of 4 or a variable one, so ask the field how to read it.
+*/
+static bool
+ReadCfaPattern(TIFF * pTiff, CfaPattern & ePattern)
+{
+    const TIFFField *   pField = TIFFFindField(pTiff, TIFFTAG_CFAPATTERN, TIFF_ANY);
+    uint8_t *           pColors = NULL;
+    bool                bFound = false;
+
+    if (pField == NULL) {
+        return(false);
+    }
+    if (!TIFFFieldPassCount(pField)) {
+        bFound = TIFFGetField(pTiff, TIFFTAG_CFAPATTERN, &pColors) != 0;
+    }
+    else if (TIFFFieldReadCount(pField) == TIFF_VARIABLE2) {
+        uint32_t    nCount = 0;
+        bFound = TIFFGetField(pTiff, TIFFTAG_CFAPATTERN, &nCount, &pColors) != 0 && nCount == 4;
+    }
+    else {
+        uint16_t    nCount = 0;
+        bFound = TIFFGetField(pTiff, TIFFTAG_CFAPATTERN, &nCount, &pColors) != 0 && nCount == 4;
+    }
+
+    return(bFound && pColors != NULL && CfaPatternFromColors(pColors, ePattern));
+}
+
+
+/**
+ *  Read the tags of the current directory (page).
+*/
+static void
+ReadPageInfo(TIFF * pTiff, TiffPageInfo & info)
+{
+    uint16_t    nBPP = 0;
+
+    info = TiffPageInfo();
+    info.nDirOffset = TIFFCurrentDirOffset(pTiff);
+    TIFFGetField(pTiff, TIFFTAG_IMAGEWIDTH, &info.nWidth);
+    TIFFGetField(pTiff, TIFFTAG_IMAGELENGTH, &info.nHeight);
+    TIFFGetFieldDefaulted(pTiff, TIFFTAG_BITSPERSAMPLE, &nBPP);
+    info.nBPP = nBPP;
+    TIFFGetFieldDefaulted(pTiff, TIFFTAG_SAMPLESPERPIXEL, &info.nSampPerPixel);
+
+    // Resolution
+    TIFFGetField(pTiff, TIFFTAG_RESOLUTIONUNIT, &info.nResolutionUnits);
+    TIFFGetField(pTiff, TIFFTAG_XRESOLUTION, &info.fResolutionX);
+    TIFFGetField(pTiff, TIFFTAG_YRESOLUTION, &info.fResolutionY);
+
+    // Layout of the encoded data
+    TIFFGetFieldDefaulted(pTiff, TIFFTAG_COMPRESSION, &info.nCompression);
+    info.bIsTiled = (TIFFIsTiled(pTiff) != 0);
+    if (info.bIsTiled) {
+        TIFFGetField(pTiff, TIFFTAG_TILEWIDTH, &info.nTileWidth);
+        TIFFGetField(pTiff, TIFFTAG_TILELENGTH, &info.nTileHeight);
+    }
+    else {
+        TIFFGetFieldDefaulted(pTiff, TIFFTAG_ROWSPERSTRIP, &info.nRowsPerStrip);
+        info.nRowsPerStrip = TMin(info.nRowsPerStrip, info.nHeight);
+    }
+
+    info.bHasCfa = ReadCfaPattern(pTiff, info.eCfa);
+}
+
 
 /**
  *  Open a .tiff image.
+ *
+ *  Walks the IFD chain once to index every page, then leaves page 0 current.
 */
 TocErr_t
 TiffSrcFile::OpenFile(const char* pFilename)
@@ -34,15 +106,18 @@ TiffSrcFile::OpenFile(const char* pFilename)
     mPTiff = TIFFOpen(pFilename, "r");
 
     if (mPTiff != NULL) {
-        TIFFGetField(mPTiff, TIFFTAG_IMAGEWIDTH, &mWidth);
-        TIFFGetField(mPTiff, TIFFTAG_IMAGELENGTH, &mHeight);
-        TIFFGetField(mPTiff, TIFFTAG_BITSPERSAMPLE, &mBPP);
-        TIFFGetField(mPTiff, TIFFTAG_SAMPLESPERPIXEL, &mSampPerPixel);
+        mFileName = pFilename;
+
+        do {
+            TiffPageInfo    info;
+            ReadPageInfo(mPTiff, info);
+            mPages.push_back(info);
+        } while (TIFFReadDirectory(mPTiff));
 
-        // Resolution
-        TIFFGetField(mPTiff, TIFFTAG_RESOLUTIONUNIT, &mResolutionUnits);
-        TIFFGetField(mPTiff, TIFFTAG_XRESOLUTION, &mResolutionX );
-        TIFFGetField(mPTiff, TIFFTAG_YRESOLUTION, &mResolutionY );
+        if (mPages.size() > 1) {
+            TIFFSetSubDirectory(mPTiff, mPages[0].nDirOffset);
+        }
+        LoadPage(0);
     }
     else {
         nReturn = kErrTiff_Open;
@@ -53,12 +128,63 @@ TiffSrcFile::OpenFile(const char* pFilename)
 }
 
 
+/**
+ *  Copy the indexed tags of nPage into the members.
+*/
+void
+TiffSrcFile::LoadPage(uint32_t nPage)
+{
+    const TiffPageInfo &    info = mPages[nPage];
+
+    mPage = nPage;
+    mWidth = info.nWidth;
+    mHeight = info.nHeight;
+    mBPP = info.nBPP;
+    mSampPerPixel = info.nSampPerPixel;
+    mResolutionUnits = info.nResolutionUnits;
+    mResolutionX = info.fResolutionX;
+    mResolutionY = info.fResolutionY;
+    mCompression = info.nCompression;
+    mIsTiled = info.bIsTiled;
+    mRowsPerStrip = info.nRowsPerStrip;
+    mTileWidth = info.nTileWidth;
+    mTileHeight = info.nTileHeight;
+}
+
+
+/**
+ *  Make nPage the current page.
+ *
+ *  TIFFSetDirectory() walks the IFD chain from the start on every call;
+ *  seeking straight to the indexed offset does not.
+*/
+TocErr_t
+TiffSrcFile::SetPage(uint32_t nPage)
+{
+    if (mPTiff == NULL) {
+        return(kErrTiff_PTiff);
+    }
+    if (nPage >= mPages.size()) {
+        return(kErrTiff_Page);
+    }
+    if (nPage != mPage) {
+        ReleaseBandCache();
+        if (!TIFFSetSubDirectory(mPTiff, mPages[nPage].nDirOffset)) {
+            return(kErrTiff_Read);
+        }
+        LoadPage(nPage);
+    }
+    return(kNoError);
+}
+
+
 /**
  *  close a .tiff image.
 */
 TocErr_t
 TiffSrcFile::CloseFile( )
 {
+    ReleaseBandCache();
     if (mPTiff != NULL) {
         TIFFClose(mPTiff);
         mPTiff = NULL;
@@ -79,6 +205,16 @@ TiffSrcFile::ClearFile()
 
     mResolutionX = 0.0f;
     mResolutionY = 0.0f;
+
+    mFileName.clear();
+    mCompression = COMPRESSION_NONE;
+    mIsTiled = false;
+    mRowsPerStrip = 0;
+    mTileWidth = 0;
+    mTileHeight = 0;
+
+    mPages.clear();
+    mPage = 0;
 }
 
 
@@ -168,17 +304,12 @@ TiffSrcFile::ReadMonochrome( CTocMatrix<uint16_t> & bufImg )
 
             if (ec == kNoError )
             {
-                // Read in the tiff image
-                size_t		nNext = 0;
-
+                // Read in the tiff image; rows may be padded
                 for (unsigned nRow = 0; nRow < mHeight; nRow++)
                 {
-                    //                uint16_t* pScan = (bufImg.begin() + nNext);
-                    uint16_t* pScan = (bufImg.data() + nNext);
+                    uint16_t* pScan = bufImg.GetRowPtr(nRow);
 
                     TIFFReadScanline(mPTiff, pScan, nRow);
-
-                    nNext += mWidth;
                 }
 
                 // set return value
@@ -190,3 +321,555 @@ TiffSrcFile::ReadMonochrome( CTocMatrix<uint16_t> & bufImg )
     return(ec);
 }
 
+
+/**
+ * \brief Open another handle on fileName, seeked to the page at nDirOffset.
+ *
+ * @return the handle, or NULL.
+ */
+static TIFF *
+OpenPageHandle(const std::string & fileName, uint64_t nDirOffset)
+{
+    TIFF *  pTiff = TIFFOpen(fileName.c_str(), "r");
+
+    if (pTiff != NULL && TIFFCurrentDirOffset(pTiff) != nDirOffset && !TIFFSetSubDirectory(pTiff, nDirOffset)) {
+        TIFFClose(pTiff);
+        pTiff = NULL;
+    }
+    return(pTiff);
+}
+
+
+/**
+ * \brief Run fnChunk over every chunk (strip or tile) of the image.
+ *
+ * Chunks are handed out through a shared counter.  With one thread the
+ * already open handle is used; otherwise every worker needs its own
+ * handle, since a libTiff handle cannot be shared between threads, seeked
+ * to the page at nDirOffset.  Workers take theirs from pHandles when given
+ * and leave them there for the next call; otherwise they open and close
+ * one each.
+ *
+ * @param  fnChunk  = bool fnChunk( TIFF *, uint32_t nChunk, std::vector<uint8_t> & scratch )
+ * @param  pHandles = idle handles on the page, or NULL.
+ * @return Error Code
+ */
+template< class _TFn >
+static TocErr_t
+ForEachChunk(TIFF * pTiff, const std::string & fileName, uint64_t nDirOffset, uint32_t nChunks, unsigned nThreads,
+             _TFn fnChunk, std::vector<TIFF *> * pHandles = NULL)
+{
+    std::atomic<uint32_t>   nNextChunk(0);
+    std::atomic<bool>       bFailed(false);
+
+    auto worker = [&](TIFF * pWorkTiff) {
+        std::vector<uint8_t>    scratch;
+
+        for (uint32_t nChunk = nNextChunk++; nChunk < nChunks && !bFailed; nChunk = nNextChunk++) {
+            if (!fnChunk(pWorkTiff, nChunk, scratch)) {
+                bFailed = true;
+            }
+        }
+    };
+
+    nThreads = TMin(nThreads, nChunks);
+    if (nThreads <= 1) {
+        worker(pTiff);
+    }
+    else {
+        std::vector<std::thread>    threads;
+        std::vector<TIFF *>         handles;
+
+        if (pHandles != NULL) {
+            handles.swap(*pHandles);
+        }
+        handles.resize(TMax<size_t>(handles.size(), nThreads), NULL);
+        for (unsigned nThread = 0; nThread < nThreads; nThread++) {
+            threads.emplace_back([&, nThread]() {
+                TIFF *& pWorkTiff = handles[nThread];
+                if (pWorkTiff == NULL) {
+                    pWorkTiff = OpenPageHandle(fileName, nDirOffset);
+                }
+                if (pWorkTiff == NULL) {
+                    bFailed = true;
+                    return;
+                }
+                worker(pWorkTiff);
+            });
+        }
+        for (std::thread & thread : threads) {
+            thread.join();
+        }
+        for (TIFF * pWorkTiff : handles) {
+            if (pWorkTiff == NULL) {
+                continue;
+            }
+            if (pHandles != NULL) {
+                pHandles->push_back(pWorkTiff);
+            }
+            else {
+                TIFFClose(pWorkTiff);
+            }
+        }
+    }
+
+    return(bFailed ? kErrTiff_Read : kNoError);
+}
+
+
+/**
+ * \brief Copy the rows of [nRow0, nRow1) that the band cache holds into the
+ * destination (row nRow0 first).
+ *
+ * @return true when it held any.
+ */
+static bool
+CopyCachedRows(const TiffBandCache & cache, uint8_t * pDst, size_t nDstStride, size_t nRowBytes,
+               uint32_t nRow0, uint32_t nRow1)
+{
+    uint32_t    nCopy0 = TMax(cache.nRow0, nRow0);
+    uint32_t    nCopy1 = TMin(cache.nRow1, nRow1);
+
+    for (uint32_t nRow = nCopy0; nRow < nCopy1; nRow++) {
+        memcpy(pDst + (nRow - nRow0) * nDstStride, cache.rows.data() + (nRow - cache.nRow0) * nRowBytes, nRowBytes);
+    }
+    return(nCopy0 < nCopy1);
+}
+
+
+/**
+ * \brief Decode the strips of a page that hold rows [nRow0, nRow1) straight
+ * into the destination rows.
+ *
+ * When a strip lies wholly inside the range and the destination rows are
+ * packed it is decoded in place, otherwise it goes through a scratch buffer
+ * and its rows in the range are copied.  Uncompressed strips are read on one
+ * thread since they are I/O bound.
+ *
+ * With a band cache, the strip it holds is copied rather than decoded, the
+ * last strip of the range is decoded into it for the next call, and the
+ * workers' handles stay open in it.
+ *
+ * @param  pTiff      = handle positioned on the page.
+ * @param  pDst       = destination of row nRow0.
+ * @param  nDstStride = bytes between destination rows.
+ * @param  pCache     = kept between sequential reads of one page, or NULL.
+ * @return Error Code
+ */
+static TocErr_t
+ReadPageStrips(TIFF * pTiff, const TiffPageInfo & info, const std::string & fileName,
+               uint8_t * pDst, size_t nDstStride, unsigned nThreads, uint32_t nRow0, uint32_t nRow1,
+               TiffBandCache * pCache = NULL)
+{
+    uint32_t    nFirstStrip = nRow0 / info.nRowsPerStrip;
+    uint32_t    nLastStrip = (nRow1 - 1) / info.nRowsPerStrip;
+    size_t      nRowBytes = static_cast<size_t>(TIFFScanlineSize(pTiff));
+    bool        bKeepLast = false;
+
+    if (info.nCompression == COMPRESSION_NONE) {
+        nThreads = 1;
+    }
+
+    // Strips to decode; the cache holds one whole strip.
+    std::vector<uint32_t>   strips;
+    uint32_t                nCachedStrip = UINT32_MAX;
+
+    if (pCache != NULL) {
+        if (CopyCachedRows(*pCache, pDst, nDstStride, nRowBytes, nRow0, nRow1)) {
+            nCachedStrip = pCache->nRow0 / info.nRowsPerStrip;
+        }
+        bKeepLast = (nLastStrip != nCachedStrip);
+        if (bKeepLast) {
+            pCache->nRow0 = pCache->nRow1 = 0;
+            pCache->rows.resize(info.nRowsPerStrip * nRowBytes);
+        }
+    }
+    for (uint32_t nStrip = nFirstStrip; nStrip <= nLastStrip; nStrip++) {
+        if (nStrip != nCachedStrip) {
+            strips.push_back(nStrip);
+        }
+    }
+
+    auto readStrip = [&](TIFF * pWorkTiff, uint32_t nChunk, std::vector<uint8_t> & scratch) {
+        uint32_t    nStrip = strips[nChunk];
+        uint32_t    nStripRow0 = nStrip * info.nRowsPerStrip;
+        uint32_t    nRows = TMin(info.nRowsPerStrip, info.nHeight - nStripRow0);
+        uint32_t    nCopy0 = TMax(nStripRow0, nRow0);
+        uint32_t    nCopy1 = TMin(nStripRow0 + nRows, nRow1);
+        tmsize_t    nStripBytes = static_cast<tmsize_t>(nRows * nRowBytes);
+        bool        bKeep = bKeepLast && nStrip == nLastStrip;
+
+        if (!bKeep && nDstStride == nRowBytes && nCopy0 == nStripRow0 && nCopy1 == nStripRow0 + nRows) {
+            uint8_t *   pDstStrip = pDst + (nStripRow0 - nRow0) * nDstStride;
+            return(TIFFReadEncodedStrip(pWorkTiff, nStrip, pDstStrip, nStripBytes) == nStripBytes);
+        }
+
+        if (!bKeep) {
+            scratch.resize(nStripBytes);
+        }
+        uint8_t *   pStrip = bKeep ? pCache->rows.data() : scratch.data();
+        if (TIFFReadEncodedStrip(pWorkTiff, nStrip, pStrip, nStripBytes) != nStripBytes) {
+            return(false);
+        }
+        for (uint32_t nRow = nCopy0; nRow < nCopy1; nRow++) {
+            memcpy(pDst + (nRow - nRow0) * nDstStride, pStrip + (nRow - nStripRow0) * nRowBytes, nRowBytes);
+        }
+        return(true);
+    };
+
+    TocErr_t    ec = ForEachChunk(pTiff, fileName, info.nDirOffset, static_cast<uint32_t>(strips.size()), nThreads,
+                                  readStrip, pCache != NULL ? &pCache->handles : NULL);
+    if (ec == kNoError && bKeepLast) {
+        pCache->nRow0 = nLastStrip * info.nRowsPerStrip;
+        pCache->nRow1 = TMin(pCache->nRow0 + info.nRowsPerStrip, info.nHeight);
+    }
+    return(ec);
+}
+
+
+/**
+ * \brief Decode the tiles of a page that hold rows [nRow0, nRow1) and copy
+ * their visible part in the range into the destination (row nRow0 first).
+ *
+ * A band cache works as in ReadPageStrips(), one row of tiles at a time.
+ */
+static TocErr_t
+ReadPageTiles(TIFF * pTiff, const TiffPageInfo & info, const std::string & fileName,
+              uint8_t * pDst, size_t nDstStride, unsigned nThreads, uint32_t nRow0, uint32_t nRow1,
+              TiffBandCache * pCache = NULL)
+{
+    uint32_t    nTilesX = (info.nWidth + info.nTileWidth - 1) / info.nTileWidth;
+    uint32_t    nFirstTileY = nRow0 / info.nTileHeight;
+    uint32_t    nLastTileY = (nRow1 - 1) / info.nTileHeight;
+    size_t      nPixBytes = (info.nBPP / 8) * info.nSampPerPixel;
+    size_t      nRowBytes = info.nWidth * nPixBytes;
+    tmsize_t    nTileBytes = TIFFTileSize(pTiff);
+    bool        bKeepLast = false;
+
+    if (info.nCompression == COMPRESSION_NONE) {
+        nThreads = 1;
+    }
+
+    // Rows of tiles to decode; the cache holds one whole row of them.
+    std::vector<uint32_t>   tileRows;
+    uint32_t                nCachedTileY = UINT32_MAX;
+
+    if (pCache != NULL) {
+        if (CopyCachedRows(*pCache, pDst, nDstStride, nRowBytes, nRow0, nRow1)) {
+            nCachedTileY = pCache->nRow0 / info.nTileHeight;
+        }
+        bKeepLast = (nLastTileY != nCachedTileY);
+        if (bKeepLast) {
+            pCache->nRow0 = pCache->nRow1 = 0;
+            pCache->rows.resize(info.nTileHeight * nRowBytes);
+        }
+    }
+    for (uint32_t nTileY = nFirstTileY; nTileY <= nLastTileY; nTileY++) {
+        if (nTileY != nCachedTileY) {
+            tileRows.push_back(nTileY);
+        }
+    }
+
+    auto readTile = [&](TIFF * pWorkTiff, uint32_t nChunk, std::vector<uint8_t> & scratch) {
+        uint32_t    nTileY = tileRows[nChunk / nTilesX];
+        uint32_t    nX0 = (nChunk % nTilesX) * info.nTileWidth;
+        uint32_t    nY0 = nTileY * info.nTileHeight;
+        uint32_t    nTile = TIFFComputeTile(pWorkTiff, nX0, nY0, 0, 0);
+        size_t      nCopyBytes = TMin(info.nTileWidth, info.nWidth - nX0) * nPixBytes;
+        uint32_t    nCopy0 = TMax(nY0, nRow0);
+        uint32_t    nCopy1 = TMin(nY0 + info.nTileHeight, nRow1);
+
+        scratch.resize(nTileBytes);
+        if (TIFFReadEncodedTile(pWorkTiff, nTile, scratch.data(), nTileBytes) < 0) {
+            return(false);
+        }
+        for (uint32_t nRow = nCopy0; nRow < nCopy1; nRow++) {
+            memcpy(pDst + (nRow - nRow0) * nDstStride + nX0 * nPixBytes,
+                   scratch.data() + (nRow - nY0) * info.nTileWidth * nPixBytes, nCopyBytes);
+        }
+        // Each tile of the kept row fills its own columns of the cache.
+        if (bKeepLast && nTileY == nLastTileY) {
+            uint32_t    nRows = TMin(info.nTileHeight, info.nHeight - nY0);
+            for (uint32_t nRow = 0; nRow < nRows; nRow++) {
+                memcpy(pCache->rows.data() + nRow * nRowBytes + nX0 * nPixBytes,
+                       scratch.data() + nRow * info.nTileWidth * nPixBytes, nCopyBytes);
+            }
+        }
+        return(true);
+    };
+
+    TocErr_t    ec = ForEachChunk(pTiff, fileName, info.nDirOffset, static_cast<uint32_t>(tileRows.size()) * nTilesX,
+                                  nThreads, readTile, pCache != NULL ? &pCache->handles : NULL);
+    if (ec == kNoError && bKeepLast) {
+        pCache->nRow0 = nLastTileY * info.nTileHeight;
+        pCache->nRow1 = TMin(pCache->nRow0 + info.nTileHeight, info.nHeight);
+    }
+    return(ec);
+}
+
+
+TocErr_t
+TiffSrcFile::ReadStripsInto(uint8_t * pDst, size_t nDstStride, unsigned nThreads, uint32_t nRow0, uint32_t nRow1)
+{
+    return(ReadPageStrips(mPTiff, mPages[mPage], mFileName, pDst, nDstStride, nThreads, nRow0, nRow1));
+}
+
+
+TocErr_t
+TiffSrcFile::ReadTilesInto(uint8_t * pDst, size_t nDstStride, unsigned nThreads, uint32_t nRow0, uint32_t nRow1)
+{
+    return(ReadPageTiles(mPTiff, mPages[mPage], mFileName, pDst, nDstStride, nThreads, nRow0, nRow1));
+}
+
+
+/**
+ * \brief Read in a monochrome image using whole strips or tiles.
+ *
+ * Same result as ReadMonochrome() without the per-scanline calls.
+ *
+ * @param  bufImg   = vector resized to hold the image.
+ * @param  nThreads = decode workers, 0 for hardware concurrency.
+ * @return Error Code
+ */
+TocErr_t
+TiffSrcFile::ReadMonochromeStrips( std::vector<uint16_t> & bufImg, unsigned nThreads )
+{
+    TocErr_t    ec = kErrTiff_PTiff;
+
+    if (mPTiff != NULL)
+    {
+        // CHeck to see that we're a uint16 monochrome image.
+        if (IsMonoTiff() && (mBPP == 16)) {
+            size_t      nLenBuffer = static_cast<size_t>(mWidth) * mHeight;
+
+            if (nThreads == 0) {
+                nThreads = TMax(1u, std::thread::hardware_concurrency());
+            }
+            bufImg.resize(nLenBuffer);
+
+            uint8_t *   pDst = reinterpret_cast<uint8_t *>(bufImg.data());
+            size_t      nStride = mWidth * sizeof(uint16_t);
+
+            ec = mIsTiled ? ReadTilesInto(pDst, nStride, nThreads, 0, mHeight)
+                          : ReadStripsInto(pDst, nStride, nThreads, 0, mHeight);
+        }
+    }
+
+    return(ec);
+}
+
+
+TocErr_t
+TiffSrcFile::ReadMonochromeStrips( CTocMatrix<uint16_t> & bufImg, unsigned nThreads )
+{
+    TocErr_t    ec = kErrTiff_PTiff;
+
+    if (mPTiff != NULL)
+    {
+        // CHeck to see that we're a uint16 monochrome image.
+        if (IsMonoTiff() && (mBPP == 16)) {
+            ec = bufImg.Alloc( mWidth, mHeight );
+
+            if (ec == kNoError) {
+                if (nThreads == 0) {
+                    nThreads = TMax(1u, std::thread::hardware_concurrency());
+                }
+
+                uint8_t *   pDst = reinterpret_cast<uint8_t *>(bufImg.data());
+                size_t      nStride = bufImg.GetStrideBytes();
+
+                ec = mIsTiled ? ReadTilesInto(pDst, nStride, nThreads, 0, mHeight)
+                              : ReadStripsInto(pDst, nStride, nThreads, 0, mHeight);
+            }
+        }
+    }
+
+    return(ec);
+}
+
+
+/**
+ * \brief Read rows [nRow0, nRow0 + nRows) of a monochrome image.
+ *
+ * Only the strips (or tiles) holding those rows are decoded, so a band of a
+ * very large image costs memory for the band and GetBandReadBytes() alone.
+ * The decode handles and the last strip (or row of tiles) decoded are kept
+ * until the page changes or the file closes, so reading bands top to bottom
+ * opens the file once per worker and decodes a strip that straddles two
+ * bands once.
+ *
+ * @param  bufImg   = matrix sized to nRows rows of the image.
+ * @param  nThreads = decode workers, 0 for hardware concurrency.
+ * @return Error Code
+ */
+TocErr_t
+TiffSrcFile::ReadMonochromeRows( CTocMatrix<uint16_t> & bufImg, uint32_t nRow0, uint32_t nRows, unsigned nThreads )
+{
+    TocErr_t    ec = kErrTiff_PTiff;
+
+    if (mPTiff != NULL)
+    {
+        if (nRows == 0 || nRow0 >= mHeight || nRows > mHeight - nRow0) {
+            ec = kErrSys_BadArg;
+        }
+        else if (IsMonoTiff() && (mBPP == 16)) {
+            ec = bufImg.Alloc( mWidth, nRows );
+
+            if (ec == kNoError) {
+                if (nThreads == 0) {
+                    nThreads = TMax(1u, std::thread::hardware_concurrency());
+                }
+
+                uint8_t *   pDst = reinterpret_cast<uint8_t *>(bufImg.data());
+                size_t      nStride = bufImg.GetStrideBytes();
+
+                const TiffPageInfo &    info = mPages[mPage];
+
+                ec = mIsTiled ? ReadPageTiles(mPTiff, info, mFileName, pDst, nStride, nThreads, nRow0, nRow0 + nRows,
+                                              &mBandCache)
+                              : ReadPageStrips(mPTiff, info, mFileName, pDst, nStride, nThreads, nRow0, nRow0 + nRows,
+                                               &mBandCache);
+            }
+        }
+    }
+
+    return(ec);
+}
+
+
+/**
+ * \brief Bytes ReadMonochromeRows() holds besides its destination.
+ *
+ * Each decode worker grows a scratch buffer to a whole strip (or tile), and
+ * the band cache keeps one strip (or row of tiles) of the image.  A file of
+ * one huge strip costs that strip once; many small ones cost little.
+ *
+ * @param  nThreads = decode workers, 0 for hardware concurrency.
+ */
+size_t
+TiffSrcFile::GetBandReadBytes(unsigned nThreads) const
+{
+    size_t      nPixBytes = (mBPP / 8) * static_cast<size_t>(mSampPerPixel);
+    size_t      nRowBytes = mWidth * nPixBytes;
+    size_t      nChunkBytes = mIsTiled ? mTileWidth * nPixBytes * mTileHeight : nRowBytes * mRowsPerStrip;
+    size_t      nKeptBytes = nRowBytes * (mIsTiled ? mTileHeight : mRowsPerStrip);
+
+    if (mPTiff == NULL) {
+        return(0);
+    }
+    uint32_t    nChunks = mIsTiled ? TIFFNumberOfTiles(mPTiff) : TIFFNumberOfStrips(mPTiff);
+    if (nThreads == 0) {
+        nThreads = TMax(1u, std::thread::hardware_concurrency());
+    }
+    if (mCompression == COMPRESSION_NONE) {
+        nThreads = 1;
+    }
+    // The kept strip is decoded straight into the cache, not a scratch buffer.
+    nThreads = TMin(nThreads, mIsTiled ? nChunks : nChunks - 1);
+    return(nThreads * nChunkBytes + nKeptBytes);
+}
+
+
+/**
+ *  Close the handles and drop the strip kept by ReadMonochromeRows().
+*/
+void
+TiffSrcFile::ReleaseBandCache()
+{
+    for (TIFF * pTiff : mBandCache.handles) {
+        TIFFClose(pTiff);
+    }
+    mBandCache = TiffBandCache();
+}
+
+
+TocErr_t
+TiffSrcFile::ReadPage(uint32_t nPage, std::vector<uint16_t> & bufImg, unsigned nThreads)
+{
+    TocErr_t    ec = SetPage(nPage);
+
+    if (ec == kNoError) {
+        ec = ReadMonochromeStrips(bufImg, nThreads);
+    }
+    return(ec);
+}
+
+
+/**
+ * \brief Decode the pages in parallel, one page per worker at a time.
+ *
+ * Pages are handed out through a shared counter.  Every worker opens its
+ * own handle and seeks it with the page index, so no worker walks the IFD
+ * chain; each page is decoded on its worker alone.  The current page is
+ * unchanged afterwards.
+ *
+ * @param  fnPage   = bool fnPage( uint32_t nPage, const TiffPageInfo &, std::vector<uint16_t> & bufImg )
+ * @param  nThreads = workers, 0 for hardware concurrency.
+ * @return Error Code
+ */
+TocErr_t
+TiffSrcFile::ForEachPage(const PageFn & fnPage, unsigned nThreads)
+{
+    if (mPTiff == NULL) {
+        return(kErrTiff_PTiff);
+    }
+    for (const TiffPageInfo & info : mPages) {
+        if (info.nSampPerPixel != 1 || info.nBPP != 16) {
+            return(kErrTiff_Read);
+        }
+    }
+
+    uint32_t                nPages = GetPageCount();
+    std::atomic<uint32_t>   nNextPage(0);
+    std::atomic<bool>       bFailed(false);
+
+    auto worker = [&](TIFF * pTiff) {
+        std::vector<uint16_t>   bufImg;
+
+        for (uint32_t nPage = nNextPage++; nPage < nPages && !bFailed; nPage = nNextPage++) {
+            const TiffPageInfo &    info = mPages[nPage];
+            uint8_t *   pDst;
+            size_t      nStride = info.nWidth * sizeof(uint16_t);
+            TocErr_t    ec = kErrTiff_Read;
+
+            bufImg.resize(static_cast<size_t>(info.nWidth) * info.nHeight);
+            pDst = reinterpret_cast<uint8_t *>(bufImg.data());
+            if (TIFFSetSubDirectory(pTiff, info.nDirOffset)) {
+                ec = info.bIsTiled ? ReadPageTiles(pTiff, info, mFileName, pDst, nStride, 1, 0, info.nHeight)
+                                   : ReadPageStrips(pTiff, info, mFileName, pDst, nStride, 1, 0, info.nHeight);
+            }
+            if (ec != kNoError || !fnPage(nPage, info, bufImg)) {
+                bFailed = true;
+            }
+        }
+    };
+
+    if (nThreads == 0) {
+        nThreads = TMax(1u, std::thread::hardware_concurrency());
+    }
+    nThreads = TMin(nThreads, nPages);
+    if (nThreads <= 1) {
+        worker(mPTiff);
+        TIFFSetSubDirectory(mPTiff, mPages[mPage].nDirOffset);
+    }
+    else {
+        std::vector<std::thread>    threads;
+
+        for (unsigned nThread = 0; nThread < nThreads; nThread++) {
+            threads.emplace_back([&]() {
+                TIFF * pWorkTiff = TIFFOpen(mFileName.c_str(), "r");
+                if (pWorkTiff == NULL) {
+                    bFailed = true;
+                    return;
+                }
+                worker(pWorkTiff);
+                TIFFClose(pWorkTiff);
+            });
+        }
+        for (std::thread & thread : threads) {
+            thread.join();
+        }
+    }
+
+    return(bFailed ? kErrTiff_Read : kNoError);
+}
@@ -25,6 +25,8 @@ UnitTestApp.cpp - Unit test has examples on usage.
 #include <stdint.h>
 #include <vector>
 #include <memory>
+#include <string>
+#include <functional>
 
 // Use libtiff - include header here.
 #include "tiff.h"
@@ -32,6 +34,7 @@ UnitTestApp.cpp - Unit test has examples on usage.
 
 #include "TocErrors.h"
 #include "TocMatrix.h"
+#include "CfaPattern.h"
 
 
 // Error Codes
@@ -41,18 +44,60 @@ UnitTestApp.cpp - Unit test has examples on usage.
 #define	kErrTiff_PTiff	    ERRNUM( ERRMOD_TIFF, 0x04 )     // PTiff is incorrect (e.g. NULL)
 #define	kErrTiff_Read	    ERRNUM( ERRMOD_TIFF, 0x05 )     // Read error
 #define	kErrTiff_Write	    ERRNUM( ERRMOD_TIFF, 0x06 )     // write error
+#define	kErrTiff_Page	    ERRNUM( ERRMOD_TIFF, 0x07 )     // no such page
+#define	kErrTiff_Codec	    ERRNUM( ERRMOD_TIFF, 0x08 )     // compression not built into libTiff
 
 #define	kErrTiff_NotImpl	ERRNUM( ERRMOD_TIFF, 0x05 )     // not yet implemented
 
 
+/**
+ * \brief Tags of one page (IFD) of a TIFF, read once when the file is opened.
+ */
+struct TiffPageInfo
+{
+    uint64_t		nDirOffset;			// file offset of the page's IFD
+    uint32_t		nWidth;
+    uint32_t		nHeight;
+    uint32_t		nBPP;				// bits per pixel
+    uint16_t		nSampPerPixel;
+    uint16_t		nCompression;		// libTiff compression scheme
+    bool			bIsTiled;
+    uint32_t		nRowsPerStrip;		// strip layout
+    uint32_t		nTileWidth;			// tiled layout
+    uint32_t		nTileHeight;
+    uint16_t		nResolutionUnits;
+    float			fResolutionX;
+    float			fResolutionY;
+    bool			bHasCfa;			// CFAPattern tag holds a 2x2 Bayer quad
+    CfaPattern		eCfa;				// valid when bHasCfa
+};
+
+
+/**
+ * \brief What ReadMonochromeRows() keeps between calls: its decode workers'
+ * handles, and the last strip (or row of tiles) it decoded, which the next
+ * band's halo reaches back into.
+ */
+struct TiffBandCache
+{
+    std::vector<TIFF *>     handles;            // idle handles on the current page
+    std::vector<uint8_t>    rows;               // packed image rows [nRow0, nRow1)
+    uint32_t                nRow0 = 0;
+    uint32_t                nRow1 = 0;          // nRow0 when empty
+};
+
+
 /**
  * \brief TiffSrcFile is a TIFF source file with read operations.
  * 
  * TiffSrcFile contains routines to:
  *   Open, Close and Read tiff images.
- *   Writing is not supported in this class.
+ *   Writing is not supported in this class, see TiffDstFile.h.
  * 
  * mPTiff = ptr to the libTiff file object.
+ *
+ * Multi-page files: OpenFile() indexes every page's IFD offset and tags, so
+ * SetPage() is a single seek. The members below describe the current page.
 */
 class TiffSrcFile
 {
@@ -66,6 +111,20 @@ class TiffSrcFile
     float			mResolutionX;		// resolution in x-direction
     float			mResolutionY;		// resolution in x-direction
 
+    // Layout of the encoded data
+    std::string		mFileName;			// name used to open extra handles for workers
+    uint16_t		mCompression;		// libTiff compression scheme
+    bool			mIsTiled;			// tiles rather than strips
+    uint32_t		mRowsPerStrip;		// rows in each strip (strip layout)
+    uint32_t		mTileWidth;			// tile width (tiled layout)
+    uint32_t		mTileHeight;		// tile height (tiled layout)
+
+    // Pages
+    std::vector<TiffPageInfo>	mPages;	// every page, in file order
+    uint32_t		mPage;				// current page
+
+    TiffBandCache	mBandCache;			// kept by ReadMonochromeRows() until the page changes
+
 public:
     TiffSrcFile() {
         mPTiff = NULL;
@@ -86,6 +145,16 @@ public:
     uint32_t getBPP() const     { return(mBPP); }
     uint16_t getSampPerPixel() const    { return(mSampPerPixel); }
 
+    // Bayer layout from the current page's TIFF/EP (or DNG) CFAPattern tag.
+    //  Returns false, leaving ePattern alone, when the page has none.
+    bool GetCfaPattern(CfaPattern & ePattern) const {
+        if (mPages.empty() || !mPages[mPage].bHasCfa) {
+            return(false);
+        }
+        ePattern = mPages[mPage].eCfa;
+        return(true);
+    }
+
     bool IsMonoTiff() const {
         bool		isMono = false;
         if( mPTiff != NULL ) {
@@ -104,6 +173,53 @@ public:
 
     TocErr_t ReadMonochrome(CTocMatrix<uint16_t> & bufImg);
 
+    // Read in a monochrome image a whole strip (or tile) at a time.
+    //  Compressed strips are decoded on nThreads workers, each with its own
+    //  TIFF handle.  nThreads = 0 uses the hardware concurrency.
+    TocErr_t ReadMonochromeStrips(std::vector<uint16_t> & bufImg, unsigned nThreads = 0);
+
+    TocErr_t ReadMonochromeStrips(CTocMatrix<uint16_t> & bufImg, unsigned nThreads = 0);
+
+    // Read a band of nRows rows from nRow0, decoding only the strips (or
+    //  tiles) that hold it.  For images too large to read whole.
+    //  Reading bands in order reuses the decode handles, and decodes a strip
+    //  shared by two bands once.
+    TocErr_t ReadMonochromeRows(CTocMatrix<uint16_t> & bufImg, uint32_t nRow0, uint32_t nRows, unsigned nThreads = 0);
+
+    // Bytes ReadMonochromeRows() holds besides bufImg: a decoded strip (or
+    //  tile) per worker and the strip (or row of tiles) it keeps.
+    size_t GetBandReadBytes(unsigned nThreads = 0) const;
+
+    bool IsTiled() const                { return(mIsTiled); }
+    uint32_t getRowsPerStrip() const    { return(mRowsPerStrip); }
+    uint16_t getCompression() const     { return(mCompression); }
+
+// Multi-page (burst) files
+public:
+    uint32_t GetPageCount() const       { return(static_cast<uint32_t>(mPages.size())); }
+    uint32_t GetPage() const            { return(mPage); }
+    const TiffPageInfo & GetPageInfo(uint32_t nPage) const { return(mPages[nPage]); }
+
+    // Make nPage the current page: one seek to its indexed IFD.
+    TocErr_t SetPage(uint32_t nPage);
+
+    // Read one page as a monochrome image; leaves it the current page.
+    TocErr_t ReadPage(uint32_t nPage, std::vector<uint16_t> & bufImg, unsigned nThreads = 0);
+
+    // Decode every page on nThreads workers (0 = hardware concurrency), each
+    //  with its own TIFF handle, and hand each one to fnPage on that worker.
+    //  Pages must be 16-bit monochrome.  Stops at the first failure.
+    using PageFn = std::function<bool(uint32_t nPage, const TiffPageInfo & info, std::vector<uint16_t> & bufImg)>;
+    TocErr_t ForEachPage(const PageFn & fnPage, unsigned nThreads = 0);
+
+protected:
+    void LoadPage(uint32_t nPage);
+    void ReleaseBandCache();
+
+    // Rows [nRow0, nRow1) of the current page; pDst receives row nRow0.
+    TocErr_t ReadStripsInto(uint8_t * pDst, size_t nDstStride, unsigned nThreads, uint32_t nRow0, uint32_t nRow1);
+    TocErr_t ReadTilesInto(uint8_t * pDst, size_t nDstStride, unsigned nThreads, uint32_t nRow0, uint32_t nRow1);
+
 
 // Write Routines
 public:
@@ -114,67 +230,4 @@ public:
 };
 
 
-/**
-*  Write a multi-channel TIFF to the given file.
-*/
-template< class _TChan>
-TocErr_t 
-TiffWriteMultiChan(CTocMatrix<_TChan> & tiffData, const char * pFNameTiff )
-{
-    TocErr_t    ec    = kErrTiff_Create;    // create TIFF 
-    TIFF *      pTiff = NULL;               // ptr to libTiff file object
-
-    pTiff = TIFFOpen(pFNameTiff, "w");
-    if (pTiff != NULL) 
-    {
-        int         nSetRet = 0;
-
-        // Set the TIFF fields
-        size_t      nWidth  = tiffData.getWidth();
-        size_t      nHeight = tiffData.getHeight();
-        unsigned    nBitsPerSample = tiffData.GetBitsPerSamp();
-
-        TIFFSetField(pTiff, TIFFTAG_IMAGEWIDTH, nWidth);
-        TIFFSetField(pTiff, TIFFTAG_IMAGELENGTH, nHeight);
-        TIFFSetField(pTiff, TIFFTAG_BITSPERSAMPLE, nBitsPerSample );
-        TIFFSetField(pTiff, TIFFTAG_SAMPLESPERPIXEL, tiffData.GetSampsPerPixel( ) );
-        TIFFSetField(pTiff, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
-        TIFFSetField(pTiff, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-        TIFFSetField(pTiff, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
-        TIFFSetField(pTiff, TIFFTAG_COMPRESSION, COMPRESSION_NONE);
-
-        // We have 1 row per strip
-        //  This is not the fastest but it's the easiest,
-        //  If we use nHeight then we must write the entire frame on one write.
-        //    TIFFSetField(pTiff, TIFFTAG_ROWSPERSTRIP, height); // One strip for the whole image
-        TIFFSetField(pTiff, TIFFTAG_ROWSPERSTRIP, 1);       // One strip for the whole image
-
-        // Write out the tiff data
-        size_t          nRetWrite = 0;
-
-        // Write out the tiff data scanline by scanline
-        //   If there is an error while we write we mark an error
-        size_t      nScanLen = sizeof(_TChan) * nWidth * tiffData.GetSampsPerPixel();
-        ec = kNoError;
-
-        for (unsigned nRow = 0; nRow < nHeight; nRow += 1)
-        {
-            _TChan * pNext = tiffData.GetRowPtr(nRow);
-
-            //            nRetWrite = TIFFWriteScanline(pTiff, tiffData.GetRowPtr( nRow ), nRow, nScanLen );
-            nRetWrite = TIFFWriteEncodedStrip(pTiff, nRow, pNext, nScanLen );
-            if ((nRetWrite == -1 ) || (nRetWrite < nScanLen)) {
-                // Mark an error
-                ec = kErrTiff_Write;
-            }
-        }
-
-        // Close the file
-        TIFFClose(pTiff);
-        pTiff = NULL;
-    }
-
-    return( ec );
-}
-
 #endif // __TIFFSRCFILE_H__
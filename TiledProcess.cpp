@@ -0,0 +1,201 @@
+// TiledProcess.cpp : Out-of-core processing of mosaics too large for memory.
+
+#include "TiledProcess.h"
+#include "Benchmark.h"
+#include "TiffSrcFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <numeric>
+#include <thread>
+
+static size_t alignedRowBytes(uint32_t width) {
+    return (size_t(width) * sizeof(uint16_t) + kTocAlign - 1) & ~(kTocAlign - 1);
+}
+
+static uint32_t roundUp(uint32_t value, uint32_t multiple) {
+    return (value + multiple - 1) / multiple * multiple;
+}
+
+TiledPlan PlanTiledProcess(uint32_t width, uint32_t height, uint32_t rowMultiple, size_t readerBytes,
+                           const TiledOptions& options) {
+    TiledPlan plan;
+    uint32_t align = std::max(1u, options.rowAlign);
+    uint32_t multiple = std::lcm(align, std::max(1u, rowMultiple));
+    uint32_t halo = roundUp(options.halo, align);
+    size_t depth = std::max(1u, options.queueDepth);
+    size_t rowBytes = alignedRowBytes(width);
+    auto bandBytes = [&](uint32_t rows) {
+        return rowBytes * (rows + 2 * size_t(halo)) + rowBytes * rows * options.channels;
+    };
+
+    // The writer holds up to two encoded chunks per thread, and each thread a
+    // scratch copy and an in-memory TIFF of the one it is encoding.
+    const TiffWriteOptions& tiff = options.tiff;
+    bool tiled = tiff.nTileWidth != 0 && tiff.nTileHeight != 0;
+    size_t chunkBytes = tiled ? size_t(tiff.nTileWidth) * tiff.nTileHeight * sizeof(uint16_t) : rowBytes * rowMultiple;
+    unsigned threads = tiff.nThreads ? tiff.nThreads : std::max(1u, std::thread::hardware_concurrency());
+    plan.writerBytes = (tiff.nCompression != COMPRESSION_NONE) ? 4 * size_t(threads) * chunkBytes : chunkBytes;
+    plan.readerBytes = readerBytes;
+    plan.minBudget = plan.readerBytes + plan.writerBytes + depth * bandBytes(multiple);
+
+    if (options.memoryBudget < plan.minBudget) {
+        return plan;
+    }
+    size_t perBand = (options.memoryBudget - plan.readerBytes - plan.writerBytes) / depth;
+    size_t rows = (perBand - rowBytes * 2 * halo) / (rowBytes * (1 + options.channels));
+    rows = std::min<size_t>(rows / multiple * multiple, roundUp(height, multiple));
+
+    plan.bandRows = uint32_t(rows);
+    plan.bands = (height + plan.bandRows - 1) / plan.bandRows;
+    plan.bandBytes = bandBytes(plan.bandRows);
+    return plan;
+}
+
+void TiledReport::Print(std::ostream& out) const {
+    char line[200];
+    if (!ok && !error.empty()) {
+        snprintf(line, sizeof(line), "Tiled run failed: %s\n", error.c_str());
+        out << line;
+        return;
+    }
+    snprintf(line, sizeof(line), "Tiled: %u bands of %u rows (%zu failed) in %.2f s: %.1f MP/s\n", plan.bands,
+        plan.bandRows, failed, wallSeconds, wallSeconds > 0.0 ? pixels / wallSeconds / 1e6 : 0.0);
+    out << line;
+    snprintf(line, sizeof(line), "  memory: %.1f MB per band, %.1f MB for the reader, %.1f MB for the writer\n",
+        plan.bandBytes / 1e6, plan.readerBytes / 1e6, plan.writerBytes / 1e6);
+    out << line;
+    for (const StageStats& stage : stages) {
+        double utilization = wallSeconds > 0.0 ? 100.0 * stage.busySeconds / wallSeconds : 0.0;
+        double perBand = stage.frames ? 1e3 * stage.busySeconds / stage.frames : 0.0;
+        snprintf(line, sizeof(line), "  %-8s busy %5.1f%%  %8.2f ms/band\n", stage.name.c_str(), utilization, perBand);
+        out << line;
+    }
+}
+
+TiledReport RunTiledProcess(const std::string& inputTiff, const std::string& outputTiff, const BandProcessor& process,
+                            const TiledOptions& options) {
+    using BandPtr = std::unique_ptr<TiledBand>;
+    TiledReport report;
+
+    TiffSrcFile input;
+    if (input.OpenFile(inputTiff.c_str()) != kNoError || !input.IsMonoTiff() || input.getBPP() != 16) {
+        report.error = "cannot read " + inputTiff + " as a 16-bit single-channel TIFF";
+        return report;
+    }
+    uint32_t width = input.getWidth(), height = input.getHeight();
+
+    CTiffDstStream output;
+    if (output.Open(outputTiff.c_str(), width, height, options.channels, 16, true, options.tiff) != kNoError) {
+        report.error = "cannot create " + outputTiff;
+        return report;
+    }
+
+    // One strip or tile per decode worker, and the one kept for the next band.
+    report.plan = PlanTiledProcess(width, height, output.GetBandRowMultiple(), input.GetBandReadBytes(), options);
+    const TiledPlan& plan = report.plan;
+    if (plan.bandRows == 0) {
+        char message[120];
+        snprintf(message, sizeof(message), "the memory budget needs to be at least %.1f MB", plan.minBudget / 1e6);
+        report.error = message;
+        return report;
+    }
+    uint32_t halo = roundUp(options.halo, std::max(1u, options.rowAlign));
+
+    // Every band is always in exactly one queue or held by one stage. Each
+    // one's blocks are sized for the tallest band up front.
+    size_t depth = std::max(1u, options.queueDepth);
+    BoundedQueue<BandPtr> freeBands(depth), toCompute(depth), toWrite(depth);
+    for (size_t i = 0; i < depth; i++) {
+        BandPtr band(new TiledBand());
+        if (band->input.Alloc(width, std::min(height, plan.bandRows + 2 * halo)) != kNoError ||
+            band->output.Alloc(width, std::min(height, plan.bandRows), options.channels, kTocPlanar) != kNoError) {
+            report.error = "cannot allocate the band buffers";
+            return report;
+        }
+        freeBands.Push(std::move(band));
+    }
+
+    report.stages[0].name = "read";
+    report.stages[1].name = "compute";
+    report.stages[2].name = "write";
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::thread reader([&]() {
+        StageStats& stats = report.stages[0];
+        for (uint32_t i = 0; i < plan.bands; i++) {
+            BandPtr band;
+            if (!freeBands.Pop(band)) {
+                break;
+            }
+            band->index = i;
+            band->width = width;
+            band->y0 = i * plan.bandRows;
+            band->rows = std::min(plan.bandRows, height - band->y0);
+            band->inY0 = band->y0 > halo ? band->y0 - halo : 0;
+            band->inRows = std::min(height, band->y0 + band->rows + halo) - band->inY0;
+            stats.busySeconds += TimeSeconds([&]() {
+                band->ok = input.ReadMonochromeRows(band->input, band->inY0, band->inRows) == kNoError &&
+                           band->output.Alloc(width, band->rows, options.channels, kTocPlanar) == kNoError;
+            });
+            stats.frames++;
+            toCompute.Push(std::move(band));
+        }
+        toCompute.Close();
+    });
+
+    std::thread computer([&]() {
+        StageStats& stats = report.stages[1];
+        BandPtr band;
+        while (toCompute.Pop(band)) {
+            if (band->ok) {
+                stats.busySeconds += TimeSeconds([&]() { band->ok = process(*band); });
+                stats.frames++;
+            }
+            toWrite.Push(std::move(band));
+        }
+        toWrite.Close();
+    });
+
+    // The writer runs here. Bands arrive in order; after a failure the rest
+    // are only drained, since the file cannot be completed.
+    StageStats& writeStats = report.stages[2];
+    BandPtr band;
+    while (toWrite.Pop(band)) {
+        bool written = false;
+        if (band->ok && report.failed == 0) {
+            TiffImageView view;
+            view.pData = band->output.data();
+            view.nWidth = width;
+            view.nHeight = band->rows;
+            view.nSampPerPixel = options.channels;
+            view.nBitsPerSamp = 16;
+            view.nRowStride = band->output.GetStrideBytes();
+            view.nPlaneStride = options.channels > 1 ? band->output.GetPlaneStride() * sizeof(uint16_t) : 0;
+            writeStats.busySeconds += TimeSeconds([&]() { written = output.WriteBand(view) == kNoError; });
+            writeStats.frames++;
+        }
+        if (written) {
+            report.pixels += uint64_t(width) * band->rows;
+        }
+        else {
+            report.failed++;
+            fprintf(stderr, "Band %zu (rows %u-%u) not written\n", band->index, band->y0, band->y0 + band->rows - 1);
+        }
+        freeBands.Push(std::move(band));
+    }
+
+    freeBands.Close();
+    reader.join();
+    computer.join();
+
+    report.ok = output.Close() == kNoError && report.failed == 0;
+    input.CloseFile();
+
+    std::chrono::duration<double> wall = std::chrono::steady_clock::now() - start;
+    report.wallSeconds = wall.count();
+    return report;
+}
@@ -0,0 +1,83 @@
+// TiledProcess.h : Out-of-core processing of mosaics too large for memory.
+//
+// The image is processed in bands of whole rows. A reader decodes each band's
+// input rows plus the halo rows the kernel reads above and below, a compute
+// stage fills the band's output rows, and a writer appends them to a
+// CTiffDstStream. Bands circulate through bounded queues as frames do in
+// FrameStream, so reading, computing and writing overlap and only queueDepth
+// bands are ever in memory. The band height is the largest that keeps them,
+// the reader's decoded strips and the writer's compression buffers within the
+// memory budget.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+
+#include "FrameStream.h"
+#include "TiffDstFile.h"
+#include "TocMatrix.h"
+
+// One band in flight. Its matrices are sized for the tallest band once, so
+// later bands reuse their blocks.
+struct TiledBand {
+    size_t index = 0;
+    uint32_t width = 0;
+    uint32_t y0 = 0;                    ///< first output row in the image
+    uint32_t rows = 0;                  ///< output rows in the band
+    uint32_t inY0 = 0;                  ///< first input row held: y0 less the halo, clipped to the image
+    uint32_t inRows = 0;                ///< input rows held
+    CTocMatrix<uint16_t> input;         ///< inRows rows
+    CTocMatrix<uint16_t> output;        ///< rows rows, planar channels
+    bool ok = false;
+};
+
+struct TiledOptions {
+    size_t memoryBudget = size_t(1) << 30;  ///< bytes for every band in flight and the reader's and writer's buffers
+    uint32_t halo = 2;                  ///< input rows the kernel reaches above and below an output row
+    uint16_t channels = 3;              ///< output samples per pixel
+    uint32_t rowAlign = 2;              ///< band rows and halos are multiples of this (2 keeps the CFA phase)
+    unsigned queueDepth = 3;            ///< bands in flight, one per stage at minimum
+    TiffWriteOptions tiff;              ///< output layout; tiles set the band height granularity
+};
+
+// Band height chosen for an image; bandRows is 0 when even the smallest band
+// does not fit the budget, and minBudget says what would.
+struct TiledPlan {
+    uint32_t bandRows = 0;
+    uint32_t bands = 0;
+    size_t bandBytes = 0;               ///< input and output matrices of one band
+    size_t readerBytes = 0;             ///< decoded strips or tiles held by the TIFF reader
+    size_t writerBytes = 0;             ///< encoded chunks and scratch held by the TIFF writer
+    size_t minBudget = 0;
+};
+
+// readerBytes is what decoding the input holds besides the bands, from
+// TiffSrcFile::GetBandReadBytes().
+TiledPlan PlanTiledProcess(uint32_t width, uint32_t height, uint32_t rowMultiple, size_t readerBytes,
+                           const TiledOptions& options);
+
+struct TiledReport {
+    bool ok = false;
+    std::string error;                  ///< why a run failed before it started
+    TiledPlan plan;
+    size_t failed = 0;                  ///< bands that failed
+    double wallSeconds = 0.0;
+    uint64_t pixels = 0;
+    StageStats stages[3];               ///< read, compute, write
+
+    void Print(std::ostream& out) const;
+};
+
+// Fills band.output from band.input. Output row 0 is input row y0 - inY0, and
+// input rows beyond the band are only missing at the image edges, where the
+// kernel's own boundary condition applies.
+using BandProcessor = std::function<bool(TiledBand& band)>;
+
+// Process a 16-bit single-channel TIFF into a 16-bit TIFF of options.channels
+// planes, band by band.
+TiledReport RunTiledProcess(const std::string& inputTiff, const std::string& outputTiff, const BandProcessor& process,
+                            const TiledOptions& options);
@@ -0,0 +1,323 @@
+/*
+Copyright(c) 2024 Transformative Optics.All rights reserved.
+
+This software and its documentation are considered to be
+proprietary and confidential information of Transformative Optics,
+and may not be disclosed to unauthorized individuals
+or used in any way not expressly authorized
+by the license agreement accompanying this product.
+
+Unauthorized copying of this file, via any medium,
+is strictly prohibited.Modification, reverse engineering, disassembly,
+or decompilation of this software is prohibited unless expressly permitted
+by a written agreement with Transformative Optics.
+
+----------------------------------------------------------
+Description:
+
+TocMatrix.h - image container with 64-byte aligned, padded rows.
+
+    CTocMatrix<_T>	width x height pixels of one or more samples, either
+                    interleaved (RGBRGB...) or planar (one plane per sample).
+                    Every row starts on a kTocAlign boundary.
+    CTocFramePool	recycles the blocks behind matrices, so matrices that are
+                    created and freed every frame stop allocating once the
+                    pool holds a block of each size.
+
+*/
+#ifndef __TOCMATRIX_H__
+#define __TOCMATRIX_H__     1
+
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include "TocErrors.h"
+
+
+// Row alignment in bytes: one cache line, and a whole AVX-512 vector.
+const size_t	kTocAlign = 64;
+
+// Sample layout of a multi-sample matrix
+enum TocLayout
+{
+    kTocInterleaved = 0,    // samples of a pixel are adjacent
+    kTocPlanar              // one plane per sample
+};
+
+
+/**
+ *  Allocate nBytes aligned to kTocAlign (rounded up to a multiple of it).
+*/
+inline void *
+TocAlignedAlloc(size_t nBytes)
+{
+    nBytes = (nBytes + kTocAlign - 1) & ~(kTocAlign - 1);
+#if defined( _MSC_VER )
+    return(_aligned_malloc(nBytes, kTocAlign));
+#else
+    return(aligned_alloc(kTocAlign, nBytes));
+#endif
+}
+
+inline void
+TocAlignedFree(void * pBlock)
+{
+#if defined( _MSC_VER )
+    _aligned_free(pBlock);
+#else
+    free(pBlock);
+#endif
+}
+
+
+/**
+ * \brief Thread-safe pool of aligned blocks.
+ *
+ * Acquire() returns the smallest idle block that holds nBytes (and is no
+ * more than twice that, so small requests do not pin large blocks), and
+ * allocates only when there is none.  Release() makes a block idle again.
+ * Idle blocks are freed by Trim() or when the pool is destroyed, so every
+ * matrix using a pool must be freed first.
+ */
+class CTocFramePool
+{
+    std::mutex					mMutex;
+    std::multimap<size_t, void *>	mIdle;			// idle blocks by capacity
+    size_t						mIdleBytes;
+    size_t						mAllocCount;		// blocks allocated
+    size_t						mReuseCount;		// requests served from mIdle
+
+public:
+    CTocFramePool() : mIdleBytes(0), mAllocCount(0), mReuseCount(0) {}
+    ~CTocFramePool() { Trim(); }
+
+    CTocFramePool(const CTocFramePool &) = delete;
+    CTocFramePool & operator=(const CTocFramePool &) = delete;
+
+    /**
+     *  Get a block of at least nBytes; nCapacity receives its real size.
+     *  Returns NULL if the allocation fails.
+    */
+    void * Acquire(size_t nBytes, size_t & nCapacity) {
+        {
+            std::lock_guard<std::mutex>     lock(mMutex);
+            auto    it = mIdle.lower_bound(nBytes);
+
+            if (it != mIdle.end() && it->first / 2 <= nBytes) {
+                void *  pBlock = it->second;
+
+                nCapacity = it->first;
+                mIdleBytes -= it->first;
+                mIdle.erase(it);
+                mReuseCount++;
+                return(pBlock);
+            }
+            mAllocCount++;
+        }
+
+        nCapacity = (nBytes + kTocAlign - 1) & ~(kTocAlign - 1);
+        return(TocAlignedAlloc(nCapacity));
+    }
+
+    void Release(void * pBlock, size_t nCapacity) {
+        std::lock_guard<std::mutex>     lock(mMutex);
+
+        mIdle.emplace(nCapacity, pBlock);
+        mIdleBytes += nCapacity;
+    }
+
+    // Free every idle block.
+    void Trim() {
+        std::lock_guard<std::mutex>     lock(mMutex);
+
+        for (auto & block : mIdle) {
+            TocAlignedFree(block.second);
+        }
+        mIdle.clear();
+        mIdleBytes = 0;
+    }
+
+    size_t GetAllocCount() {
+        std::lock_guard<std::mutex>     lock(mMutex);
+        return(mAllocCount);
+    }
+
+    size_t GetReuseCount() {
+        std::lock_guard<std::mutex>     lock(mMutex);
+        return(mReuseCount);
+    }
+
+    size_t GetIdleBytes() {
+        std::lock_guard<std::mutex>     lock(mMutex);
+        return(mIdleBytes);
+    }
+};
+
+
+/**
+ * \brief Image of width x height pixels with nSamps samples each.
+ *
+ * Rows are GetStride() elements apart and start on kTocAlign boundaries;
+ * planar matrices keep their planes GetPlaneStride() elements apart.
+ * Alloc() keeps the current block when it is big enough, so reallocating a
+ * matrix to the same size every frame costs nothing.  The block comes from
+ * the pool given to the constructor (or SetPool()), otherwise from the heap.
+ * Pixel values are undefined after Alloc().
+ *
+ * Matrices move but do not copy.
+ */
+template< class _T>
+class CTocMatrix
+{
+    _T *			mpData;				// first row, kTocAlign aligned
+    size_t			mCapacity;			// bytes in the block
+    CTocFramePool *	mpPool;				// owner of the block, NULL for the heap
+
+    uint32_t		mWidth;
+    uint32_t		mHeight;
+    uint16_t		mSampsPerPixel;
+    TocLayout		mLayout;
+    size_t			mStride;			// elements between rows
+    size_t			mPlaneStride;		// elements between planes (planar)
+
+public:
+    explicit CTocMatrix(CTocFramePool * pPool = NULL) : mpData(NULL), mCapacity(0), mpPool(pPool) {
+        ClearShape();
+    }
+
+    ~CTocMatrix() {
+        Free();
+    }
+
+    CTocMatrix(const CTocMatrix &) = delete;
+    CTocMatrix & operator=(const CTocMatrix &) = delete;
+
+    CTocMatrix(CTocMatrix && other) : mpData(NULL), mCapacity(0), mpPool(NULL) {
+        ClearShape();
+        *this = std::move(other);
+    }
+
+    CTocMatrix & operator=(CTocMatrix && other) {
+        if (this != &other) {
+            Free();
+            mpData = other.mpData;
+            mCapacity = other.mCapacity;
+            mpPool = other.mpPool;
+            mWidth = other.mWidth;
+            mHeight = other.mHeight;
+            mSampsPerPixel = other.mSampsPerPixel;
+            mLayout = other.mLayout;
+            mStride = other.mStride;
+            mPlaneStride = other.mPlaneStride;
+            other.mpData = NULL;
+            other.mCapacity = 0;
+            other.ClearShape();
+        }
+        return(*this);
+    }
+
+    /**
+     *  Size the matrix.
+     *
+     *  @param  nPadBytes = extra bytes per row before rounding the stride up
+     *                      to kTocAlign, e.g. kTocAlign to keep power-of-two
+     *                      widths from mapping every row to the same cache sets.
+     *  @return Error Code
+    */
+    TocErr_t Alloc(uint32_t nWidth, uint32_t nHeight, uint16_t nSamps = 1,
+                   TocLayout eLayout = kTocInterleaved, size_t nPadBytes = 0) {
+        if (nWidth == 0 || nHeight == 0 || nSamps == 0) {
+            return(kErrSys_BadArg);
+        }
+
+        size_t  nRowSamps = (eLayout == kTocInterleaved) ? size_t(nWidth) * nSamps : nWidth;
+        size_t  nRowBytes = (nRowSamps * sizeof(_T) + nPadBytes + kTocAlign - 1) & ~(kTocAlign - 1);
+        size_t  nPlanes = (eLayout == kTocInterleaved) ? 1 : nSamps;
+        size_t  nBytes = nRowBytes * nHeight * nPlanes;
+
+        if (nBytes > mCapacity) {
+            Free();
+            if (mpPool != NULL) {
+                mpData = static_cast<_T *>(mpPool->Acquire(nBytes, mCapacity));
+            }
+            else {
+                mCapacity = (nBytes + kTocAlign - 1) & ~(kTocAlign - 1);
+                mpData = static_cast<_T *>(TocAlignedAlloc(mCapacity));
+            }
+            if (mpData == NULL) {
+                mCapacity = 0;
+                ClearShape();
+                return(kErrSys_Alloc);
+            }
+        }
+
+        mWidth = nWidth;
+        mHeight = nHeight;
+        mSampsPerPixel = nSamps;
+        mLayout = eLayout;
+        mStride = nRowBytes / sizeof(_T);
+        mPlaneStride = (eLayout == kTocInterleaved) ? 0 : mStride * nHeight;
+        return(kNoError);
+    }
+
+    // Give the block back to its pool (or the heap).
+    void Free() {
+        if (mpData != NULL) {
+            if (mpPool != NULL) {
+                mpPool->Release(mpData, mCapacity);
+            }
+            else {
+                TocAlignedFree(mpData);
+            }
+        }
+        mpData = NULL;
+        mCapacity = 0;
+        ClearShape();
+    }
+
+    // Take later blocks from pPool; frees the current one.
+    void SetPool(CTocFramePool * pPool) {
+        Free();
+        mpPool = pPool;
+    }
+
+// Access Data Elements
+public:
+    uint32_t getWidth() const           { return(mWidth); }
+    uint32_t getHeight() const          { return(mHeight); }
+    uint16_t GetSampsPerPixel() const   { return(mSampsPerPixel); }
+    unsigned GetBitsPerSamp() const     { return(8 * sizeof(_T)); }
+    TocLayout GetLayout() const         { return(mLayout); }
+    size_t GetStride() const            { return(mStride); }
+    size_t GetStrideBytes() const       { return(mStride * sizeof(_T)); }
+    size_t GetPlaneStride() const       { return(mPlaneStride); }
+    bool IsEmpty() const                { return(mpData == NULL || mWidth == 0); }
+
+    _T * data()                         { return(mpData); }
+    const _T * data() const             { return(mpData); }
+
+    // Row nRow of plane nPlane (nPlane is 0 for interleaved matrices).
+    _T * GetRowPtr(uint32_t nRow, uint16_t nPlane = 0) {
+        return(mpData + nPlane * mPlaneStride + nRow * mStride);
+    }
+    const _T * GetRowPtr(uint32_t nRow, uint16_t nPlane = 0) const {
+        return(mpData + nPlane * mPlaneStride + nRow * mStride);
+    }
+
+protected:
+    void ClearShape() {
+        mWidth = 0;
+        mHeight = 0;
+        mSampsPerPixel = 0;
+        mLayout = kTocInterleaved;
+        mStride = 0;
+        mPlaneStride = 0;
+    }
+};
+
+#endif // __TOCMATRIX_H__
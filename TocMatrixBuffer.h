@@ -0,0 +1,23 @@
+// TocMatrixBuffer.h : A CTocMatrix viewed as a Halide::Buffer without a copy.
+//
+// The buffer aliases the matrix, so the matrix must outlive it and must not be
+// reallocated while it is in use. Dimensions are x, y and, with more than one
+// sample, c. The row stride keeps the matrix's padding, so every row a
+// pipeline reads or writes starts on a kTocAlign boundary.
+
+#pragma once
+
+#include "Halide.h"
+#include "TocMatrix.h"
+
+template <typename T>
+Halide::Buffer<T> TocMatrixBuffer(CTocMatrix<T>& matrix) {
+    bool interleaved = matrix.GetLayout() == kTocInterleaved;
+    int samples = matrix.GetSampsPerPixel();
+    halide_dimension_t shape[3] = {
+        halide_dimension_t(0, int(matrix.getWidth()), interleaved ? samples : 1),
+        halide_dimension_t(0, int(matrix.getHeight()), int(matrix.GetStride())),
+        halide_dimension_t(0, samples, interleaved ? 1 : int(matrix.GetPlaneStride())),
+    };
+    return Halide::Buffer<T>(matrix.data(), samples > 1 ? 3 : 2, shape);
+}
@@ -0,0 +1,70 @@
+// WindowStatistics.cpp : Integral images for O(1) window mean and variance.
+
+#include "WindowStatistics.h"
+
+#include <algorithm>
+
+template <typename T>
+void WindowStatistics::Build(const T* src, ptrdiff_t stride, uint32_t width, uint32_t height) {
+	m_width = width;
+	m_height = height;
+	size_t tableWidth = size_t(width) + 1;
+	m_sum.assign(tableWidth * (size_t(height) + 1), 0);
+	m_sumSq.assign(m_sum.size(), 0);
+
+	// Each entry is the running sum along its row plus the entry above.
+	for (uint32_t y = 0; y < height; y++) {
+		const T* row = src + ptrdiff_t(y) * stride;
+		const uint64_t* sumAbove = &m_sum[size_t(y) * tableWidth];
+		const uint64_t* sumSqAbove = &m_sumSq[size_t(y) * tableWidth];
+		uint64_t* sum = &m_sum[size_t(y + 1) * tableWidth];
+		uint64_t* sumSq = &m_sumSq[size_t(y + 1) * tableWidth];
+		uint64_t rowSum = 0, rowSumSq = 0;
+		for (uint32_t x = 0; x < width; x++) {
+			uint64_t v = row[x];
+			rowSum += v;
+			rowSumSq += v * v;
+			sum[x + 1] = sumAbove[x + 1] + rowSum;
+			sumSq[x + 1] = sumSqAbove[x + 1] + rowSumSq;
+		}
+	}
+}
+
+void WindowStatistics::windowSums(int x0, int y0, int x1, int y1, uint64_t& sum, uint64_t& sumSq) const {
+	size_t tableWidth = size_t(m_width) + 1;
+	size_t i00 = size_t(y0) * tableWidth + x0, i01 = size_t(y0) * tableWidth + x1;
+	size_t i10 = size_t(y1) * tableWidth + x0, i11 = size_t(y1) * tableWidth + x1;
+	sum = m_sum[i11] - m_sum[i01] - m_sum[i10] + m_sum[i00];
+	sumSq = m_sumSq[i11] - m_sumSq[i01] - m_sumSq[i10] + m_sumSq[i00];
+}
+
+void WindowStatistics::Query(int x, int y, int radius, double& mean, double& variance) const {
+	int w = int(m_width), h = int(m_height);
+	int x0 = std::clamp(x - radius, 0, w), x1 = std::clamp(x + radius + 1, 0, w);
+	int y0 = std::clamp(y - radius, 0, h), y1 = std::clamp(y + radius + 1, 0, h);
+	double area = double(x1 - x0) * (y1 - y0);
+	if (area == 0.0) {
+		mean = variance = 0.0;
+		return;
+	}
+
+	uint64_t sum, sumSq;
+	windowSums(x0, y0, x1, y1, sum, sumSq);
+	mean = double(sum) / area;
+	variance = std::max((double(sumSq) - double(sum) * mean) / area, 0.0);
+}
+
+double WindowStatistics::Mean(int x, int y, int radius) const {
+	double mean, variance;
+	Query(x, y, radius, mean, variance);
+	return mean;
+}
+
+double WindowStatistics::Variance(int x, int y, int radius) const {
+	double mean, variance;
+	Query(x, y, radius, mean, variance);
+	return variance;
+}
+
+template void WindowStatistics::Build<uint8_t>(const uint8_t*, ptrdiff_t, uint32_t, uint32_t);
+template void WindowStatistics::Build<uint16_t>(const uint16_t*, ptrdiff_t, uint32_t, uint32_t);
@@ -0,0 +1,42 @@
+// WindowStatistics.h : Mean and variance of any square window in O(1).
+//
+// Build() makes one pass over a frame to fill integral images of the values
+// and their squares. After that, each query costs four lookups per image,
+// whatever the window size. This is the per-pixel counterpart of
+// DefineLocalStatistics() in HalidePipelines.h and gives the same results:
+// windows are clipped to the image, and the variance is the population variance.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class WindowStatistics {
+public:
+	WindowStatistics() = default;
+
+	// Strides are in pixels.
+	template <typename T>
+	WindowStatistics(const T* src, ptrdiff_t stride, uint32_t width, uint32_t height) { Build(src, stride, width, height); }
+
+	template <typename T>
+	void Build(const T* src, ptrdiff_t stride, uint32_t width, uint32_t height);
+
+	uint32_t width() const { return m_width; }
+	uint32_t height() const { return m_height; }
+
+	// Statistics of the in-bounds part of the (2 * radius + 1)^2 window around (x, y).
+	void Query(int x, int y, int radius, double& mean, double& variance) const;
+	double Mean(int x, int y, int radius) const;
+	double Variance(int x, int y, int radius) const;
+
+private:
+	// Sums over [x0, x1) x [y0, y1) of both tables.
+	void windowSums(int x0, int y0, int x1, int y1, uint64_t& sum, uint64_t& sumSq) const;
+
+	uint32_t m_width = 0;
+	uint32_t m_height = 0;
+	std::vector<uint64_t> m_sum;	///< (width + 1) x (height + 1); row and column 0 are zero
+	std::vector<uint64_t> m_sumSq;	///< same layout, sums of squares
+};
@@ -12,14 +12,34 @@
 #include <stdlib.h>
 //custom tiff reader from Robs code
 #include "TiffSrcFile.h"
+#include "TiffDstFile.h"
 #include <sstream> 
 
+#include <algorithm>
 #include <vector>
 #include<iostream>
 #include <chrono>
+#include <memory>
+#include <thread>
+#include <filesystem>
 #include<cmath>
 #include<cstdint>
 #include "PGMImage.h"
+#include "HalidePipelines.h"
+#include "PipelineCache.h"
+#include "PipelineProfile.h"
+#include "Benchmark.h"
+#include "MedianFilter.h"
+#include "DemosaicCpu.h"
+#include "WindowStatistics.h"
+#include "FrameStream.h"
+#include "SizeSweep.h"
+#include "ThreadScaling.h"
+#include "TiledProcess.h"
+#include "TocMatrixBuffer.h"
+#ifdef SPEEDTESTS_AOT
+#include "AotKernels.h"
+#endif
 
 using namespace Halide;
 using namespace Halide::Tools;
@@ -28,13 +48,237 @@ using namespace std;
 //using namespace Halide::Runtime;
 
 
-template <typename Func, typename... Args>
-double timeFunction(Func func, Args&&... args) {
-    auto start = std::chrono::high_resolution_clock::now();
-    func(std::forward<Args>(args)...);
-    auto end = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double> duration = end - start;
-    return duration.count();
+// Target of the JIT pipelines: the host, with Halide's profiler under --profile.
+static bool gProfilePipelines = false;
+
+static Target jitTarget() {
+    Target target = get_host_target();
+    return gProfilePipelines ? target.with_feature(Target::Profile) : target;
+}
+
+// Cases whose pipeline comes from the cache are built for jitTarget(), so under
+// --profile their stages can be reported.
+static void profileCachedPipeline(BenchCase& bench) {
+    if (gProfilePipelines) {
+        bench.phases.profile = TakeProfilerReports;
+    }
+}
+
+#ifdef SPEEDTESTS_AOT
+// An AOT kernel's result, raised as the JIT pipelines raise the same errors,
+// so a failed run is neither timed as a fast one nor taken as output.
+static void checkAot(int result, const char* kernel) {
+    if (result != 0) {
+        throw Halide::RuntimeError(std::string(kernel) + " failed with Halide error " + std::to_string(result));
+    }
+}
+#endif
+
+// JIT pipelines, compiled once per key through the pipeline cache. Each takes
+// the hand schedule unless schedule names an autoscheduler.
+CachedPipeline& cachedBoxAverage(int radius, const PipelineSchedule& schedule = PipelineSchedule()) {
+    PipelineKey key{ "box_average", UInt(16), { radius }, jitTarget(), schedule };
+    return GetPipelineCache().Get(key, [radius](CachedPipeline& entry) {
+        entry.input = ImageParam(UInt(16), 2, "input");
+        Var x("x"), y("y");
+        Func avg = DefineBoxAverage(entry.input, entry.input.width(), entry.input.height(), radius);
+
+        // Schedule the function for CPU execution
+        if (entry.schedule.IsManual()) {
+            avg.parallel(y).vectorize(x, 8);
+        }
+        return avg;
+    });
+}
+
+// params[0] is the radius; only the accumulator type is compiled in.
+CachedPipeline& cachedBoxAverageIntegral(int radius, const PipelineSchedule& schedule = PipelineSchedule()) {
+    Type accum = BoxSumType(radius);
+    PipelineKey key{ "box_average_integral", UInt(16), { accum.bits() }, jitTarget(), schedule };
+    return GetPipelineCache().Get(key, [accum, radius](CachedPipeline& entry) {
+        entry.input = ImageParam(UInt(16), 2, "input");
+        entry.params.push_back(Param<>(Int(32), "radius"));
+        entry.params[0].set_estimate(radius);
+        BoxAverageIntegral box = DefineBoxAverageIntegral(entry.input, entry.input.width(), entry.input.height(),
+                                                          entry.params[0], accum);
+        if (entry.schedule.IsManual()) {
+            ScheduleBoxAverageIntegral(box, box.output, entry.target);
+        }
+        return box.output;
+    });
+}
+
+CachedPipeline& cachedBoxDemosaic(const PipelineSchedule& schedule = PipelineSchedule()) {
+    PipelineKey key{ "box_demosaic", UInt(16), {}, jitTarget(), schedule };
+    return GetPipelineCache().Get(key, [](CachedPipeline& entry) {
+        entry.input = ImageParam(UInt(16), 2, "input");
+        Func demosaic = DefineBoxDemosaic(entry.input, entry.input.width(), entry.input.height());
+        if (entry.schedule.IsManual()) {
+            Var x = demosaic.args()[0], y = demosaic.args()[1];
+            demosaic.parallel(y, 8).vectorize(x, entry.target.natural_vector_size<uint16_t>());
+        }
+        return demosaic;
+    });
+}
+
+// Each CFA pattern is compiled on its own.
+CachedPipeline& cachedBayerDemosaic(CfaPattern pattern = CfaPattern::RGGB,
+                                    const PipelineSchedule& schedule = PipelineSchedule()) {
+    PipelineKey key{ "bayer_demosaic", UInt(16), { int(pattern) }, jitTarget(), schedule };
+    return GetPipelineCache().Get(key, [pattern](CachedPipeline& entry) {
+        entry.input = ImageParam(UInt(16), 2, "input");
+        BayerDemosaic demosaic = DefineBayerDemosaic(entry.input, entry.input.width(), entry.input.height(), pattern);
+        if (entry.schedule.IsManual()) {
+            ScheduleBayerDemosaic(demosaic, demosaic.output, entry.target);
+        }
+        return demosaic.output;
+    });
+}
+
+CachedPipeline& cachedBayerDemosaicMHC(CfaPattern pattern = CfaPattern::RGGB,
+                                       const PipelineSchedule& schedule = PipelineSchedule()) {
+    PipelineKey key{ "bayer_demosaic_mhc", UInt(16), { int(pattern) }, jitTarget(), schedule };
+    return GetPipelineCache().Get(key, [pattern](CachedPipeline& entry) {
+        entry.input = ImageParam(UInt(16), 2, "input");
+        BayerDemosaic demosaic = DefineBayerDemosaicMHC(entry.input, entry.input.width(), entry.input.height(), pattern);
+        if (entry.schedule.IsManual()) {
+            ScheduleBayerDemosaic(demosaic, demosaic.output, entry.target);
+        }
+        return demosaic.output;
+    });
+}
+
+CachedPipeline& cachedMedian(int kernelSize, bool bayer, const PipelineSchedule& schedule = PipelineSchedule()) {
+    PipelineKey key{ bayer ? "bayer_median" : "median", UInt(16), { kernelSize }, jitTarget(), schedule };
+    return GetPipelineCache().Get(key, [kernelSize, bayer](CachedPipeline& entry) {
+        entry.input = ImageParam(UInt(16), 2, "input");
+        bool manual = entry.schedule.IsManual();
+        if (bayer) {
+            BayerMedian median = DefineBayerMedian(entry.input, entry.input.width(), entry.input.height(), kernelSize);
+            if (manual) {
+                ScheduleBayerMedian(median, median.output, entry.target);
+            }
+            return median.output;
+        }
+        Median median = DefineMedian(entry.input, entry.input.width(), entry.input.height(), kernelSize);
+        if (manual) {
+            ScheduleMedian(median, median.output, entry.target);
+        }
+        return median.output;
+    });
+}
+
+// params[0] is the radius. Realizes into (mean, variance) float buffers.
+CachedPipeline& cachedLocalStatistics(const PipelineSchedule& schedule = PipelineSchedule()) {
+    PipelineKey key{ "local_statistics", UInt(16), {}, jitTarget(), schedule };
+    return GetPipelineCache().Get(key, [](CachedPipeline& entry) {
+        entry.input = ImageParam(UInt(16), 2, "input");
+        entry.params.push_back(Param<>(Int(32), "radius"));
+        entry.params[0].set_estimate(3);
+        LocalStatistics stats = DefineLocalStatistics(entry.input, entry.input.width(), entry.input.height(), entry.params[0]);
+        if (entry.schedule.IsManual()) {
+            ScheduleLocalStatistics(stats, stats.output, entry.target);
+        }
+        return stats.output;
+    });
+}
+
+// params[0] is the variance threshold.
+CachedPipeline& cachedMedianGate(Type type, int kernelSize, const PipelineSchedule& schedule = PipelineSchedule()) {
+    PipelineKey key{ "median_gate", type, { kernelSize }, jitTarget(), schedule };
+    return GetPipelineCache().Get(key, [type, kernelSize](CachedPipeline& entry) {
+        entry.input = ImageParam(type, 3, "input");
+        entry.params.push_back(Param<>(Float(32), "variance_threshold"));
+        entry.params[0].set_estimate(80.0f);
+        MedianGate gate = DefineMedianGate(entry.input, entry.input.width(), entry.input.height(), kernelSize, entry.params[0]);
+        if (entry.schedule.IsManual()) {
+            ScheduleMedianGate(gate, gate.output, entry.target);
+        }
+        return gate.output;
+    });
+}
+
+// params[0] is the brightness factor.
+CachedPipeline& cachedBrighten(const PipelineSchedule& schedule = PipelineSchedule()) {
+    PipelineKey key{ "brighten", UInt(8), {}, jitTarget(), schedule };
+    return GetPipelineCache().Get(key, [](CachedPipeline& entry) {
+        entry.input = ImageParam(UInt(8), 3, "input");
+        entry.params.push_back(Param<>(Int(32), "factor"));
+        entry.params[0].set_estimate(50);
+        Func brighten = DefineBrighten(entry.input, entry.params[0]);
+        if (entry.schedule.IsManual()) {
+            Var x = brighten.args()[0], y = brighten.args()[1];
+            brighten.vectorize(x, entry.target.natural_vector_size<uint8_t>()).parallel(y);
+        }
+        return brighten;
+    });
+}
+
+// Kernels with a batched form, which realizes several same-sized frames at once.
+static bool isBatchedKernel(const std::string& kernel) {
+    return kernel == "box_demosaic" || kernel == "bayer_demosaic" || kernel == "bayer_demosaic_mhc" ||
+           kernel == "median" || kernel == "bayer_median" || kernel == "brighten";
+}
+
+// A kernel's batched pipeline: the input gains a last, frame dimension that
+// Halide's implicit variables carry through every stage unchanged, so the
+// algorithm and hand schedule are the single-frame ones. The hand schedule
+// then runs the frames in parallel around its own parallel strips, so one
+// realize of many small frames fills the thread pool the way one large frame
+// does. params[0] is brighten's factor.
+CachedPipeline& cachedBatched(const std::string& kernel, int kernelSize, CfaPattern pattern,
+                              const PipelineSchedule& schedule = PipelineSchedule()) {
+    bool brighten = (kernel == "brighten");
+    PipelineKey key{ kernel + "_batch", brighten ? UInt(8) : UInt(16), { kernelSize, int(pattern) }, jitTarget(), schedule };
+    return GetPipelineCache().Get(key, [kernel, kernelSize, pattern, brighten](CachedPipeline& entry) {
+        entry.batched = true;
+        entry.input = ImageParam(brighten ? UInt(8) : UInt(16), brighten ? 4 : 3, "input");
+        Expr width = entry.input.width(), height = entry.input.height();
+        bool manual = entry.schedule.IsManual();
+        Func out;
+        if (brighten) {
+            entry.params.push_back(Param<>(Int(32), "factor"));
+            entry.params[0].set_estimate(50);
+            out = DefineBrighten(entry.input, entry.params[0]);
+            if (manual) {
+                Var x = out.args()[0], y = out.args()[1];
+                out.vectorize(x, entry.target.natural_vector_size<uint8_t>()).parallel(y);
+            }
+        }
+        else if (kernel == "box_demosaic") {
+            out = DefineBoxDemosaic(entry.input, width, height);
+            if (manual) {
+                Var x = out.args()[0], y = out.args()[1];
+                out.parallel(y, 8).vectorize(x, entry.target.natural_vector_size<uint16_t>());
+            }
+        }
+        else if (kernel == "median") {
+            Median median = DefineMedian(entry.input, width, height, kernelSize);
+            if (manual) {
+                ScheduleMedian(median, median.output, entry.target);
+            }
+            out = median.output;
+        }
+        else if (kernel == "bayer_median") {
+            BayerMedian median = DefineBayerMedian(entry.input, width, height, kernelSize);
+            if (manual) {
+                ScheduleBayerMedian(median, median.output, entry.target);
+            }
+            out = median.output;
+        }
+        else {
+            BayerDemosaic demosaic = (kernel == "bayer_demosaic_mhc") ? DefineBayerDemosaicMHC(entry.input, width, height, pattern)
+                                                                      : DefineBayerDemosaic(entry.input, width, height, pattern);
+            if (manual) {
+                ScheduleBayerDemosaic(demosaic, demosaic.output, entry.target);
+            }
+            out = demosaic.output;
+        }
+        if (manual) {
+            out.parallel(out.args().back());
+        }
+        return out;
+    });
 }
 
 void simpleBufferCopy(const std::vector<uint16_t>& image, int width, int height) {
@@ -57,7 +301,9 @@ void simpleBufferCopy(const std::vector<uint16_t>& image, int width, int height)
     }
 }
 
-void processImage(const std::vector<uint16_t>& image, int width, int height, int radius) {
+// Box average of the image. The integral-image version costs the same for any
+// radius; the original sums (2r+1)^2 taps per pixel.
+void processImage(const std::vector<uint16_t>& image, int width, int height, int radius, bool integral = true) {
     // Create an input and output buffer that will be used for every iteration of the loop.
     Buffer<uint16_t> inBuf(width, height);
     Buffer<uint16_t> outBuf(width, height);
@@ -65,35 +311,40 @@ void processImage(const std::vector<uint16_t>& image, int width, int height, int
     // Copy the image data to the input buffer
     memcpy(inBuf.data(), image.data(), image.size() * sizeof(uint16_t));
 
-    Var x("x"), y("y");
-
-    // Define the boundary condition to set pixels outside the image to 0
-    Func clamped = BoundaryConditions::constant_exterior(inBuf, 0);
-
-    // Compute the clamped coordinates for the averaging and use them to compute the area of the averaging region.
-    Expr clamped_minX = clamp(x - radius, 0, inBuf.width() - 1);
-    Expr clamped_maxX = clamp(x + radius, 0, inBuf.width() - 1);
-    Expr clamped_minY = clamp(y - radius, 0, inBuf.height() - 1);
-    Expr clamped_maxY = clamp(y + radius, 0, inBuf.height() - 1);
-    Expr area = (clamped_maxX - clamped_minX + 1) * (clamped_maxY - clamped_minY + 1);
-    Func avg("avg");
-
-    try {
-        RDom d(-radius, 2 * radius + 1, -radius, 2 * radius + 1);
-        avg(x, y) = cast<uint16_t>(0); ///< Needed because you can't use a domain in a pure function definition
-        avg(x, y) += cast<uint16_t>(clamped(x + d.x, y + d.y) / area);
-        avg.update(0).unscheduled(); ///< This squashes a JIT compiler warning about the update being scheduled
+    if (integral) {
+#ifdef SPEEDTESTS_AOT
+        if (int result = AotBoxAverageIntegral(inBuf.raw_buffer(), radius, outBuf.raw_buffer())) {
+            std::cerr << "AotBoxAverageIntegral failed with Halide error " << result << std::endl;
+            return;
+        }
+#else
+        CachedPipeline& box = cachedBoxAverageIntegral(radius);
+        box.input.set(inBuf);
+        box.params[0].set(radius);
+        box.pipeline.realize(outBuf, box.target);
+#endif
     }
-    catch (Halide::CompileError& e) {
-        std::cerr << "Compile error when defining Halide code: " << e.what() << std::endl;
-        return;
+#ifdef SPEEDTESTS_AOT
+    else if (radius == kAotBoxRadius) {
+        if (int result = AotBoxAverage(inBuf.raw_buffer(), outBuf.raw_buffer())) {
+            std::cerr << "AotBoxAverage failed with Halide error " << result << std::endl;
+            return;
+        }
     }
+#endif
+    else {
+        try {
+            CachedPipeline& avg = cachedBoxAverage(radius);
 
-    // Schedule the function for CPU execution
-    avg.parallel(y).vectorize(x, 8);
-
-    // Realize the function
-    avg.realize(outBuf);
+            // Realize the function
+            avg.input.set(inBuf);
+            avg.pipeline.realize(outBuf, avg.target);
+        }
+        catch (Halide::CompileError& e) {
+            std::cerr << "Compile error when defining Halide code: " << e.what() << std::endl;
+            return;
+        }
+    }
 
     // Copy the output buffer back to the host
     outBuf.copy_to_host();
@@ -108,17 +359,16 @@ void processImage(const std::vector<uint16_t>& image, int width, int height, int
 }
 
 void demosaicHalide(Buffer<uint16_t> input, Buffer<uint16_t>& output) {
-    Var x("x"), y("y");
-    Func demosaic("demosaic");
-
-    // Apply boundary conditions
-    Func clamped = BoundaryConditions::repeat_edge(input);
-
-    // Simple bilinear interpolation demosaicing
-    demosaic(x, y) = (clamped(x, y) + clamped(x + 1, y) + clamped(x, y + 1) + clamped(x + 1, y + 1)) / 4;
+#ifdef SPEEDTESTS_AOT
+    output = Buffer<uint16_t>(input.width(), input.height());
+    checkAot(AotBoxDemosaic(input.raw_buffer(), output.raw_buffer()), "AotBoxDemosaic");
+#else
+    CachedPipeline& demosaic = cachedBoxDemosaic();
 
     // Realize the function
-    output = demosaic.realize({ input.width(), input.height() });
+    demosaic.input.set(input);
+    output = demosaic.pipeline.realize({ input.width(), input.height() }, demosaic.target);
+#endif
 }
 
 Buffer<uint16_t> convertToHalideBuffer(std::unique_ptr<uint16_t[]>& bufImg, int width, int height) {
@@ -144,8 +394,8 @@ void demosaicImage(const char* input_filename, const char* output_filename) {
         }
         printf("Opened TIFF file: %s\n", input_filename);
 
-        std::unique_ptr<uint16_t[]> bufImg;
-        if (inputImage.ReadMonochrome(bufImg) != 0) {
+        std::vector<uint16_t> bufImg;
+        if (inputImage.ReadMonochromeStrips(bufImg) != 0) {
             fprintf(stderr, "Failed to read image data\n");
             inputImage.CloseFile();
             return;
@@ -180,7 +430,7 @@ void demosaicImage(const char* input_filename, const char* output_filename) {
         Buffer<int> result(8, 8);
 
 
-        Buffer<uint16_t> halideBuffer = convertToHalideBuffer(bufImg, inputImage.getWidth(), inputImage.getHeight());
+        Buffer<uint16_t> halideBuffer(bufImg.data(), inputImage.getWidth(), inputImage.getHeight());
 
         Buffer<uint16_t> outBuffer(inputImage.getWidth(), inputImage.getHeight());
         // Call the demosaicing function
@@ -195,29 +445,12 @@ void demosaicImage(const char* input_filename, const char* output_filename) {
         printf("Realized Halide function\n");
 
         // Create and write the output TIFF image
-        TIFF* out = TIFFOpen(output_filename, "w");
-        if (!out) {
-            fprintf(stderr, "Failed to open output TIFF file: %s\n", output_filename);
+        TiffImageView image = { outBuffer.data(), uint32_t(outBuffer.width()), uint32_t(outBuffer.height()), 1, 16,
+                                outBuffer.width() * sizeof(uint16_t), 0 };
+        if (TiffWriteImage(output_filename, image) != kNoError) {
+            fprintf(stderr, "Failed to write output TIFF file: %s\n", output_filename);
             return;
         }
-        printf("Opened output TIFF file: %s\n", output_filename);
-
-        TIFFSetField(out, TIFFTAG_IMAGEWIDTH, outBuffer.width());
-        TIFFSetField(out, TIFFTAG_IMAGELENGTH, outBuffer.height());
-        TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, 16);
-        TIFFSetField(out, TIFFTAG_ORIENTATION, ORIENTATION_TOPLEFT);
-        TIFFSetField(out, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
-        TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
-
-        for (uint32_t row = 0; row < outBuffer.height(); row++) {
-            if (TIFFWriteScanline(out, outBuffer.data() + row * outBuffer.width(), row, 0) < 0) {
-                fprintf(stderr, "Failed to write TIFF scanline\n");
-                TIFFClose(out);
-                return;
-            }
-        }
-
-        TIFFClose(out);
         printf("Image written successfully to %s\n", output_filename);
     }
     catch (const std::exception& e) {
@@ -239,97 +472,576 @@ void brightHalide(const std::string& filename, int factor) {
     }
 
 
-    Halide::Func brighter;
-    Halide::Var x, y, c;
+#ifdef SPEEDTESTS_AOT
+    Halide::Buffer<uint8_t> output(input.width(), input.height(), input.channels());
+    if (int result = AotBrighten(input.raw_buffer(), factor, output.raw_buffer())) {
+        std::cerr << "AotBrighten failed with Halide error " << result << std::endl;
+        return;
+    }
+#else
+    CachedPipeline& brighter = cachedBrighten();
+    brighter.input.set(input);
+    brighter.params[0].set(factor);
+    Halide::Buffer<uint8_t> output =
+        brighter.pipeline.realize({ input.width(), input.height(), input.channels() }, brighter.target);
+#endif
+
+    save_image(output, "brighterHalide.png");
+};
 
-    Halide::Expr value = input(x, y, c);
 
-    value = value + factor;
-    value = Halide::min(value, 255.0f);
+void medianFilter(const std::string& filename, int kernel_size, float variance_threshold) {
+    try {
+        // Load the input image, 8- or 16-bit
+        Buffer<> input = Tools::load_image(filename);
 
-    value = Halide::cast<uint8_t>(value);
+        // Create an output buffer
+        Buffer<> output(input.type(), input.width(), input.height(), input.channels());
 
-    brighter(x, y, c) = value;
-    Halide::Buffer<uint8_t> output =
-        brighter.realize({ input.width(), input.height(), input.channels() });
+#ifdef SPEEDTESTS_AOT
+        if (kernel_size == kAotMedianKernelSize && input.type() == UInt(8)) {
+            checkAot(AotMedianGate(input.raw_buffer(), variance_threshold, output.raw_buffer()), "AotMedianGate");
+        }
+        else
+#endif
+        {
+            CachedPipeline& median = cachedMedianGate(input.type(), kernel_size);
+
+            // Realize the algorithm into the output buffer
+            median.input.set(input);
+            median.params[0].set(variance_threshold);
+            median.pipeline.realize(output, median.target);
+        }
 
-    save_image(output, "brighterHalide.png");
-};
+        // Save the output
+        Tools::save_image(output, "bay_clean2.png");
+    }
+    catch (const Halide::CompileError& e) {
+        std::cerr << "Halide Compile Error: " << e.what() << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Standard Exception: " << e.what() << std::endl;
+    }
+    catch (...) {
+        std::cerr << "Unknown Exception occurred." << std::endl;
+    }
+}
 
+// Compare the scanline reader with the strip/tile reader on one TIFF.
+void compareTiffReaders(const std::string& filename) {
+    TiffSrcFile inputImage;
+    if (inputImage.OpenFile(filename.c_str()) != 0) {
+        fprintf(stderr, "Failed to open TIFF file: %s\n", filename.c_str());
+        return;
+    }
+
+    double megaBytes = double(inputImage.getWidth()) * inputImage.getHeight() * sizeof(uint16_t) / (1024.0 * 1024.0);
+    std::vector<uint16_t> scanBuf, stripBuf;
+
+    // Warm the file cache so neither reader pays for the first disk read.
+    inputImage.ReadMonochromeStrips(stripBuf);
 
-float calculateKernelVariance(Buffer<uint8_t> input, int x, int y, int kernel_size) {
-    int half_kernel = kernel_size / 2;
-    RDom r(-half_kernel, kernel_size, -half_kernel, kernel_size);
+    double scanTime = TimeSeconds([&]() { inputImage.ReadMonochrome(scanBuf); });
+    double stripTime = TimeSeconds([&]() { inputImage.ReadMonochromeStrips(stripBuf); });
 
-    // Define a Func to compute the mean
-    Func mean_func;
-    mean_func() = sum(cast<float>(input(x + r.x, y + r.y))) / (kernel_size * kernel_size);
+    printf("%s: %u x %u, %s, compression %u, %u rows per strip\n", filename.c_str(),
+        inputImage.getWidth(), inputImage.getHeight(), inputImage.IsTiled() ? "tiled" : "stripped",
+        unsigned(inputImage.getCompression()), inputImage.getRowsPerStrip());
+    printf("  scanline reader: %8.1f MB/s\n", megaBytes / scanTime);
+    printf("  strip reader:    %8.1f MB/s (%.2fx)\n", megaBytes / stripTime, scanTime / stripTime);
+    if (scanBuf != stripBuf) {
+        fprintf(stderr, "  readers disagree on the pixel data\n");
+    }
+    inputImage.CloseFile();
+}
 
-    // Realize the mean
-    Buffer<float> mean_buf = mean_func.realize();
-    float mean = mean_buf();
+// Read every page of a multi-page TIFF one after another, then with the
+// pages spread over a growing number of workers.
+void compareTiffPages(const std::string& filename) {
+    TiffSrcFile inputImage;
+    if (inputImage.OpenFile(filename.c_str()) != 0) {
+        fprintf(stderr, "Failed to open TIFF file: %s\n", filename.c_str());
+        return;
+    }
 
-    // Define a Func to compute the variance
-    Func variance_func;
-    variance_func() = sum(pow(cast<float>(input(x + r.x, y + r.y)) - mean, 2)) / (kernel_size * kernel_size);
+    uint32_t pages = inputImage.GetPageCount();
+    double megaBytes = 0.0;
+    for (uint32_t page = 0; page < pages; page++) {
+        const TiffPageInfo& info = inputImage.GetPageInfo(page);
+        megaBytes += double(info.nWidth) * info.nHeight * sizeof(uint16_t) / (1024.0 * 1024.0);
+    }
+    printf("%s: %u pages, %.1f MB decoded\n", filename.c_str(), pages, megaBytes);
+
+    // Checksums show every ordering decoded the same pixels.
+    std::vector<uint64_t> serialSums(pages), parallelSums(pages);
+    std::vector<uint16_t> buf;
+    auto checksum = [](const std::vector<uint16_t>& v) {
+        uint64_t sum = 0;
+        for (uint16_t value : v) {
+            sum = sum * 31 + value;
+        }
+        return sum;
+    };
+
+    bool ok = true;
+    double serialTime = TimeSeconds([&]() {
+        for (uint32_t page = 0; page < pages && ok; page++) {
+            ok = inputImage.ReadPage(page, buf, 1) == kNoError;
+            serialSums[page] = checksum(buf);
+        }
+    });
+    if (!ok) {
+        fprintf(stderr, "  failed to read the pages serially\n");
+        return;
+    }
+    printf("  serial:     %8.1f MB/s\n", megaBytes / serialTime);
+
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned threads = 1; threads <= maxThreads; threads *= 2) {
+        double time = TimeSeconds([&]() {
+            ok = inputImage.ForEachPage([&](uint32_t page, const TiffPageInfo&, std::vector<uint16_t>& pixels) {
+                parallelSums[page] = checksum(pixels);
+                return true;
+            }, threads) == kNoError;
+        });
+        if (!ok) {
+            fprintf(stderr, "  failed to read the pages on %u threads\n", threads);
+            return;
+        }
+        printf("  %2u threads: %8.1f MB/s (%.2fx)%s\n", threads, megaBytes / time, serialTime / time,
+            parallelSums == serialSums ? "" : "  pixel data differs");
+    }
+    inputImage.CloseFile();
+}
 
-    // Realize the variance
-    Buffer<float> variance_buf = variance_func.realize();
-    return variance_buf();
+// A dense Halide buffer as a TIFF image; each channel is written as its own plane.
+static TiffImageView tiffView(const Buffer<uint16_t>& buffer) {
+    TiffImageView image = { buffer.data(), uint32_t(buffer.width()), uint32_t(buffer.height()),
+                            uint16_t(buffer.channels()), 16, size_t(buffer.stride(1)) * sizeof(uint16_t), 0 };
+    if (buffer.channels() > 1) {
+        image.nPlaneStride = size_t(buffer.stride(2)) * sizeof(uint16_t);
+    }
+    return image;
 }
 
-void medianFilter(const std::string& filename, int kernel_size, float variance_threshold) {
-    try {
-        // Load the input image
-        Buffer<uint8_t> input = Tools::load_image(filename);
+// Write the demosaiced 48-bit RGB of a TIFF with each writer layout and codec,
+// against the time it takes to compute it.
+void compareTiffWriters(const std::string& filename) {
+    TiffSrcFile inputImage;
+    std::vector<uint16_t> bufImg;
+    if (inputImage.OpenFile(filename.c_str()) != 0 || inputImage.ReadMonochromeStrips(bufImg) != 0) {
+        fprintf(stderr, "Failed to read TIFF file: %s\n", filename.c_str());
+        return;
+    }
+    int width = inputImage.getWidth();
+    int height = inputImage.getHeight();
+    CfaPattern pattern = CfaPattern::RGGB;
+    inputImage.GetCfaPattern(pattern);
+    inputImage.CloseFile();
+
+    CachedPipeline& pipeline = cachedBayerDemosaic(pattern);
+    Buffer<uint16_t> input(bufImg.data(), width, height);
+    Buffer<uint16_t> rgb(width, height, 3);
+    pipeline.input.set(input);
+    pipeline.pipeline.realize(rgb, pipeline.target);
+    double computeTime = TimeSeconds([&]() { pipeline.pipeline.realize(rgb, pipeline.target); });
+
+    struct WriterCase {
+        const char* name;
+        uint16_t compression;
+        uint32_t rowsPerStrip;
+        uint32_t tileSize;
+        unsigned threads;
+    };
+    const WriterCase cases[] = {
+        { "none, 1 row per strip", COMPRESSION_NONE, 1, 0, 1 },
+        { "none", COMPRESSION_NONE, 0, 0, 1 },
+        { "deflate, 1 thread", COMPRESSION_ADOBE_DEFLATE, 0, 0, 1 },
+        { "deflate", COMPRESSION_ADOBE_DEFLATE, 0, 0, 0 },
+        { "deflate, 256 tiles", COMPRESSION_ADOBE_DEFLATE, 0, 256, 0 },
+        { "lzw, 1 thread", COMPRESSION_LZW, 0, 0, 1 },
+        { "lzw", COMPRESSION_LZW, 0, 0, 0 },
+        { "zstd, 1 thread", COMPRESSION_ZSTD, 0, 0, 1 },
+        { "zstd", COMPRESSION_ZSTD, 0, 0, 0 },
+    };
+
+    std::string outName = (std::filesystem::temp_directory_path() / "speedtests_writer.tif").string();
+    TiffImageView image = tiffView(rgb);
+    double megaBytes = double(width) * height * 3 * sizeof(uint16_t) / (1024.0 * 1024.0);
+
+    printf("48-bit RGB %d x %d, %.1f MB; demosaic %.1f MB/s\n", width, height, megaBytes, megaBytes / computeTime);
+    for (const WriterCase& writer : cases) {
+        TiffWriteOptions options;
+        options.nCompression = writer.compression;
+        options.nRowsPerStrip = writer.rowsPerStrip;
+        options.nTileWidth = options.nTileHeight = writer.tileSize;
+        options.nThreads = writer.threads;
+
+        TocErr_t ec = kNoError;
+        double time = TimeSeconds([&]() { ec = TiffWriteImage(outName.c_str(), image, options); });
+        if (ec == kErrTiff_Codec) {
+            printf("  %-22s not built into libtiff\n", writer.name);
+            continue;
+        }
+        if (ec != kNoError) {
+            fprintf(stderr, "  %-22s failed to write %s\n", writer.name, outName.c_str());
+            continue;
+        }
+        std::error_code error;
+        double fileMegaBytes = double(std::filesystem::file_size(outName, error)) / (1024.0 * 1024.0);
+        printf("  %-22s %8.1f MB/s  ratio %.2f\n", writer.name, megaBytes / time, megaBytes / fileMegaBytes);
+    }
+    std::filesystem::remove(outName);
+}
 
-        // Define the algorithm
-        Var x, y, c;
-        Func clamped = BoundaryConditions::repeat_edge(input);
-        Func median;
+// Compare reading a PGM into memory with mapping it in place.
+void comparePGMLoads(const std::string& filename) {
+    const std::pair<PGMImage::LoadMode, const char*> modes[] = {
+        { PGMImage::LoadMode::Read, "read + swap" },
+        { PGMImage::LoadMode::MapView, "mapped view" },
+        { PGMImage::LoadMode::MapPrivate, "mapped private" },
+    };
+
+    for (const auto& mode : modes) {
+        uint64_t checksum = 0;
+        double megaBytes = 0.0;
+        double loadTime = TimeSeconds([&]() {
+            // Touch every pixel so the mapped modes pay for their page faults.
+            PGMImage image(filename, mode.first);
+            for (uint32_t y = 0; y < image.height(); y++) {
+                for (uint32_t x = 0; x < image.width(); x++) {
+                    checksum += image.pixel(x, y);
+                }
+            }
+            megaBytes = double(image.size()) * sizeof(uint16_t) / (1024.0 * 1024.0);
+        });
+        printf("  %-15s %8.1f MB/s (checksum %llu)\n", mode.second, megaBytes / loadTime, (unsigned long long)checksum);
+    }
+}
 
-        // Define a reduction domain for the specified kernel size
-        int half_kernel = kernel_size / 2;
-        RDom r(-half_kernel, kernel_size, -half_kernel, kernel_size);
+// A smooth color image with sharp edges: low-frequency color ramps, a chirp
+// that sweeps up to near the Nyquist rate, and a few hard-edged shapes.
+static Buffer<uint16_t> syntheticRGB(int width, int height) {
+    Buffer<uint16_t> rgb(width, height, 3);
+    const double pi = 3.14159265358979;
+    for (int c = 0; c < 3; c++) {
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                double u = double(x) / width, v = double(y) / height;
+                double ramp = 0.5 + 0.3 * std::sin(2 * pi * (u * (c + 1) + v * (3 - c)) + c);
+                double chirp = 0.1 * std::cos(pi * width * u * u * 0.4 + c * 0.5);
+                bool inside = (std::abs(u - 0.3) < 0.1 && std::abs(v - 0.6) < 0.15) ||
+                              (std::hypot(u - 0.7, v - 0.35) < 0.12) || (u > v && u - v < 0.05);
+                double value = inside ? (c == 1 ? 0.9 : 0.15) : ramp + chirp;
+                rgb(x, y, c) = uint16_t(std::clamp(value, 0.0, 1.0) * 65535.0 + 0.5);
+            }
+        }
+    }
+    return rgb;
+}
 
-        // Calculate the mean and variance using reduction domains
-        Func mean_func, variance_func;
-        mean_func(x, y, c) = sum(cast<float>(clamped(x + r.x, y + r.y, c))) / (kernel_size * kernel_size);
-        Expr mean = mean_func(x, y, c);
+// Noise within 255 of full scale, where the sum of two or four pixels no
+// longer fits in 16 bits, so an average that drops the carry shows.
+static Buffer<uint16_t> brightRGB(int width, int height) {
+    Buffer<uint16_t> rgb(width, height, 3);
+    uint32_t state = 12345;
+    rgb.for_each_element([&](int x, int y, int c) {
+        state = state * 1664525u + 1013904223u;
+        rgb(x, y, c) = uint16_t(65535 - (state >> 24));
+    });
+    return rgb;
+}
 
-        variance_func(x, y, c) = sum(pow(cast<float>(clamped(x + r.x, y + r.y, c)) - mean, 2)) / (kernel_size * kernel_size);
-        Expr variance = variance_func(x, y, c);
+// The Bayer mosaic a camera with the given layout would record of rgb.
+static Buffer<uint16_t> mosaicOf(const Buffer<uint16_t>& rgb, CfaPattern pattern) {
+    Buffer<uint16_t> mosaic(rgb.width(), rgb.height());
+    for (int y = 0; y < rgb.height(); y++) {
+        for (int x = 0; x < rgb.width(); x++) {
+            // Red where both offsets from the red pixel are even, blue where both are odd
+            int dx = (x ^ CfaRedX(pattern)) & 1, dy = (y ^ CfaRedY(pattern)) & 1;
+            int c = (dx == dy) ? (dx ? 2 : 0) : 1;
+            mosaic(x, y) = rgb(x, y, c);
+        }
+    }
+    return mosaic;
+}
 
-        // Collect the values in the neighborhood
-        std::vector<Expr> values;
-        for (int i = 0; i < kernel_size * kernel_size; i++) {
-            values.push_back(clamped(x + r.x, y + r.y, c));
+// PSNR of one channel against the truth, leaving out a two-pixel border.
+template <typename Image>
+static double channelPSNR(const Image& out, const Buffer<uint16_t>& truth, int c) {
+    double sumSq = 0.0;
+    size_t count = 0;
+    for (int y = 2; y < truth.height() - 2; y++) {
+        for (int x = 2; x < truth.width() - 2; x++) {
+            double diff = double(out(x, y, c)) - truth(x, y, c);
+            sumSq += diff * diff;
+            count++;
         }
+    }
+    double mse = sumSq / std::max<size_t>(count, 1);
+    return mse > 0.0 ? 10.0 * std::log10(65535.0 * 65535.0 / mse) : INFINITY;
+}
 
-        // Apply the median filter if the variance is below the threshold
-        median(x, y, c) = select(variance < variance_threshold, cast<uint8_t>(values[values.size() / 2]), clamped(x, y, c));
+// Quality and speed of the bilinear and Malvar-He-Cutler demosaics on an RGGB
+// mosaic sampled from a synthetic image, so the true RGB is known.
+void compareDemosaicQuality(int width, int height, int repetitions = 10) {
+    width &= ~1;
+    height &= ~1;
+    Buffer<uint16_t> truth = syntheticRGB(width, height);
+    Buffer<uint16_t> mosaic = mosaicOf(truth, CfaPattern::RGGB);
+
+    printf("Demosaic quality on a %d x %d synthetic RGGB mosaic (PSNR in dB):\n", width, height);
+    printf("  %-10s %9s %7s %7s %7s\n", "", "MP/s", "R", "G", "B");
+    const std::pair<const char*, CachedPipeline*> pipelines[] = {
+        { "bilinear", &cachedBayerDemosaic() },
+        { "mhc", &cachedBayerDemosaicMHC() },
+    };
+    for (const auto& entry : pipelines) {
+        CachedPipeline& pipeline = *entry.second;
+        Buffer<uint16_t> out(width, height, 3);
+        pipeline.input.set(mosaic);
+        pipeline.pipeline.realize(out, pipeline.target);
+        double time = TimeSeconds([&]() {
+            for (int i = 0; i < repetitions; i++) {
+                pipeline.pipeline.realize(out, pipeline.target);
+            }
+        }) / repetitions;
+        printf("  %-10s %9.1f %7.2f %7.2f %7.2f\n", entry.first, double(width) * height / time / 1e6,
+            channelPSNR(out, truth, 0), channelPSNR(out, truth, 1), channelPSNR(out, truth, 2));
+    }
+}
 
-        // Schedule the algorithm
-        median.vectorize(x, 16).parallel(y);
+// Throughput of the original select-based demosaic and the per-phase pipeline.
+// JIT compilation happens before the timed realizations.
+void compareBayerDemosaic(const std::string& filename, int repetitions = 10) {
+    TiffSrcFile inputImage;
+    std::vector<uint16_t> bufImg;
+    if (inputImage.OpenFile(filename.c_str()) != 0 || inputImage.ReadMonochromeStrips(bufImg) != 0) {
+        fprintf(stderr, "Failed to read TIFF file: %s\n", filename.c_str());
+        return;
+    }
+    int width = inputImage.getWidth();
+    int height = inputImage.getHeight();
+    inputImage.CloseFile();
+
+    Buffer<uint16_t> input(bufImg.data(), width, height);
+    Target target = get_host_target();
+
+    // The original has no boundary condition, so it only covers the interior.
+    Func selectDemosaic = DefineBayerDemosaicSelect(Func(input));
+    Buffer<uint16_t> selectOut(width - 2, height - 2, 3);
+    selectOut.set_min(1, 1, 0);
+    selectDemosaic.compile_jit(target);
+
+    BayerDemosaic phaseDemosaic = DefineBayerDemosaic(Func(input), width, height);
+    ScheduleBayerDemosaic(phaseDemosaic, phaseDemosaic.output, target);
+    Buffer<uint16_t> phaseOut(width, height, 3);
+    phaseDemosaic.output.compile_jit(target);
+
+    double selectTime = TimeSeconds([&]() {
+        for (int i = 0; i < repetitions; i++) {
+            selectDemosaic.realize(selectOut);
+        }
+    }) / repetitions;
+    double phaseTime = TimeSeconds([&]() {
+        for (int i = 0; i < repetitions; i++) {
+            phaseDemosaic.output.realize(phaseOut);
+        }
+    }) / repetitions;
+
+    printf("Bayer demosaic %d x %d:\n", width, height);
+    printf("  select per pixel: %8.1f MP/s\n", double(width - 2) * (height - 2) / selectTime / 1e6);
+    printf("  per-phase:        %8.1f MP/s (%.1fx)\n", double(width) * height / phaseTime / 1e6,
+        (double(width) * height / phaseTime) / (double(width - 2) * (height - 2) / selectTime));
+
+    // The hand-written kernels must reproduce the per-phase pipeline exactly.
+    Buffer<uint16_t> cpuOut(width, height, 3);
+    for (CpuKernel kernel : { CpuKernel::Scalar, CpuKernel::Auto }) {
+        auto run = [&]() {
+            return BayerDemosaicBilinear(input.data(), width, cpuOut.data(), cpuOut.stride(1), cpuOut.stride(2), width,
+                height, CfaPattern::RGGB, 0, kernel);
+        };
+        if (!run()) {
+            continue;
+        }
+        bool ok = true;
+        double cpuTime = TimeSeconds([&]() {
+            for (int i = 0; i < repetitions; i++) {
+                ok = run() && ok;
+            }
+        }) / repetitions;
+        if (!ok) {
+            printf("  hand-written %-6s FAILED\n", CpuKernelName(kernel));
+            continue;
+        }
+        bool same = std::equal(cpuOut.data(), cpuOut.data() + cpuOut.number_of_elements(), phaseOut.data());
+        printf("  hand-written %-6s %6.1f MP/s (%.2fx per-phase)%s\n", CpuKernelName(kernel),
+            double(width) * height / cpuTime / 1e6, phaseTime / cpuTime, same ? "" : "  OUTPUT DIFFERS");
+    }
 
-        // Create an output buffer
-        Buffer<uint8_t> output(input.width(), input.height(), input.channels());
+    // Every CFA pattern has its own compiled pipeline and template instance;
+    // none should be slower than RGGB, and the two must still agree.
+    printf("  per CFA pattern, MP/s:  %8s %8s\n", "halide", CpuKernelName(CpuKernel::Auto));
+    for (CfaPattern pattern : kCfaPatterns) {
+        CachedPipeline& pipeline = cachedBayerDemosaic(pattern);
+        pipeline.input.set(input);
+        pipeline.pipeline.realize(phaseOut, pipeline.target);
+        double halideTime = TimeSeconds([&]() {
+            for (int i = 0; i < repetitions; i++) {
+                pipeline.pipeline.realize(phaseOut, pipeline.target);
+            }
+        }) / repetitions;
+        bool ok = true;
+        double cpuTime = TimeSeconds([&]() {
+            for (int i = 0; i < repetitions; i++) {
+                ok = BayerDemosaicBilinear(input.data(), width, cpuOut.data(), cpuOut.stride(1), cpuOut.stride(2), width,
+                    height, pattern) && ok;
+            }
+        }) / repetitions;
+        if (!ok) {
+            printf("    %-21s %8.1f %8s\n", CfaPatternName(pattern), double(width) * height / halideTime / 1e6, "FAILED");
+            continue;
+        }
+        bool same = std::equal(cpuOut.data(), cpuOut.data() + cpuOut.number_of_elements(), phaseOut.data());
+        printf("    %-21s %8.1f %8.1f%s\n", CfaPatternName(pattern), double(width) * height / halideTime / 1e6,
+            double(width) * height / cpuTime / 1e6, same ? "" : "  OUTPUT DIFFERS");
+    }
+}
 
-        // Realize the algorithm into the output buffer
-        median.realize(output);
+// Median throughput per kernel size: the Halide sorting networks where they
+// apply and the histogram filter everywhere, on single-channel and Bayer-phase
+// data. Every result is checked against the histogram filter.
+void compareMedianFilters(const std::string& filename, int repetitions = 5) {
+    std::vector<uint16_t> bufImg;
+    uint32_t width = 2048, height = 1536;
+    if (filename.empty()) {
+        bufImg.resize(size_t(width) * height);
+        uint32_t state = 12345;
+        for (uint16_t& value : bufImg) {
+            state = state * 1664525u + 1013904223u;
+            value = uint16_t(state >> 20);
+        }
+    }
+    else {
+        TiffSrcFile inputImage;
+        if (inputImage.OpenFile(filename.c_str()) != 0 || inputImage.ReadMonochromeStrips(bufImg) != 0) {
+            fprintf(stderr, "Failed to read TIFF file: %s\n", filename.c_str());
+            return;
+        }
+        width = inputImage.getWidth();
+        height = inputImage.getHeight();
+    }
+    double megaPixels = double(width) * height / 1e6;
+    Buffer<uint16_t> input(bufImg.data(), width, height);
+    Buffer<uint16_t> networkOut(width, height);
+    std::vector<uint16_t> histOut(bufImg.size());
+
+    printf("Median %u x %u, MP/s:\n", width, height);
+    printf("  %-7s %-6s %10s %10s\n", "layout", "kernel", "network", "histogram");
+    for (bool bayer : { false, true }) {
+        for (int kernelSize : { 3, 5, 7, 9, 15, 31 }) {
+            int radius = kernelSize / 2;
+            double histTime = TimeSeconds([&]() {
+                for (int i = 0; i < repetitions; i++) {
+                    if (bayer) {
+                        MedianFilterBayerHistogram(bufImg.data(), width, histOut.data(), width, width, height, radius);
+                    }
+                    else {
+                        MedianFilterHistogram(bufImg.data(), width, histOut.data(), width, width, height, radius);
+                    }
+                }
+            }) / repetitions;
+
+            // Networks beyond 7x7 take too long to compile to be worth it.
+            char network[32] = "-";
+            if (kernelSize <= 7) {
+                CachedPipeline& median = cachedMedian(kernelSize, bayer);
+                median.input.set(input);
+                median.pipeline.realize(networkOut, median.target);
+                double networkTime = TimeSeconds([&]() {
+                    for (int i = 0; i < repetitions; i++) {
+                        median.pipeline.realize(networkOut, median.target);
+                    }
+                }) / repetitions;
+                bool same = std::equal(histOut.begin(), histOut.end(), networkOut.data());
+                snprintf(network, sizeof(network), "%.1f%s", megaPixels / networkTime, same ? "" : " (differs)");
+            }
+            printf("  %-7s %2dx%-3d %10s %10.1f\n", bayer ? "bayer" : "mono", kernelSize, kernelSize, network,
+                megaPixels / histTime);
+        }
+    }
+}
 
-        // Save the output
-        Tools::save_image(output, "bay_clean2.png");
+// Demosaic the same frame repeatedly through the pipeline cache. Only the
+// first frame pays for JIT compilation.
+void benchmarkPipelineCache(const std::string& filename, int frames = 20) {
+    TiffSrcFile inputImage;
+    std::vector<uint16_t> bufImg;
+    if (inputImage.OpenFile(filename.c_str()) != 0 || inputImage.ReadMonochromeStrips(bufImg) != 0) {
+        fprintf(stderr, "Failed to read TIFF file: %s\n", filename.c_str());
+        return;
     }
-    catch (const Halide::CompileError& e) {
-        std::cerr << "Halide Compile Error: " << e.what() << std::endl;
+    Buffer<uint16_t> input(bufImg.data(), inputImage.getWidth(), inputImage.getHeight());
+    Buffer<uint16_t> output(input.width(), input.height(), 3);
+    CfaPattern pattern = CfaPattern::RGGB;
+    inputImage.GetCfaPattern(pattern);
+    inputImage.CloseFile();
+
+    double firstFrame = 0.0, laterFrames = 0.0;
+    for (int frame = 0; frame < frames; frame++) {
+        double frameTime = TimeSeconds([&]() {
+            CachedPipeline& demosaic = cachedBayerDemosaic(pattern);
+            demosaic.input.set(input);
+            demosaic.pipeline.realize(output, demosaic.target);
+        });
+        (frame == 0 ? firstFrame : laterFrames) += frameTime;
     }
-    catch (const std::exception& e) {
-        std::cerr << "Standard Exception: " << e.what() << std::endl;
+
+    printf("Bayer demosaic through the pipeline cache, %d frames:\n", frames);
+    printf("  first frame:  %8.2f ms\n", firstFrame * 1e3);
+    if (frames > 1) {
+        printf("  later frames: %8.2f ms mean\n", laterFrames * 1e3 / (frames - 1));
     }
-    catch (...) {
-        std::cerr << "Unknown Exception occurred." << std::endl;
+    GetPipelineCache().PrintStats(std::cout);
+}
+
+// Demosaic a sequence of frames with reading, demosaicing and writing
+// overlapped. Outputs go to outputDir as planar PGMs; empty skips writing.
+// Every frame of a sequence is taken to share one CFA pattern.
+void streamDemosaic(const std::string& dirOrList, const std::string& outputDir, unsigned queueDepth,
+                    CfaPattern pattern) {
+    std::vector<std::string> inputs = ListStreamFrames(dirOrList);
+    if (inputs.empty()) {
+        fprintf(stderr, "No frames found in %s\n", dirOrList.c_str());
+        return;
     }
+
+    FrameProcessor demosaic = [pattern](StreamFrame& frame) {
+        if (!frame.output || frame.output->width() != frame.width || frame.output->height() != 3 * frame.height) {
+            frame.output.reset(new PGMImage(frame.width, 3 * frame.height));
+        }
+        Buffer<uint16_t> input = TocMatrixBuffer(frame.raw);
+        Buffer<uint16_t> output(frame.output->data(), frame.width, frame.height, 3);
+#ifdef SPEEDTESTS_AOT
+        return AotBayerDemosaic(input.raw_buffer(), output.raw_buffer(), pattern) == 0;
+#else
+        try {
+            CachedPipeline& pipeline = cachedBayerDemosaic(pattern);
+            pipeline.input.set(input);
+            pipeline.pipeline.realize(output, pipeline.target);
+            return true;
+        }
+        catch (const Halide::Error& e) {
+            fprintf(stderr, "Halide error: %s\n", e.what());
+            return false;
+        }
+#endif
+    };
+
+    StreamOptions options;
+    options.queueDepth = queueDepth;
+    options.outputDir = outputDir;
+    RunFrameStream(inputs, demosaic, options).Print(std::cout);
 }
 
 //bayer Demosaic 
@@ -352,8 +1064,8 @@ void BayerDemosaicHalide(const std::string& inputFilename, const std::string& ou
         }
         printf("Opened TIFF file: %s\n", myFilename.c_str());
 
-        std::unique_ptr<uint16_t> bufImg;
-        if (inputImage.ReadMonochrome(bufImg) != 0) {
+        std::vector<uint16_t> bufImg;
+        if (inputImage.ReadMonochromeStrips(bufImg) != 0) {
             fprintf(stderr, "Failed to read image data\n");
             inputImage.CloseFile();
             return;
@@ -361,11 +1073,16 @@ void BayerDemosaicHalide(const std::string& inputFilename, const std::string& ou
         printf("Read image data successfully\n");
 
         // Assuming TiffSrcFile has methods to get width and height
-        uint16_t width = inputImage.getWidth();
-        uint16_t height = inputImage.getHeight();
-        printf("Width: %u, Height: %u\n", width, height);
+        int width = inputImage.getWidth();
+        int height = inputImage.getHeight();
+        printf("Width: %d, Height: %d\n", width, height);
+
+        // Bayer layout from the CFAPattern tag, RGGB when there is none
+        CfaPattern pattern = CfaPattern::RGGB;
+        inputImage.GetCfaPattern(pattern);
+        printf("CFA pattern: %s\n", CfaPatternName(pattern));
 
-        uint16_t* raw_data = bufImg.get();
+        uint16_t* raw_data = bufImg.data();
         if (!raw_data) {
             std::cerr << "Failed to read image data" << std::endl;
             return;
@@ -382,42 +1099,19 @@ void BayerDemosaicHalide(const std::string& inputFilename, const std::string& ou
         Halide::Buffer<uint16_t> input(raw_data, width, height);
         std::cout << "Halide buffer created successfully" << std::endl;
 
-        // Define the Halide variables
-        Halide::Var x("x"), y("y"), c("c");
-
-        // Define the Halide function
-        Halide::Func demosaic("demosaic");
-
-        // Define the Bayer pattern
-        Halide::Expr R = input(x, y);
-        Halide::Expr G = input(x, y);
-        Halide::Expr B = input(x, y);
-
-        // Apply the Bayer pattern
-        R = Halide::select((x % 2 == 0) && (y % 2 == 0), input(x, y),
-            (x % 2 == 1) && (y % 2 == 0), (input(x - 1, y) + input(x + 1, y)) / 2,
-            (x % 2 == 0) && (y % 2 == 1), (input(x, y - 1) + input(x, y + 1)) / 2,
-            (input(x - 1, y - 1) + input(x + 1, y - 1) + input(x - 1, y + 1) + input(x + 1, y + 1)) / 4);
-
-        G = Halide::select((x % 2 == 1) && (y % 2 == 1), input(x, y),
-            (x % 2 == 0) && (y % 2 == 1), (input(x - 1, y) + input(x + 1, y)) / 2,
-            (x % 2 == 1) && (y % 2 == 0), (input(x, y - 1) + input(x, y + 1)) / 2,
-            (input(x - 1, y - 1) + input(x + 1, y - 1) + input(x - 1, y + 1) + input(x + 1, y + 1)) / 4);
-
-        B = Halide::select((x % 2 == 1) && (y % 2 == 1), input(x, y),
-            (x % 2 == 0) && (y % 2 == 1), (input(x - 1, y) + input(x + 1, y)) / 2,
-            (x % 2 == 1) && (y % 2 == 0), (input(x, y - 1) + input(x, y + 1)) / 2,
-            (input(x - 1, y - 1) + input(x + 1, y - 1) + input(x - 1, y + 1) + input(x + 1, y + 1)) / 4);
-
-        // Combine the channels
-        demosaic(x, y, c) = Halide::select(c == 0, R,
-            c == 1, G,
-            B);
+        Halide::Buffer<uint16_t> output(width, height, 3);
+#ifdef SPEEDTESTS_AOT
+        checkAot(AotBayerDemosaic(input.raw_buffer(), output.raw_buffer(), pattern), "AotBayerDemosaic");
+#else
+        // Per-phase demosaic, compiled on first use
+        CachedPipeline& demosaic = cachedBayerDemosaic(pattern);
 
         std::cout << "Halide function defined" << std::endl;
 
         // Realize the function
-        Halide::Buffer<uint16_t> output = demosaic.realize({ width, height, 3 });
+        demosaic.input.set(input);
+        demosaic.pipeline.realize(output, demosaic.target);
+#endif
 
         std::cout << "Halide function realized" << std::endl;
 
@@ -425,7 +1119,7 @@ void BayerDemosaicHalide(const std::string& inputFilename, const std::string& ou
         PGMImage outputImage(width, height);
 
         // Copy the Halide buffer data to the PGMImage data
-        std::memcpy(outputImage.data(), output.data(), width * height * sizeof(uint16_t));
+        std::memcpy(outputImage.data(), output.data(), outputImage.size() * sizeof(uint16_t));
 
         // Save the output image
         if (outputImage.Write(outputFilename)) {
@@ -446,19 +1140,1951 @@ void BayerDemosaicHalide(const std::string& inputFilename, const std::string& ou
     }
 }
 
-int main() 
-{
-    printf("Starting main\n");
-    //TiffSrcFile inputImage;
-    //inputImage.ReadMonochrome();
-    //double medianFilterTime = timeFunction(medianFilter, "bay_dust.jpg", 3, 80); 
-    //loadTiff("LowerLeftQuadrant.tiff");
-    BayerDemosaicHalide("C:\\ws\\speedtests\\UPQ.tiff", "C:\\ws\\speedtest\\Finished.tiff");
-    //double halideDemosaicTime = timeFunction(BayerDemosaicHalide, "LowerLeftQuadrant.tiff", "test1.png"); //demosaic_image
-    //double bayerMosaicTime = timeFunction(demosaicImage, "LowerLeftQuadrant.tiff", "test.tiff");
-    //std::cout << "Halide execution time: " << halideDemosaicTime << " seconds" << std::endl;
-    //std::cout << "Halide execution time: " << bayerMosaicTime << " seconds" << std::endl;
-
-    //processImage("bay_dust.jpg", 3, .01);
-    return 0;
+// Options shared by the benchmark cases.
+struct BenchInput {
+    std::string filename;       ///< TIFF, PGM or (8-bit kernels) any image Halide::Tools loads; empty for synthetic
+    int width = 4096;           ///< synthetic input size
+    int height = 3072;
+    int radius = 3;
+    int kernelSize = 3;
+    float varianceThreshold = 80.0f;
+    int factor = 50;
+    CfaPattern cfa = CfaPattern::RGGB;  ///< demosaic layout: --cfa, else the input's CFAPattern tag
+    int estimateWidth = 0;      ///< size the autoschedulers tune for; 0 for the input's own
+    int estimateHeight = 0;
+    int batch = 0;              ///< frames per realize of a batched pipeline; 0 for the single-frame kernels
+    bool distinctFrames = false;    ///< batched frames differ (frameVariant()) rather than copy the input
+    std::string scheduleDir;    ///< where autoscheduled cases save their schedules; empty skips it
+    unsigned threads = 0;       ///< worker threads for the hand-written kernels; 0 for all cores
+    std::string storeName;      ///< where the store phase writes; empty skips it
+    TiffWriteOptions tiff;      ///< how the store phase writes a .tif
+};
+
+static bool hasExtension(const std::string& name, const char* ext) {
+    size_t len = strlen(ext);
+    return name.size() >= len && name.compare(name.size() - len, len, ext) == 0;
+}
+
+// Read a 16-bit mosaic from a TIFF or PGM file, or fill a synthetic one. The
+// rows are aligned, and reloading the same size keeps the same block.
+static bool loadMosaic(const BenchInput& in, CTocMatrix<uint16_t>& raw, int& width, int& height) {
+    if (in.filename.empty()) {
+        width = in.width;
+        height = in.height;
+        if (raw.Alloc(width, height) != kNoError) {
+            return false;
+        }
+        uint32_t state = 12345;
+        for (int y = 0; y < height; y++) {
+            uint16_t* row = raw.GetRowPtr(y);
+            for (int x = 0; x < width; x++) {
+                state = state * 1664525u + 1013904223u;
+                row[x] = uint16_t(state >> 16);
+            }
+        }
+        return true;
+    }
+    if (hasExtension(in.filename, ".pgm")) {
+        PGMImage image(in.filename);
+        if (image.data() == nullptr) {
+            return false;
+        }
+        width = image.width();
+        height = image.height();
+        if (raw.Alloc(width, height) != kNoError) {
+            return false;
+        }
+        for (int y = 0; y < height; y++) {
+            std::copy_n(image.data() + size_t(y) * width, width, raw.GetRowPtr(y));
+        }
+        return true;
+    }
+    TiffSrcFile tiff;
+    bool ok = tiff.OpenFile(in.filename.c_str()) == kNoError && tiff.ReadMonochromeStrips(raw) == kNoError;
+    width = tiff.getWidth();
+    height = tiff.getHeight();
+    tiff.CloseFile();
+    return ok;
+}
+
+// Write a 16-bit output as TIFF (.tif or .tiff) or PGM; PGM stacks the planes of a
+// 3-channel output vertically.
+static void storeMosaic(const Buffer<uint16_t>& output, const std::string& filename, const TiffWriteOptions& tiff) {
+    if (hasExtension(filename, ".tif") || hasExtension(filename, ".tiff")) {
+        if (TiffWriteImage(filename.c_str(), tiffView(output), tiff) != kNoError) {
+            fprintf(stderr, "Failed to write %s\n", filename.c_str());
+        }
+        return;
+    }
+    PGMImage image(output.width(), output.height() * output.channels());
+    for (int c = 0; c < output.channels(); c++) {
+        for (int y = 0; y < output.height(); y++) {
+            const uint16_t* row = &output(output.dim(0).min(), output.dim(1).min() + y, c);
+            memcpy(image.data() + (size_t(c) * output.height() + y) * output.width(), row, output.width() * sizeof(uint16_t));
+        }
+    }
+    image.Write(filename);
+}
+
+// Band processor for a 16-bit kernel run out of core, with the halo rows it
+// reads around each output row and the planes it writes.
+static bool makeTiledKernel(const std::string& kernel, const BenchInput& in, BandProcessor& process,
+                            TiledOptions& options) {
+    CachedPipeline* pipeline = nullptr;
+    int kernelSize = in.kernelSize;
+    if (kernel == "bayer_demosaic" || kernel == "bayer_demosaic_mhc") {
+        pipeline = (kernel == "bayer_demosaic_mhc") ? &cachedBayerDemosaicMHC(in.cfa) : &cachedBayerDemosaic(in.cfa);
+        options.halo = 2;
+        options.channels = 3;
+    }
+    else if (kernel == "box_average") {
+        pipeline = &cachedBoxAverage(in.radius);
+        options.halo = uint32_t(std::max(0, in.radius));
+        options.channels = 1;
+    }
+    else if ((kernel == "median" || kernel == "bayer_median") && kernelSize % 2 == 1) {
+        bool bayer = (kernel == "bayer_median");
+        pipeline = &cachedMedian(kernelSize, bayer);
+        options.halo = uint32_t(bayer ? 2 * (kernelSize / 2) : kernelSize / 2);
+        options.channels = 1;
+    }
+    else {
+        return false;
+    }
+
+    int radius = in.radius;
+    process = [pipeline, radius](TiledBand& band) {
+        Buffer<uint16_t> input = TocMatrixBuffer(band.input);
+        Buffer<uint16_t> output = TocMatrixBuffer(band.output);
+        output.set_min(0, int(band.y0 - band.inY0));
+        try {
+            pipeline->input.set(input);
+            if (!pipeline->params.empty()) {
+                pipeline->params[0].set(radius);
+            }
+            pipeline->pipeline.realize(output, pipeline->target);
+            return true;
+        }
+        catch (const Halide::Error& e) {
+            fprintf(stderr, "Halide error: %s\n", e.what());
+            return false;
+        }
+    };
+    return true;
+}
+
+// Run a kernel over a TIFF band by band within a memory budget.
+void tiledProcess(const BenchInput& in, const std::string& kernel, const std::string& outName, size_t memoryBudget,
+                  unsigned queueDepth) {
+    TiledOptions options;
+    options.memoryBudget = memoryBudget;
+    options.queueDepth = queueDepth;
+    options.tiff = in.tiff;
+    BandProcessor process;
+    if (!makeTiledKernel(kernel, in, process, options)) {
+        fprintf(stderr, "Cannot run %s band by band\n", kernel.c_str());
+        return;
+    }
+    RunTiledProcess(in.filename, outName, process, options).Print(std::cout);
+}
+
+// Every sample of a 16-bit planar TIFF, plane by plane, whether it has strips or tiles.
+static bool readTiffPlanes(const std::string& filename, std::vector<uint16_t>& samples, uint32_t& width,
+                           uint32_t& height, uint16_t& planes) {
+    TIFF* tiff = TIFFOpen(filename.c_str(), "r");
+    if (tiff == nullptr) {
+        return false;
+    }
+    uint16_t bits = 0, config = PLANARCONFIG_CONTIG;
+    planes = 1;
+    TIFFGetField(tiff, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(tiff, TIFFTAG_IMAGELENGTH, &height);
+    TIFFGetField(tiff, TIFFTAG_BITSPERSAMPLE, &bits);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_SAMPLESPERPIXEL, &planes);
+    TIFFGetFieldDefaulted(tiff, TIFFTAG_PLANARCONFIG, &config);
+    bool ok = bits == 16 && (planes == 1 || config == PLANARCONFIG_SEPARATE);
+    samples.assign(size_t(width) * height * planes, 0);
+
+    if (ok && TIFFIsTiled(tiff)) {
+        uint32_t tileWidth = 0, tileHeight = 0;
+        TIFFGetField(tiff, TIFFTAG_TILEWIDTH, &tileWidth);
+        TIFFGetField(tiff, TIFFTAG_TILELENGTH, &tileHeight);
+        std::vector<uint16_t> tile(size_t(tileWidth) * tileHeight);
+        for (uint16_t s = 0; ok && s < planes; s++) {
+            for (uint32_t ty = 0; ok && ty < height; ty += tileHeight) {
+                for (uint32_t tx = 0; ok && tx < width; tx += tileWidth) {
+                    ok = TIFFReadTile(tiff, tile.data(), tx, ty, 0, s) >= 0;
+                    for (uint32_t y = ty; ok && y < std::min(height, ty + tileHeight); y++) {
+                        std::copy_n(&tile[size_t(y - ty) * tileWidth], std::min(tileWidth, width - tx),
+                                    &samples[(size_t(s) * height + y) * width + tx]);
+                    }
+                }
+            }
+        }
+    }
+    else {
+        for (uint16_t s = 0; ok && s < planes; s++) {
+            for (uint32_t y = 0; ok && y < height; y++) {
+                ok = TIFFReadScanline(tiff, &samples[(size_t(s) * height + y) * width], y, s) >= 0;
+            }
+        }
+    }
+    TIFFClose(tiff);
+    return ok;
+}
+
+// Run a kernel over a TIFF in memory and band by band within the budget, and
+// check the two outputs hold the same pixels.
+void compareTiled(const BenchInput& in, const std::string& kernel, size_t memoryBudget, unsigned queueDepth) {
+    if (!hasExtension(in.filename, ".tif") && !hasExtension(in.filename, ".tiff")) {
+        fprintf(stderr, "--compare tiled needs a TIFF --input\n");
+        return;
+    }
+    TiledOptions options;
+    options.memoryBudget = memoryBudget;
+    options.queueDepth = queueDepth;
+    options.tiff = in.tiff;
+    BandProcessor process;
+    if (!makeTiledKernel(kernel, in, process, options)) {
+        fprintf(stderr, "Cannot run %s band by band\n", kernel.c_str());
+        return;
+    }
+    std::filesystem::path tmp = std::filesystem::temp_directory_path();
+    std::string wholeName = (tmp / "speedtests_whole.tif").string();
+    std::string tiledName = (tmp / "speedtests_tiled.tif").string();
+
+    // In memory: the whole mosaic and its output at once, as one band.
+    TiledBand whole;
+    int width = 0, height = 0;
+    bool ok = true;
+    double wholeTime = TimeSeconds([&]() {
+        ok = loadMosaic(in, whole.input, width, height) &&
+             whole.output.Alloc(uint32_t(width), uint32_t(height), options.channels, kTocPlanar) == kNoError;
+        if (!ok) {
+            return;
+        }
+        whole.width = uint32_t(width);
+        whole.rows = whole.inRows = uint32_t(height);
+        Buffer<uint16_t> output = TocMatrixBuffer(whole.output);
+        ok = process(whole) && TiffWriteImage(wholeName.c_str(), tiffView(output), options.tiff) == kNoError;
+    });
+    if (!ok) {
+        fprintf(stderr, "Failed to run %s on %s in memory\n", kernel.c_str(), in.filename.c_str());
+        return;
+    }
+    size_t wholeBytes = whole.input.GetStrideBytes() * whole.input.getHeight() * (1 + options.channels);
+    whole.input.Free();
+    whole.output.Free();
+
+    TiledReport report = RunTiledProcess(in.filename, tiledName, process, options);
+    double pixels = double(width) * height;
+    printf("%s on %d x %d\n", kernel.c_str(), width, height);
+    printf("  in memory   %8.2f s  %7.1f MP/s  %8.1f MB\n", wholeTime, pixels / wholeTime / 1e6, wholeBytes / 1e6);
+    if (report.ok) {
+        size_t tiledBytes = report.plan.readerBytes + report.plan.writerBytes +
+                            std::max<size_t>(1, queueDepth) * report.plan.bandBytes;
+        printf("  band by band %7.2f s  %7.1f MP/s  %8.1f MB\n", report.wallSeconds, pixels / report.wallSeconds / 1e6,
+               tiledBytes / 1e6);
+    }
+    report.Print(std::cout);
+
+    std::vector<uint16_t> wholePixels, tiledPixels;
+    uint32_t w0 = 0, h0 = 0, w1 = 0, h1 = 0;
+    uint16_t p0 = 0, p1 = 0;
+    if (report.ok && readTiffPlanes(wholeName, wholePixels, w0, h0, p0) &&
+        readTiffPlanes(tiledName, tiledPixels, w1, h1, p1)) {
+        bool same = w0 == w1 && h0 == h1 && p0 == p1 && wholePixels == tiledPixels;
+        printf("  outputs %s\n", same ? "identical" : "DIFFER");
+    }
+    std::filesystem::remove(wholeName);
+    std::filesystem::remove(tiledName);
+}
+
+// The schedule an impl names: jit is the hand schedule, and an autoscheduler's
+// name (adams2019, li2018, mullapudi2016) the same JIT pipeline scheduled by it
+// for --estimate, or else for the input's own size.
+static PipelineSchedule benchSchedule(const std::string& impl, const BenchInput& in, int width, int height) {
+    PipelineSchedule schedule;
+    if (impl != "jit" && ParseSchedule(impl, schedule) && !schedule.IsManual()) {
+        schedule.estimateWidth = in.estimateWidth > 0 ? in.estimateWidth : width;
+        schedule.estimateHeight = in.estimateHeight > 0 ? in.estimateHeight : height;
+    }
+    return schedule;
+}
+
+// Save the schedule an autoscheduler chose as DIR/<kernel>.<schedule>.schedule.h.
+static void saveSchedule(const CachedPipeline& pipeline, const std::string& kernel, const std::string& dir) {
+    if (dir.empty() || pipeline.scheduleSource.empty()) {
+        return;
+    }
+    std::error_code error;
+    std::filesystem::create_directories(dir, error);
+    std::filesystem::path name = std::filesystem::path(dir) / (kernel + "." + pipeline.schedule.Name() + ".schedule.h");
+    std::ofstream out(name);
+    out << "// " << kernel << ", " << pipeline.schedule.autoscheduler << " for " << pipeline.schedule.estimateWidth << "x"
+        << pipeline.schedule.estimateHeight << " on " << pipeline.target.to_string() << "\n"
+        << pipeline.scheduleSource;
+    if (!out) {
+        fprintf(stderr, "Failed to write %s\n", name.string().c_str());
+    }
+}
+
+// A Buffer's elements from its min corner, as a BenchImage.
+template <typename T>
+static BenchImage benchImage(const Buffer<T>& buffer) {
+    BenchImage image;
+    image.width = buffer.width();
+    image.height = buffer.height();
+    image.channels = buffer.dimensions() > 2 ? buffer.channels() : 1;
+    image.values.reserve(size_t(image.width) * image.height * image.channels);
+    for (int c = 0; c < image.channels; c++) {
+        for (int y = 0; y < image.height; y++) {
+            for (int x = 0; x < image.width; x++) {
+                int at[3] = { buffer.dim(0).min() + x, buffer.dim(1).min() + y, c };
+                image.values.push_back(double(buffer(at)));
+            }
+        }
+    }
+    return image;
+}
+
+static const char* kBenchKernels[] = { "box_average", "box_average_integral", "box_demosaic", "bayer_demosaic", "bayer_demosaic_mhc",
+                                       "bayer_demosaic_select", "median", "bayer_median", "local_statistics", "median_gate",
+                                       "brighten" };
+
+// Set up a kernel's batched pipeline on in.batch copies of the input, as one
+// realize. Only the JIT pipelines, hand or autoscheduled, have a batched form.
+// Frame f of a batch with distinctFrames: every sample shifted by an amount of
+// its own, wrapping, so no two frames of a --verify batch are alike.
+template <typename T>
+static void frameVariant(Buffer<T> frame, int f) {
+    int shift = f * (sizeof(T) == 1 ? 37 : 4099);
+    frame.for_each_value([shift](T& value) { value = T(value + shift); });
+}
+
+static bool makeBatchedCase(const std::string& kernel, const std::string& impl, const BenchInput& in, BenchCase& bench) {
+    PipelineSchedule parsed;
+    bool autoscheduled = impl != "jit" && ParseSchedule(impl, parsed) && !parsed.IsManual();
+    bool brighten = (kernel == "brighten");
+    bool medianKernel = (kernel == "median" || kernel == "bayer_median");
+    if (!isBatchedKernel(kernel) || (impl != "jit" && !autoscheduled) || (medianKernel && in.kernelSize % 2 == 0)) {
+        return false;
+    }
+    bench.kernel = kernel;
+    bench.impl = impl;
+    bench.frames = in.batch;
+
+    struct State {
+        Buffer<> input, output;
+        CachedPipeline* pipeline = nullptr;
+    };
+    auto state = std::make_shared<State>();
+    int frames = in.batch;
+    auto load = [state, in, frames, brighten]() {
+        if (brighten) {
+            Buffer<uint8_t> frame;
+            if (in.filename.empty()) {
+                frame = Buffer<uint8_t>(in.width, in.height, 3);
+                frame.for_each_element([&](int x, int y, int c) { frame(x, y, c) = uint8_t(x * 7 + y * 13 + c * 71); });
+            }
+            else {
+                Buffer<uint8_t> loaded = Tools::load_image(in.filename);
+                frame = loaded;
+            }
+            if (frame.dimensions() != 3) {
+                return false;
+            }
+            Buffer<uint8_t> input(frame.width(), frame.height(), frame.channels(), frames);
+            for (int f = 0; f < frames; f++) {
+                input.sliced(3, f).copy_from(frame);
+                if (in.distinctFrames) {
+                    frameVariant(input.sliced(3, f), f);
+                }
+            }
+            state->input = input;
+            return true;
+        }
+        CTocMatrix<uint16_t> raw;
+        int width = 0, height = 0;
+        if (!loadMosaic(in, raw, width, height)) {
+            return false;
+        }
+        Buffer<uint16_t> frame = TocMatrixBuffer(raw);
+        Buffer<uint16_t> input(width, height, frames);
+        for (int f = 0; f < frames; f++) {
+            input.sliced(2, f).copy_from(frame);
+            if (in.distinctFrames) {
+                frameVariant(input.sliced(2, f), f);
+            }
+        }
+        state->input = input;
+        return true;
+    };
+    if (!load()) {
+        return false;
+    }
+    int width = state->input.dim(0).extent(), height = state->input.dim(1).extent();
+    int channels = 1;
+    if (brighten) {
+        channels = state->input.dim(2).extent();
+        state->output = Buffer<uint8_t>(width, height, channels, frames);
+        bench.bytes = uint64_t(width) * height * channels * 2 * frames;
+    }
+    else {
+        channels = (kernel == "bayer_demosaic" || kernel == "bayer_demosaic_mhc") ? 3 : 1;
+        state->output = (channels == 3) ? Buffer<uint16_t>(width, height, 3, frames) : Buffer<uint16_t>(width, height, frames);
+        bench.bytes = uint64_t(width) * height * sizeof(uint16_t) * (1 + channels) * frames;
+    }
+    bench.width = width;
+    bench.height = height;
+    bench.phases.frame = [state, brighten](int f) {
+        int frame = state->output.dimensions() - 1;
+        return brighten ? benchImage(state->output.as<uint8_t>().sliced(frame, f))
+                        : benchImage(state->output.as<uint16_t>().sliced(frame, f));
+    };
+    // The last frame, which is the one an indexing mistake would miss.
+    bench.phases.output = [frame = bench.phases.frame, frames]() { return frame(frames - 1); };
+    if (!in.filename.empty()) {
+        bench.phases.load = [load]() { load(); };
+    }
+
+    int kernelSize = in.kernelSize;
+    CfaPattern cfa = in.cfa;
+    int factor = in.factor;
+    PipelineSchedule schedule = benchSchedule(impl, in, width, height);
+    if (!schedule.IsManual()) {
+        schedule.estimateFrames = frames;
+    }
+    std::string scheduleDir = in.scheduleDir;
+    bench.phases.compile = [state, kernel, kernelSize, cfa, schedule, scheduleDir]() {
+        state->pipeline = &cachedBatched(kernel, kernelSize, cfa, schedule);
+        saveSchedule(*state->pipeline, kernel + "_batch", scheduleDir);
+    };
+    profileCachedPipeline(bench);
+    bench.phases.execute = [state, factor]() {
+        state->pipeline->input.set(state->input);
+        if (!state->pipeline->params.empty()) {
+            state->pipeline->params[0].set(factor);
+        }
+        state->pipeline->pipeline.realize(state->output, state->pipeline->target);
+    };
+    return true;
+}
+
+// Set up one kernel/implementation pair. Returns false for unknown pairs or unreadable input.
+static bool makeBenchCase(const std::string& kernel, const std::string& impl, const BenchInput& in, BenchCase& bench) {
+    if (in.batch > 0) {
+        return makeBatchedCase(kernel, impl, in, bench);
+    }
+    bool aot = (impl == "aot");
+#ifndef SPEEDTESTS_AOT
+    if (aot) {
+        return false;
+    }
+#endif
+    // The histogram median and the hand-written demosaic (cpu: AVX2 where
+    // available, scalar: forced fallback) are plain C++ with no JIT or AOT form.
+    bool hist = (impl == "hist");
+    bool medianKernel = (kernel == "median" || kernel == "bayer_median");
+    bool handWritten = (impl == "cpu" || impl == "scalar");
+    PipelineSchedule parsed;
+    bool autoscheduled = impl != "jit" && ParseSchedule(impl, parsed) && !parsed.IsManual();
+    if ((!aot && !hist && !handWritten && !autoscheduled && impl != "jit") || (hist && !medianKernel) ||
+        (handWritten && kernel != "bayer_demosaic")) {
+        return false;
+    }
+    bench.kernel = kernel;
+    bench.impl = impl;
+
+    // 16-bit single-channel kernels
+    if (kernel == "box_average" || kernel == "box_average_integral" || kernel == "box_demosaic" ||
+        kernel == "bayer_demosaic" || kernel == "bayer_demosaic_mhc" || kernel == "bayer_demosaic_select" || medianKernel) {
+        struct State {
+            CTocMatrix<uint16_t> raw, out;
+            Buffer<uint16_t> input, output;
+            CachedPipeline* pipeline = nullptr;
+            Func select;
+        };
+        auto state = std::make_shared<State>();
+        int width = 0, height = 0;
+        if (!loadMosaic(in, state->raw, width, height)) {
+            return false;
+        }
+        int channels = (kernel == "box_average" || kernel == "box_average_integral" || kernel == "box_demosaic" || medianKernel) ? 1 : 3;
+        if (state->out.Alloc(width, height, uint16_t(channels), kTocPlanar) != kNoError) {
+            return false;
+        }
+        state->input = TocMatrixBuffer(state->raw);
+        state->output = TocMatrixBuffer(state->out);
+        bench.width = width;
+        bench.height = height;
+        bench.bytes = uint64_t(width) * height * sizeof(uint16_t) * (1 + channels);
+        bench.phases.output = [state]() { return benchImage(state->output); };
+
+        if (!in.filename.empty()) {
+            bench.phases.load = [state, in]() {
+                int width, height;
+                loadMosaic(in, state->raw, width, height);
+            };
+        }
+        if (!in.storeName.empty()) {
+            std::string storeName = in.storeName;
+            TiffWriteOptions tiff = in.tiff;
+            bench.phases.store = [state, storeName, tiff]() { storeMosaic(state->output, storeName, tiff); };
+        }
+
+        if (kernel == "bayer_demosaic_select") {
+            // No boundary condition, so only the interior is computed.
+            if (aot || autoscheduled) {
+                return false;
+            }
+            state->output = Buffer<uint16_t>(width - 2, height - 2, 3);
+            state->output.set_min(1, 1, 0);
+            CfaPattern cfa = in.cfa;
+            bench.phases.compile = [state, cfa]() {
+                state->select = DefineBayerDemosaicSelect(Func(state->input), cfa);
+                state->select.compile_jit(get_host_target());
+            };
+            bench.phases.execute = [state]() { state->select.realize(state->output); };
+            return true;
+        }
+
+        if (handWritten) {
+            CpuKernel cpu = (impl == "scalar") ? CpuKernel::Scalar : CpuKernel::Auto;
+            CfaPattern cfa = in.cfa;
+            unsigned threads = in.threads;
+            bench.phases.execute = [state, width, height, cfa, threads, cpu]() {
+                // Raised as a Halide error so every caller reports it the same way.
+                if (!BayerDemosaicBilinear(state->raw.data(), state->raw.GetStride(), state->out.data(), state->out.GetStride(),
+                                           state->out.GetPlaneStride(), width, height, cfa, threads, cpu)) {
+                    throw Halide::RuntimeError(std::string("BayerDemosaicBilinear (") + CpuKernelName(cpu) + ") failed");
+                }
+            };
+            return true;
+        }
+
+        bool bayer = (kernel == "bayer_median");
+        int kernelSize = in.kernelSize;
+        if (hist) {
+            unsigned threads = in.threads;
+            bench.phases.execute = [state, width, height, kernelSize, bayer, threads]() {
+                const uint16_t* src = state->raw.data();
+                uint16_t* dst = state->out.data();
+                ptrdiff_t srcStride = state->raw.GetStride(), dstStride = state->out.GetStride();
+                if (bayer) {
+                    MedianFilterBayerHistogram(src, srcStride, dst, dstStride, width, height, kernelSize / 2, 0, threads);
+                }
+                else {
+                    MedianFilterHistogram(src, srcStride, dst, dstStride, width, height, kernelSize / 2, 0, threads);
+                }
+            };
+            return kernelSize % 2 == 1 && kernelSize / 2 <= kMedianMaxRadius;
+        }
+
+        if (aot) {
+#ifdef SPEEDTESTS_AOT
+            if (medianKernel) {
+                if (kernelSize != 3 && kernelSize != 5) {
+                    return false;
+                }
+                bench.phases.execute = [state, kernelSize, bayer]() {
+                    checkAot(AotMedian(state->input.raw_buffer(), kernelSize, bayer, state->output.raw_buffer()), "AotMedian");
+                };
+                return true;
+            }
+            if (kernel == "box_average" && in.radius != kAotBoxRadius) {
+                return false;
+            }
+            if (kernel == "box_average_integral") {
+                int radius = in.radius;
+                bench.phases.execute = [state, radius]() {
+                    checkAot(AotBoxAverageIntegral(state->input.raw_buffer(), radius, state->output.raw_buffer()),
+                             "AotBoxAverageIntegral");
+                };
+                return true;
+            }
+            if (kernel == "bayer_demosaic" || kernel == "bayer_demosaic_mhc") {
+                bool mhc = (kernel == "bayer_demosaic_mhc");
+                CfaPattern cfa = in.cfa;
+                bench.phases.execute = [state, mhc, cfa]() {
+                    if (mhc) {
+                        checkAot(AotBayerDemosaicMHC(state->input.raw_buffer(), state->output.raw_buffer(), cfa),
+                                 "AotBayerDemosaicMHC");
+                    }
+                    else {
+                        checkAot(AotBayerDemosaic(state->input.raw_buffer(), state->output.raw_buffer(), cfa),
+                                 "AotBayerDemosaic");
+                    }
+                };
+                return true;
+            }
+            bool box = (kernel == "box_average");
+            int (*aotKernel)(halide_buffer_t*, halide_buffer_t*) = box ? AotBoxAverage : AotBoxDemosaic;
+            const char* aotName = box ? "AotBoxAverage" : "AotBoxDemosaic";
+            bench.phases.execute = [state, aotKernel, aotName]() {
+                checkAot(aotKernel(state->input.raw_buffer(), state->output.raw_buffer()), aotName);
+            };
+#endif
+            return true;
+        }
+
+        if (medianKernel && kernelSize % 2 == 0) {
+            return false;
+        }
+        int radius = in.radius;
+        CfaPattern cfa = in.cfa;
+        PipelineSchedule schedule = benchSchedule(impl, in, width, height);
+        std::string scheduleDir = in.scheduleDir;
+        bench.phases.compile = [state, kernel, radius, kernelSize, medianKernel, bayer, cfa, schedule, scheduleDir]() {
+            state->pipeline = medianKernel ? &cachedMedian(kernelSize, bayer, schedule)
+                            : (kernel == "box_average") ? &cachedBoxAverage(radius, schedule)
+                            : (kernel == "box_average_integral") ? &cachedBoxAverageIntegral(radius, schedule)
+                            : (kernel == "box_demosaic") ? &cachedBoxDemosaic(schedule)
+                            : (kernel == "bayer_demosaic_mhc") ? &cachedBayerDemosaicMHC(cfa, schedule)
+                                                               : &cachedBayerDemosaic(cfa, schedule);
+            saveSchedule(*state->pipeline, kernel, scheduleDir);
+        };
+        profileCachedPipeline(bench);
+        bench.phases.execute = [state, radius]() {
+            state->pipeline->input.set(state->input);
+            if (!state->pipeline->params.empty()) {
+                state->pipeline->params[0].set(radius);
+            }
+            state->pipeline->pipeline.realize(state->output, state->pipeline->target);
+        };
+        return true;
+    }
+
+    // 16-bit in, float (mean, variance) maps out
+    if (kernel == "local_statistics") {
+        struct State {
+            CTocMatrix<uint16_t> raw;
+            Buffer<uint16_t> input;
+            Buffer<float> mean, variance;
+            CachedPipeline* pipeline = nullptr;
+        };
+        auto state = std::make_shared<State>();
+        int width = 0, height = 0;
+        if (!loadMosaic(in, state->raw, width, height)) {
+            return false;
+        }
+        state->input = TocMatrixBuffer(state->raw);
+        state->mean = Buffer<float>(width, height);
+        state->variance = Buffer<float>(width, height);
+        bench.width = width;
+        bench.height = height;
+        bench.bytes = uint64_t(width) * height * (sizeof(uint16_t) + 2 * sizeof(float));
+        bench.phases.output = [state]() {
+            // Mean and variance as two channels
+            BenchImage image = benchImage(state->mean);
+            BenchImage variance = benchImage(state->variance);
+            image.values.insert(image.values.end(), variance.values.begin(), variance.values.end());
+            image.channels = 2;
+            return image;
+        };
+        if (!in.filename.empty()) {
+            bench.phases.load = [state, in]() {
+                int width, height;
+                loadMosaic(in, state->raw, width, height);
+            };
+        }
+
+        int radius = in.radius;
+        if (aot) {
+#ifdef SPEEDTESTS_AOT
+            bench.phases.execute = [state, radius]() {
+                checkAot(AotLocalStatistics(state->input.raw_buffer(), radius, state->mean.raw_buffer(),
+                                            state->variance.raw_buffer()),
+                         "AotLocalStatistics");
+            };
+#endif
+            return true;
+        }
+        PipelineSchedule schedule = benchSchedule(impl, in, width, height);
+        std::string scheduleDir = in.scheduleDir;
+        bench.phases.compile = [state, schedule, scheduleDir]() {
+            state->pipeline = &cachedLocalStatistics(schedule);
+            saveSchedule(*state->pipeline, "local_statistics", scheduleDir);
+        };
+        profileCachedPipeline(bench);
+        bench.phases.execute = [state, radius]() {
+            state->pipeline->input.set(state->input);
+            state->pipeline->params[0].set(radius);
+            state->pipeline->pipeline.realize(Realization({ state->mean, state->variance }), state->pipeline->target);
+        };
+        return true;
+    }
+
+    // 8-bit 3-channel kernels
+    if (kernel == "median_gate" || kernel == "brighten") {
+        struct State {
+            Buffer<uint8_t> input, output;
+            CachedPipeline* pipeline = nullptr;
+        };
+        auto state = std::make_shared<State>();
+        auto load = [state, in]() {
+            if (in.filename.empty()) {
+                state->input = Buffer<uint8_t>(in.width, in.height, 3);
+                state->input.for_each_element([&](int x, int y, int c) { state->input(x, y, c) = uint8_t(x * 7 + y * 13 + c * 71); });
+            }
+            else {
+                Buffer<uint8_t> loaded = Tools::load_image(in.filename);
+                state->input = loaded;
+            }
+        };
+        load();
+        if (state->input.dimensions() != 3) {
+            return false;
+        }
+        state->output = Buffer<uint8_t>(state->input.width(), state->input.height(), state->input.channels());
+        bench.width = state->input.width();
+        bench.height = state->input.height();
+        bench.bytes = uint64_t(state->input.number_of_elements()) * 2;
+        bench.phases.output = [state]() { return benchImage(state->output); };
+        if (!in.filename.empty()) {
+            bench.phases.load = load;
+        }
+        if (!in.storeName.empty()) {
+            std::string storeName = in.storeName;
+            bench.phases.store = [state, storeName]() { Tools::save_image(state->output, storeName); };
+        }
+
+        bool median = (kernel == "median_gate");
+        if (aot) {
+#ifdef SPEEDTESTS_AOT
+            if (median && in.kernelSize != kAotMedianKernelSize) {
+                return false;
+            }
+            float threshold = in.varianceThreshold;
+            int factor = in.factor;
+            bench.phases.execute = [state, median, threshold, factor]() {
+                if (median) {
+                    checkAot(AotMedianGate(state->input.raw_buffer(), threshold, state->output.raw_buffer()), "AotMedianGate");
+                }
+                else {
+                    checkAot(AotBrighten(state->input.raw_buffer(), factor, state->output.raw_buffer()), "AotBrighten");
+                }
+            };
+#endif
+            return true;
+        }
+
+        int kernelSize = in.kernelSize;
+        float threshold = in.varianceThreshold;
+        int factor = in.factor;
+        PipelineSchedule schedule = benchSchedule(impl, in, bench.width, bench.height);
+        std::string scheduleDir = in.scheduleDir;
+        bench.phases.compile = [state, kernel, median, kernelSize, schedule, scheduleDir]() {
+            state->pipeline = median ? &cachedMedianGate(UInt(8), kernelSize, schedule) : &cachedBrighten(schedule);
+            saveSchedule(*state->pipeline, kernel, scheduleDir);
+        };
+        profileCachedPipeline(bench);
+        bench.phases.execute = [state, median, threshold, factor]() {
+            state->pipeline->input.set(state->input);
+            if (median) {
+                state->pipeline->params[0].set(threshold);
+            }
+            else {
+                state->pipeline->params[0].set(factor);
+            }
+            state->pipeline->pipeline.realize(state->output, state->pipeline->target);
+        };
+        return true;
+    }
+
+    return false;
+}
+
+// Time each kernel's JIT pipeline with its hand schedule and with every
+// autoscheduler, and rank the schedules per kernel on this machine.
+void compareSchedules(const BenchInput& in, const BenchOptions& options, const std::vector<std::string>& kernels) {
+    std::vector<std::string> impls = { "jit" };
+    for (const char* autoscheduler : kAutoschedulers) {
+        impls.push_back(PipelineSchedule{ autoscheduler }.Name());
+    }
+    printf("Schedules on %s, %u threads\n", get_host_target().to_string().c_str(),
+           std::max(1u, std::thread::hardware_concurrency()));
+
+    for (const std::string& kernel : kernels) {
+        std::vector<BenchResult> results;
+        for (const std::string& impl : impls) {
+            BenchCase bench;
+            try {
+                if (makeBenchCase(kernel, impl, in, bench)) {
+                    results.push_back(RunBenchCase(bench, options));
+                }
+            }
+            catch (const Halide::Error& e) {
+                fprintf(stderr, "%s (%s): Halide error: %s\n", kernel.c_str(), impl.c_str(), e.what());
+            }
+        }
+        if (results.empty()) {
+            continue;
+        }
+        std::sort(results.begin(), results.end(), [](const BenchResult& a, const BenchResult& b) {
+            return a.execute.median < b.execute.median;
+        });
+        auto manual = std::find_if(results.begin(), results.end(), [](const BenchResult& r) { return r.impl == "jit"; });
+
+        printf("%s %dx%d\n", kernel.c_str(), results.front().width, results.front().height);
+        printf("  %-4s %-14s %10s %9s %10s %9s\n", "rank", "schedule", "median ms", "MP/s", "compile s", "vs manual");
+        for (size_t i = 0; i < results.size(); i++) {
+            const BenchResult& r = results[i];
+            char speedup[16] = "-";
+            if (manual != results.end()) {
+                snprintf(speedup, sizeof(speedup), "%.2fx", manual->execute.median / r.execute.median);
+            }
+            printf("  %-4zu %-14s %10.2f %9.1f %10.2f %9s\n", i + 1, r.impl == "jit" ? "manual" : r.impl.c_str(),
+                   r.execute.median * 1e3, r.MPixPerSec(), r.compile.median, speedup);
+        }
+    }
+    GetPipelineCache().PrintStats(std::cout);
+}
+
+// Time a kernel on frames of a small crop: the single-frame pipeline realized
+// once per frame, the batched pipeline at 1, 2, 4 ... maxBatch frames per
+// realize, and for reference one full 4096 x 3072 frame. Prints the time per
+// frame and throughput of each, and the batch size that comes closest to the
+// full frame's throughput.
+void compareBatch(const BenchInput& in, const BenchOptions& options, const std::string& kernel, const std::string& impl,
+                  int maxBatch) {
+    std::vector<std::pair<std::string, BenchResult>> rows;
+    auto run = [&](const std::string& name, const BenchInput& caseInput) {
+        BenchCase bench;
+        try {
+            if (!makeBenchCase(kernel, impl, caseInput, bench)) {
+                fprintf(stderr, "%s (%s): no %s case\n", kernel.c_str(), impl.c_str(), name.c_str());
+                return;
+            }
+            rows.push_back({ name, RunBenchCase(bench, options) });
+        }
+        catch (const Halide::Error& e) {
+            fprintf(stderr, "%s (%s) %s: Halide error: %s\n", kernel.c_str(), impl.c_str(), name.c_str(), e.what());
+        }
+        catch (const std::bad_alloc&) {
+            fprintf(stderr, "%s (%s) %s: out of memory\n", kernel.c_str(), impl.c_str(), name.c_str());
+        }
+    };
+
+    BenchInput crop = in;
+    crop.batch = 0;
+    crop.storeName.clear();
+    run("unbatched", crop);
+    for (int n = 1; n <= maxBatch; n *= 2) {
+        BenchInput batched = crop;
+        batched.batch = n;
+        run("batch " + std::to_string(n), batched);
+    }
+    BenchInput full = crop;
+    full.filename.clear();
+    full.width = 4096;
+    full.height = 3072;
+    run("4096x3072", full);
+    if (rows.empty()) {
+        return;
+    }
+
+    const BenchResult* unbatched = (rows.front().first == "unbatched") ? &rows.front().second : nullptr;
+    const BenchResult* reference = (rows.back().first == "4096x3072") ? &rows.back().second : nullptr;
+    printf("%s (%s) on %dx%d frames, %u threads\n", kernel.c_str(), impl.c_str(), rows.front().second.width,
+           rows.front().second.height, std::max(1u, std::thread::hardware_concurrency()));
+    printf("  %-11s %6s %11s %9s %9s %12s %10s\n", "run", "frames", "ms/realize", "ms/frame", "MP/s", "vs unbatched",
+           "vs full");
+    const std::pair<std::string, BenchResult>* best = nullptr;
+    for (const auto& row : rows) {
+        const BenchResult& r = row.second;
+        char speedup[16] = "-", share[16] = "-";
+        if (unbatched) {
+            snprintf(speedup, sizeof(speedup), "%.2fx", r.MPixPerSec() / unbatched->MPixPerSec());
+        }
+        if (reference) {
+            snprintf(share, sizeof(share), "%.0f%%", 100.0 * r.MPixPerSec() / reference->MPixPerSec());
+        }
+        printf("  %-11s %6d %11.3f %9.3f %9.1f %12s %10s\n", row.first.c_str(), r.frames, r.execute.median * 1e3,
+               r.execute.median * 1e3 / r.frames, r.MPixPerSec(), speedup, share);
+        if (row.first.compare(0, 6, "batch ") == 0 && (!best || r.MPixPerSec() > best->second.MPixPerSec())) {
+            best = &row;
+        }
+    }
+    if (best) {
+        printf("Best: %d frames per realize, %.1f MP/s\n", best->second.frames, best->second.MPixPerSec());
+    }
+}
+
+// Run each kernel on synthetic square inputs from minSide to maxSide and print
+// ns/pixel against the working set, or return the results for CSV or JSON.
+// Small sizes get more repetitions, so every size times about as many pixels
+// as --reps runs at the default 4096 x 3072.
+std::vector<BenchResult> sizeSweep(const BenchInput& in, const BenchOptions& options, const std::vector<std::string>& kernels,
+                                   const std::string& impl, int minSide, int maxSide, bool print) {
+    const CacheLevels& caches = GetCacheLevels();
+    if (print) {
+        printf("Size sweep on %s, caches L1 %zu KB x %zu, L2 %zu KB x %zu, L3 %zu MB x %zu\n",
+               get_host_target().to_string().c_str(), caches.size[0] >> 10,
+               caches.size[0] ? caches.total[0] / caches.size[0] : 0, caches.size[1] >> 10,
+               caches.size[1] ? caches.total[1] / caches.size[1] : 0, caches.size[2] >> 20,
+               caches.size[2] ? caches.total[2] / caches.size[2] : 0);
+    }
+
+    std::vector<BenchResult> all;
+    for (const std::string& kernel : kernels) {
+        SizeSweep sweep;
+        sweep.kernel = kernel;
+        sweep.impl = impl;
+        for (int side : SweepSides(minSide, maxSide)) {
+            BenchInput sized = in;
+            sized.filename.clear();
+            sized.storeName.clear();
+            sized.width = sized.height = side;
+            BenchOptions sizedOptions = options;
+            double pixelsPerRun = double(side) * side;
+            sizedOptions.reps = int(std::clamp(options.reps * 4096.0 * 3072.0 / pixelsPerRun, 3.0, 1000.0));
+            BenchCase bench;
+            try {
+                if (!makeBenchCase(kernel, impl, sized, bench)) {
+                    // Most likely out of memory; larger sizes would fail too.
+                    fprintf(stderr, "%s (%s): cannot run at %dx%d\n", kernel.c_str(), impl.c_str(), side, side);
+                    break;
+                }
+                sweep.points.push_back(RunBenchCase(bench, sizedOptions));
+            }
+            catch (const Halide::Error& e) {
+                fprintf(stderr, "%s (%s) at %dx%d: Halide error: %s\n", kernel.c_str(), impl.c_str(), side, side, e.what());
+            }
+            catch (const std::bad_alloc&) {
+                fprintf(stderr, "%s (%s): out of memory at %dx%d\n", kernel.c_str(), impl.c_str(), side, side);
+                break;
+            }
+        }
+        if (print) {
+            sweep.Print(std::cout, caches);
+        }
+        all.insert(all.end(), sweep.points.begin(), sweep.points.end());
+    }
+    return all;
+}
+
+// Lowest PSNR (dB) any channel of a demosaic may have against the synthetic
+// truth. Bilinear reaches about 25.3 dB on red and blue at 256x192 and a little
+// more on larger images; a wrong layout or a swapped channel falls far below.
+const double kVerifyMinPSNR = 24.0;
+
+// local_statistics of in's mosaic from WindowStatistics queries, as the
+// pipelines' two-channel (mean, variance) output.
+static bool windowStatisticsImage(const BenchInput& in, BenchImage& image) {
+    CTocMatrix<uint16_t> raw;
+    int width = 0, height = 0;
+    if (!loadMosaic(in, raw, width, height)) {
+        return false;
+    }
+    WindowStatistics stats(raw.data(), raw.GetStride(), uint32_t(width), uint32_t(height));
+    image.width = width;
+    image.height = height;
+    image.channels = 2;
+    image.values.resize(size_t(width) * height * 2);
+    double* variances = image.values.data() + size_t(width) * height;
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            size_t at = size_t(y) * width + x;
+            stats.Query(x, y, in.radius, image.values[at], variances[at]);
+        }
+    }
+    return true;
+}
+
+// The rounded 2x2 means box_demosaic must give for in's mosaic, summed in 32
+// bits with the edges repeated.
+static bool exactBoxDemosaic(const BenchInput& in, BenchImage& image) {
+    CTocMatrix<uint16_t> raw;
+    int width = 0, height = 0;
+    if (!loadMosaic(in, raw, width, height)) {
+        return false;
+    }
+    image.width = width;
+    image.height = height;
+    image.channels = 1;
+    image.values.clear();
+    for (int y = 0; y < height; y++) {
+        const uint16_t* row = raw.GetRowPtr(y);
+        const uint16_t* below = raw.GetRowPtr(std::min(y + 1, height - 1));
+        for (int x = 0; x < width; x++) {
+            int right = std::min(x + 1, width - 1);
+            uint32_t sum = uint32_t(row[x]) + row[right] + below[x] + below[right];
+            image.values.push_back(double((sum + 2) / 4));
+        }
+    }
+    return true;
+}
+
+// The bilinear demosaic of in's mosaic, summed in 32 bits, with the edges
+// mirrored as DefineBayerDemosaic() does: what bayer_demosaic must give.
+static bool exactBilinearDemosaic(const BenchInput& in, BenchImage& image) {
+    CTocMatrix<uint16_t> raw;
+    int width = 0, height = 0;
+    if (!loadMosaic(in, raw, width, height)) {
+        return false;
+    }
+    auto at = [&](int x, int y) -> uint32_t {
+        x = x < 0 ? -x : (x >= width ? 2 * width - 2 - x : x);
+        y = y < 0 ? -y : (y >= height ? 2 * height - 2 - y : y);
+        return raw.GetRowPtr(y)[x];
+    };
+    image.width = width;
+    image.height = height;
+    image.channels = 3;
+    image.values.assign(size_t(width) * height * 3, 0.0);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            int dx = (x ^ CfaRedX(in.cfa)) & 1, dy = (y ^ CfaRedY(in.cfa)) & 1;
+            uint32_t across = (at(x - 1, y) + at(x + 1, y) + 1) / 2;
+            uint32_t along = (at(x, y - 1) + at(x, y + 1) + 1) / 2;
+            uint32_t cross = (at(x - 1, y) + at(x + 1, y) + at(x, y - 1) + at(x, y + 1) + 2) / 4;
+            uint32_t diag = (at(x - 1, y - 1) + at(x + 1, y - 1) + at(x - 1, y + 1) + at(x + 1, y + 1) + 2) / 4;
+            uint32_t rgb[3];
+            if (dx == dy) {
+                // Red or blue: green from the four beside it, the other from the corners
+                rgb[1] = cross;
+                rgb[dx ? 2 : 0] = at(x, y);
+                rgb[dx ? 0 : 2] = diag;
+            }
+            else {
+                // Green: on a red row red is left and right, blue above and below
+                rgb[1] = at(x, y);
+                rgb[0] = (dy == 0) ? across : along;
+                rgb[2] = (dy == 0) ? along : across;
+            }
+            for (int c = 0; c < 3; c++) {
+                image.values[(size_t(c) * height + y) * width + x] = rgb[c];
+            }
+        }
+    }
+    return true;
+}
+
+// bayer_demosaic's output without its one-pixel border: the select demosaic
+// has no boundary condition and covers only the interior, where it must
+// interpolate exactly as the per-phase pipeline does.
+static bool bilinearInterior(const BenchInput& in, BenchImage& image) {
+    BenchCase bench;
+    if (!makeBenchCase("bayer_demosaic", "jit", in, bench)) {
+        return false;
+    }
+    bench.phases.compile();
+    bench.phases.execute();
+    BenchImage full = bench.phases.output();
+    image.width = full.width - 2;
+    image.height = full.height - 2;
+    image.channels = full.channels;
+    image.values.clear();
+    for (int c = 0; c < full.channels; c++) {
+        for (int y = 1; y <= image.height; y++) {
+            for (int x = 1; x <= image.width; x++) {
+                image.values.push_back(full(x, y, c));
+            }
+        }
+    }
+    return true;
+}
+
+// Worst difference between two outputs, relative to the first for floats.
+static double maxDifference(const BenchImage& a, const BenchImage& b, bool relative) {
+    double worst = 0.0;
+    for (size_t i = 0; i < a.values.size(); i++) {
+        double diff = std::abs(a.values[i] - b.values[i]);
+        worst = std::max(worst, relative ? diff / std::max(1.0, std::abs(a.values[i])) : diff);
+    }
+    return worst;
+}
+
+// Write rgb (cropped so the last strip and tiles are partial) with every
+// layout and codec on one thread and on all cores, read each file back and
+// compare. Codecs libtiff was built without are skipped. Adds to checks and
+// failures and prints a row per file in verifyKernels()'s table.
+static void verifyTiffWriter(const Buffer<uint16_t>& rgb, int& checks, int& failures) {
+    Buffer<uint16_t> image = rgb.cropped(0, 0, rgb.width() - 3).cropped(1, 0, rgb.height() - 5);
+    std::string name = (std::filesystem::temp_directory_path() / "speedtests-verify.tif").string();
+    const std::pair<const char*, uint16_t> codecs[] = { { "none", COMPRESSION_NONE },
+                                                         { "deflate", COMPRESSION_ADOBE_DEFLATE },
+                                                         { "lzw", COMPRESSION_LZW },
+                                                         { "zstd", COMPRESSION_ZSTD } };
+    for (bool tiled : { false, true }) {
+        for (const auto& codec : codecs) {
+            for (unsigned threads : { 1u, 0u }) {
+                TiffWriteOptions options;
+                options.nCompression = codec.second;
+                options.nRowsPerStrip = tiled ? 0 : 7;
+                options.nTileWidth = options.nTileHeight = tiled ? 48 : 0;
+                options.nThreads = threads;
+                std::string impl = std::string(codec.first) + (threads == 1 ? " x1" : " xN");
+
+                TocErr_t ec = TiffWriteImage(name.c_str(), tiffView(image), options);
+                if (ec == kErrTiff_Codec) {
+                    continue;
+                }
+                std::vector<uint16_t> samples;
+                uint32_t width = 0, height = 0;
+                uint16_t planes = 0;
+                char detail[64];
+                bool ok = false;
+                if (ec != kNoError) {
+                    snprintf(detail, sizeof(detail), "write failed (%d)", int(ec));
+                }
+                else if (!readTiffPlanes(name, samples, width, height, planes)) {
+                    snprintf(detail, sizeof(detail), "read back failed");
+                }
+                else if (int(width) != image.width() || int(height) != image.height() || planes != 3) {
+                    snprintf(detail, sizeof(detail), "read back as %u x %u x %u", width, height, unsigned(planes));
+                }
+                else {
+                    size_t wrong = 0;
+                    image.for_each_element([&](int x, int y, int c) {
+                        wrong += samples[(size_t(c) * height + y) * width + x] != image(x, y, c);
+                    });
+                    ok = (wrong == 0);
+                    if (ok) {
+                        snprintf(detail, sizeof(detail), "read back identical");
+                    }
+                    else {
+                        snprintf(detail, sizeof(detail), "%zu samples differ", wrong);
+                    }
+                }
+                checks++;
+                failures += ok ? 0 : 1;
+                printf("  %-22s %-12s %-14s %-32s %s\n", "tiff_write", tiled ? "tiles" : "strip", impl.c_str(), detail,
+                       ok ? "ok" : "FAIL");
+            }
+        }
+    }
+
+    // Tiles must be multiples of 16; anything else is a parameter error.
+    TiffWriteOptions odd;
+    odd.nTileWidth = odd.nTileHeight = 24;
+    TocErr_t ec = TiffWriteImage(name.c_str(), tiffView(image), odd);
+    bool ok = (ec == kErrSys_BadArg);
+    checks++;
+    failures += ok ? 0 : 1;
+    printf("  %-22s %-12s %-14s %-32s %s\n", "tiff_write", "tiles", "24 x 24", ok ? "rejected as a bad argument" : "not rejected",
+           ok ? "ok" : "FAIL");
+    std::filesystem::remove(name);
+}
+
+// The single-frame jit output for frame f of a distinctFrames batch of in's
+// input: the frame is varied as makeBatchedCase() varies it and run on its own.
+static bool singleFrameOutput(const std::string& kernel, BenchInput in, int f, BenchImage& image) {
+    bool brighten = (kernel == "brighten");
+    std::string name =
+        (std::filesystem::temp_directory_path() / (std::string("speedtests-verify-frame") + (brighten ? ".ppm" : ".pgm")))
+            .string();
+    if (brighten) {
+        Buffer<uint8_t> frame = Tools::load_image(in.filename);
+        frameVariant(frame, f);
+        Tools::save_image(frame, name);
+    }
+    else {
+        CTocMatrix<uint16_t> raw;
+        int width = 0, height = 0;
+        if (!loadMosaic(in, raw, width, height)) {
+            return false;
+        }
+        Buffer<uint16_t> frame = TocMatrixBuffer(raw);
+        frameVariant(frame, f);
+        storeMosaic(frame, name, TiffWriteOptions());
+    }
+    in.filename = name;
+    in.batch = 0;
+    in.distinctFrames = false;
+    BenchCase bench;
+    bool made = makeBenchCase(kernel, "jit", in, bench);
+    if (made) {
+        bench.phases.compile();
+        bench.phases.execute();
+        image = bench.phases.output();
+    }
+    std::filesystem::remove(name);
+    return made;
+}
+
+// Run each batched pipeline on a batch of distinct frames made from in's input
+// and check every output frame against the single-frame JIT output for its
+// input frame, so a pipeline that reads the wrong frame fails. Adds to checks
+// and failures and prints a row per implementation in verifyKernels()'s table.
+static void verifyBatchedFrames(const std::string& kernel, const std::string& caseName, BenchInput in, int batch,
+                                const std::vector<std::string>& impls, int& checks, int& failures) {
+    std::vector<BenchImage> singles(batch);
+    bool made = true;
+    try {
+        for (int f = 0; f < batch && made; f++) {
+            made = singleFrameOutput(kernel, in, f, singles[f]);
+        }
+    }
+    catch (const Halide::Error& e) {
+        made = false;
+        fprintf(stderr, "%s (jit): Halide error: %s\n", kernel.c_str(), e.what());
+    }
+    if (!made) {
+        checks++;
+        failures++;
+        std::string name = "jit x" + std::to_string(batch);
+        printf("  %-22s %-12s %-14s %-32s %s\n", kernel.c_str(), caseName.c_str(), name.c_str(),
+               "no single-frame references", "FAIL");
+        return;
+    }
+    in.batch = batch;
+    in.distinctFrames = true;
+    for (const std::string& impl : impls) {
+        BenchCase bench;
+        std::string error;
+        char detail[64] = "";
+        int wrong = 0, firstWrong = -1;
+        try {
+            if (!makeBenchCase(kernel, impl, in, bench) || !bench.phases.frame) {
+                continue;
+            }
+            bench.phases.compile();
+            bench.phases.execute();
+            for (int f = 0; f < bench.frames; f++) {
+                BenchImage output = bench.phases.frame(f);
+                const BenchImage& single = singles[f];
+                if (output.width != single.width || output.height != single.height ||
+                    output.channels != single.channels || maxDifference(single, output, false) != 0.0) {
+                    wrong++;
+                    firstWrong = (firstWrong < 0) ? f : firstWrong;
+                }
+            }
+        }
+        catch (const Halide::Error& e) {
+            error = e.what();
+        }
+
+        bool ok = error.empty() && wrong == 0;
+        if (!error.empty()) {
+            snprintf(detail, sizeof(detail), "Halide error");
+            fprintf(stderr, "%s (%s, batch %d): Halide error: %s\n", kernel.c_str(), impl.c_str(), batch, error.c_str());
+        }
+        else if (ok) {
+            snprintf(detail, sizeof(detail), "%d distinct frames as jit", bench.frames);
+        }
+        else {
+            snprintf(detail, sizeof(detail), "%d of %d frames differ, first %d", wrong, bench.frames, firstWrong);
+        }
+        checks++;
+        failures += ok ? 0 : 1;
+        std::string name = impl + " x" + std::to_string(batch);
+        printf("  %-22s %-12s %-14s %-32s %s\n", kernel.c_str(), caseName.c_str(), name.c_str(), detail,
+               ok ? "ok" : "FAIL");
+    }
+}
+
+// Run every implementation of each kernel on inputs sampled from a synthetic
+// RGB image and check them against each other: integer outputs bit for bit,
+// local_statistics within a float tolerance. The demosaics run on all four CFA
+// layouts and must also reach kVerifyMinPSNR against the truth; the medians run
+// at 3x3 and 5x5, the sizes with AOT libraries. Every 16-bit kernel also runs on
+// a mosaic near full scale. With --batch the implementations run one frame at a
+// time, and each batched pipeline then runs on distinct frames, each checked
+// against the JIT output for its own input frame. Returns the number of failures.
+int verifyKernels(const BenchInput& in, const std::vector<std::string>& kernels, const std::vector<std::string>& impls) {
+    int width = in.width & ~1, height = in.height & ~1;
+    Buffer<uint16_t> truth = syntheticRGB(width, height);
+    std::filesystem::path dir = std::filesystem::temp_directory_path();
+    std::string rgbName = (dir / "speedtests-verify.ppm").string();
+    Buffer<uint8_t> rgb8(width, height, 3);
+    rgb8.for_each_element([&](int x, int y, int c) { rgb8(x, y, c) = uint8_t(truth(x, y, c) >> 8); });
+    Tools::save_image(rgb8, rgbName);
+
+    printf("Verifying on a %d x %d synthetic image\n", width, height);
+    printf("  %-22s %-12s %-14s %-32s %s\n", "kernel", "case", "impl", "output", "result");
+    int checks = 0, failures = 0;
+    for (const std::string& kernel : kernels) {
+        bool select = (kernel == "bayer_demosaic_select");
+        bool demosaic = (kernel == "bayer_demosaic" || kernel == "bayer_demosaic_mhc");
+        bool median = (kernel == "median" || kernel == "bayer_median");
+        bool rgbInput = (kernel == "median_gate" || kernel == "brighten");
+
+        // The O(1) window queries must agree with the pipelines' maps. The
+        // box and bilinear demosaics are held to exact 32-bit sums, and the
+        // select demosaic, with only a JIT form, to the interior of the
+        // bilinear one; these references run first.
+        std::vector<std::string> kernelImpls = impls;
+        if (kernel == "local_statistics") {
+            kernelImpls.push_back("window");
+        }
+        else if (kernel == "box_demosaic" || kernel == "bayer_demosaic") {
+            kernelImpls.insert(kernelImpls.begin(), "exact");
+        }
+        else if (select) {
+            kernelImpls.insert(kernelImpls.begin(), "bilinear");
+        }
+
+        struct VerifyCase {
+            std::string name;
+            BenchInput input;
+            Buffer<uint16_t> truth;     ///< mosaicked for the input
+            bool psnr;                  ///< demosaics held to kVerifyMinPSNR
+        };
+        std::vector<VerifyCase> cases;
+        BenchInput base = in;
+        base.storeName.clear();
+        base.scheduleDir.clear();
+        base.batch = 0;
+        if (demosaic || select) {
+            for (CfaPattern pattern : kCfaPatterns) {
+                base.cfa = pattern;
+                cases.push_back({ CfaPatternName(pattern), base, truth, demosaic });
+            }
+        }
+        else if (median) {
+            for (int kernelSize : { 3, 5 }) {
+                base.kernelSize = kernelSize;
+                cases.push_back({ std::to_string(kernelSize) + "x" + std::to_string(kernelSize), base, truth, false });
+            }
+        }
+        else {
+            cases.push_back({ "-", base, truth, false });
+        }
+        // Odd and small widths for the hand-written demosaic: below one AVX2
+        // vector of 16 pixels, one past one and two vectors, and one past 1024
+        // vectors, so its vector tail and edge columns meet the pipelines'.
+        // Too small for the PSNR floor, which the edges would dominate.
+        if (kernel == "bayer_demosaic") {
+            const std::pair<int, int> sizes[] = { { 13, 7 }, { 17, 9 }, { 33, 34 }, { 16385, 6 } };
+            for (const auto& size : sizes) {
+                for (CfaPattern pattern : { CfaPattern::RGGB, CfaPattern::GBRG }) {
+                    base.cfa = pattern;
+                    std::string name = std::to_string(size.first) + "x" + std::to_string(size.second);
+                    cases.push_back({ name + " " + CfaPatternName(pattern), base, syntheticRGB(size.first, size.second),
+                                      false });
+                }
+            }
+        }
+        // Near full scale, for the averages' carries. The 8-bit inputs of the
+        // RGB kernels cannot reach it.
+        if (!rgbInput) {
+            base.cfa = CfaPattern::RGGB;
+            cases.push_back({ "bright", base, brightRGB(width, height), false });
+        }
+
+        for (VerifyCase& entry : cases) {
+            BenchInput& caseInput = entry.input;
+            std::string mosaicName = (dir / ("speedtests-verify-" + kernel + ".pgm")).string();
+            if (rgbInput) {
+                caseInput.filename = rgbName;
+            }
+            else {
+                storeMosaic(mosaicOf(entry.truth, (demosaic || select) ? caseInput.cfa : CfaPattern::RGGB), mosaicName,
+                            TiffWriteOptions());
+                caseInput.filename = mosaicName;
+            }
+
+            // The first implementation that runs is the reference for the rest.
+            BenchImage reference;
+            bool jitOk = false;
+            std::string referenceImpl;
+            for (const std::string& impl : kernelImpls) {
+                BenchCase bench;
+                BenchImage output;
+                std::string error;
+                try {
+                    if (impl == "window" || impl == "exact" || impl == "bilinear") {
+                        bool made = (impl == "window")           ? windowStatisticsImage(caseInput, output)
+                                    : (impl == "bilinear")       ? bilinearInterior(caseInput, output)
+                                    : (kernel == "box_demosaic") ? exactBoxDemosaic(caseInput, output)
+                                                                 : exactBilinearDemosaic(caseInput, output);
+                        if (!made) {
+                            continue;
+                        }
+                    }
+                    else if (!makeBenchCase(kernel, impl, caseInput, bench) || !bench.phases.output) {
+                        continue;
+                    }
+                    else {
+                        if (bench.phases.compile) {
+                            bench.phases.compile();
+                        }
+                        bench.phases.execute();
+                        output = bench.phases.output();
+                    }
+                }
+                catch (const Halide::Error& e) {
+                    error = e.what();
+                }
+
+                char detail[64] = "";
+                bool ok = error.empty();
+                if (!ok) {
+                    snprintf(detail, sizeof(detail), "Halide error");
+                    fprintf(stderr, "%s (%s): Halide error: %s\n", kernel.c_str(), impl.c_str(), error.c_str());
+                }
+                else if (referenceImpl.empty()) {
+                    reference = output;
+                    referenceImpl = impl;
+                    snprintf(detail, sizeof(detail), "reference");
+                }
+                else if (output.width != reference.width || output.height != reference.height ||
+                         output.channels != reference.channels) {
+                    ok = false;
+                    snprintf(detail, sizeof(detail), "%d x %d x %d, not as %s", output.width, output.height,
+                             output.channels, referenceImpl.c_str());
+                }
+                else {
+                    bool floats = (kernel == "local_statistics");
+                    double diff = maxDifference(reference, output, floats);
+                    ok = floats ? diff <= 1e-4 : diff == 0.0;
+                    if (diff == 0.0) {
+                        snprintf(detail, sizeof(detail), "identical to %s", referenceImpl.c_str());
+                    }
+                    else {
+                        snprintf(detail, sizeof(detail), "differs from %s by %.3g%s", referenceImpl.c_str(), diff,
+                                 floats ? " rel." : "");
+                    }
+                }
+
+                char psnr[48] = "";
+                if (ok && entry.psnr) {
+                    double r = channelPSNR(output, entry.truth, 0), g = channelPSNR(output, entry.truth, 1),
+                           b = channelPSNR(output, entry.truth, 2);
+                    ok = std::min({ r, g, b }) >= kVerifyMinPSNR;
+                    snprintf(psnr, sizeof(psnr), "  PSNR %.1f %.1f %.1f dB", r, g, b);
+                }
+                checks++;
+                failures += ok ? 0 : 1;
+                printf("  %-22s %-12s %-14s %-32s %s%s\n", kernel.c_str(), entry.name.c_str(), impl.c_str(), detail,
+                       ok ? "ok" : "FAIL", psnr);
+                jitOk = jitOk || (ok && impl == "jit");
+            }
+            if (in.batch > 0 && isBatchedKernel(kernel) && jitOk) {
+                verifyBatchedFrames(kernel, entry.name, caseInput, in.batch, impls, checks, failures);
+            }
+            if (!rgbInput) {
+                std::filesystem::remove(mosaicName);
+            }
+        }
+    }
+    std::filesystem::remove(rgbName);
+    verifyTiffWriter(truth, checks, failures);
+    printf("%d checks, %d failed\n", checks, failures);
+    return failures;
+}
+
+// Run each kernel at 1, 2, 4, ... maxThreads threads, each count in a child
+// speedtests with the same options, and report how it scales against the
+// machine's copy bandwidth at the same thread count.
+void threadScaling(int argc, char** argv, const std::vector<std::string>& kernels, const std::string& impl,
+                   unsigned maxThreads, bool pin) {
+    // Forward every option but those the study sets per child.
+    static const char* kOwnFlags[] = { "--scaling", "--pin" };
+    static const char* kOwnOptions[] = { "--kernel", "--impl", "--format", "--out", "--threads", "--max-threads", "--store" };
+    auto quote = [](const std::string& arg) { return "\"" + arg + "\""; };
+    std::string base = quote(argv[0]);
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (std::find(std::begin(kOwnFlags), std::end(kOwnFlags), arg) != std::end(kOwnFlags)) {
+            continue;
+        }
+        if (std::find(std::begin(kOwnOptions), std::end(kOwnOptions), arg) != std::end(kOwnOptions)) {
+            i++;
+            continue;
+        }
+        base += " " + quote(arg);
+    }
+    base += " --format csv";
+    if (pin) {
+        base += " --pin";
+    }
+
+    std::vector<unsigned> counts = ScalingThreadCounts(maxThreads);
+    std::vector<double> copyBandwidth;
+    for (unsigned threads : counts) {
+        copyBandwidth.push_back(MeasureCopyBandwidth(threads, pin));
+    }
+    printf("Thread scaling up to %u threads%s\n", maxThreads, pin ? ", pinned" : "");
+
+    for (const std::string& kernel : kernels) {
+        ScalingCurve curve;
+        curve.kernel = kernel;
+        curve.impl = impl;
+        for (size_t i = 0; i < counts.size(); i++) {
+            std::string command = base + " --kernel " + kernel + " --impl " + impl + " --threads " + std::to_string(counts[i]);
+            std::vector<BenchResult> results;
+            if (!RunBenchCommand(command, results) || results.empty()) {
+                fprintf(stderr, "%s (%s) at %u threads did not run\n", kernel.c_str(), impl.c_str(), counts[i]);
+                continue;
+            }
+            ScalingPoint point;
+            point.threads = counts[i];
+            point.result = results.front();
+            point.copyGBPerSec = copyBandwidth[i];
+            curve.points.push_back(point);
+        }
+        curve.Analyze();
+        curve.Print(std::cout);
+    }
+}
+
+static void printUsage() {
+    printf("usage: speedtests [options]\n"
+           "  --kernel NAME      kernel to run, or 'all' (default all)\n"
+           "  --impl NAME        jit, aot, hist (histogram median), cpu or scalar (hand-written\n"
+           "                     bayer_demosaic), adams2019, li2018 or mullapudi2016 (JIT with\n"
+           "                     that autoscheduler), schedules (jit and the autoschedulers) or\n"
+           "                     all (default all)\n"
+           "  --input FILE       input image; otherwise a synthetic one is generated\n"
+           "  --size WxH         synthetic input size (default 4096x3072)\n"
+           "  --warmup N         untimed runs before timing (default 2)\n"
+           "  --reps N           timed repetitions (default 10)\n"
+           "  --radius R         box_average and local_statistics radius (default 3)\n"
+           "  --kernel-size N    median and median_gate window width (default 3)\n"
+           "  --cfa PATTERN      rggb, bggr, grbg or gbrg for the demosaics (default: the\n"
+           "                     input's CFAPattern tag, else rggb)\n"
+           "  --estimate WxH     size the autoschedulers tune for (default: the input's size)\n"
+           "  --schedule-dir DIR save each autoscheduled pipeline's schedule in DIR\n"
+           "  --format FMT       table, json or csv (default table)\n"
+           "  --out FILE         write the results to FILE instead of stdout\n"
+           "  --store FILE       write each output to FILE (.tif, .tiff or .pgm) and time it\n"
+           "  --tiff-compression none, deflate, lzw or zstd for --store (default none)\n"
+           "  --tiff-rows N      rows per strip for --store (default about 1 MB per strip)\n"
+           "  --tiff-tile WxH    tiles instead of strips for --store, multiples of 16\n"
+           "  --tiff-threads N   compression threads for --store (default all cores)\n"
+           "  --bigtiff          write BigTIFF for --store (default: only past 4 GB)\n"
+           "  --compare NAME     tiff-readers, tiff-pages, tiff-writers, pgm-loads, bayer,\n"
+           "                     median, cache or tiled (in memory against band by band) on\n"
+           "                     --input, demosaic-quality on a synthetic image of --size, or\n"
+           "                     schedules: --kernel ranked by schedule on --input or --size,\n"
+           "                     or batch: --kernel (default bayer_demosaic) on --input or\n"
+           "                     --size (default 512x512) frames, one per realize against\n"
+           "                     1, 2, 4 ... --batch-max per realize\n"
+           "  --stream DIR|LIST  demosaic every TIFF/PGM frame in DIR (or listed in LIST) with\n"
+           "                     reading, demosaicing and writing overlapped\n"
+           "  --out-dir DIR      where --stream writes its outputs (default: not written)\n"
+           "  --queue-depth N    frames in flight for --stream and bands for --tiled (default 3)\n"
+           "  --tiled FILE       run --kernel (default bayer_demosaic) over --input band by band\n"
+           "                     into FILE, holding at most --memory-budget in memory\n"
+           "  --memory-budget MB memory for --tiled and --compare tiled (default 1024)\n"
+           "  --batch N          realize N copies of the input at once through the batched\n"
+           "                     pipelines (demosaics, medians and brighten; jit and the\n"
+           "                     autoschedulers only)\n"
+           "  --batch-max N      most frames per realize for --compare batch (default 64)\n"
+           "  --profile          compile the JIT pipelines with Halide's profiler and report\n"
+           "                     each stage's time, threads and allocations\n"
+           "  --counters         count cycles, instructions and LLC misses around each timed\n"
+           "                     run (Linux perf events) and report IPC and memory GB/s\n"
+           "  --threads N        worker threads for Halide and the hand-written kernels\n"
+           "                     (default all cores)\n"
+           "  --pin              keep the process on the first --threads cores\n"
+           "  --scaling          run --kernel (default box_average, median, bayer_demosaic and\n"
+           "                     brighten) with --impl (default jit) at 1, 2, 4 ... threads and\n"
+           "                     report speedup, efficiency and where throughput saturates\n"
+           "  --max-threads N    largest thread count for --scaling (default all cores)\n"
+           "  --sweep            run --kernel (default box_average, median, the demosaics and\n"
+           "                     brighten) with --impl (default jit) on square synthetic inputs\n"
+           "                     doubling in pixels from --sweep-min to --sweep-max, and report\n"
+           "                     ns/pixel against the working set and the cache it fits in\n"
+           "  --sweep-min N      smallest side for --sweep (default 64)\n"
+           "  --sweep-max N      largest side for --sweep (default 16384)\n"
+           "  --verify           run every implementation of --kernel on mosaics of a synthetic\n"
+           "                     image of --size, check they agree (and the demosaics' PSNR)\n"
+           "                     and exit nonzero on any failure; with --batch, also check every\n"
+           "                     frame of the batched pipelines, each input frame made distinct,\n"
+           "                     against the single-frame jit on that frame\n"
+           "  --baseline FILE    compare the median times with FILE (CSV from a previous run on\n"
+           "                     this machine) and fail on regressions; written if missing\n"
+           "  --update-baseline  overwrite --baseline with this run's times\n"
+           "  --regression-margin PCT\n"
+           "                     slowdown over --baseline that fails, in percent (default 10)\n"
+           "  --list             list the kernels\n");
+}
+
+int main(int argc, char** argv)
+{
+    BenchInput input;
+    BenchOptions options;
+    BenchFormat format = BenchFormat::Table;
+    std::string kernelName = "all", implName = "all", outName, compareName, streamName, outDir, tiledName;
+    unsigned queueDepth = 3;
+    size_t memoryBudget = size_t(1024) << 20;
+    unsigned maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    bool scaling = false, pin = false, sweep = false;
+    int sweepMin = 64, sweepMax = 16384;
+    bool verify = false, updateBaseline = false;
+    std::string baselineName;
+    double regressionMargin = 0.10;
+    bool cfaGiven = false, sizeGiven = false;
+    int batchMax = 64;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        bool used = true;
+
+        if (arg == "--list") {
+            for (const char* kernel : kBenchKernels) {
+                printf("%s\n", kernel);
+            }
+            return 0;
+        }
+        else if (arg == "--help" || arg == "-h") {
+            printUsage();
+            return 0;
+        }
+        else if (arg == "--bigtiff") {
+            input.tiff.eBigTiff = kTiffBigAlways;
+            continue;
+        }
+        else if (arg == "--scaling") {
+            scaling = true;
+            continue;
+        }
+        else if (arg == "--sweep") {
+            sweep = true;
+            continue;
+        }
+        else if (arg == "--pin") {
+            pin = true;
+            continue;
+        }
+        else if (arg == "--profile") {
+            gProfilePipelines = true;
+            continue;
+        }
+        else if (arg == "--counters") {
+            options.counters = true;
+            continue;
+        }
+        else if (arg == "--verify") {
+            verify = true;
+            continue;
+        }
+        else if (arg == "--update-baseline") {
+            updateBaseline = true;
+            continue;
+        }
+        else if (value == nullptr) {
+            used = false;
+        }
+        else if (arg == "--kernel") {
+            kernelName = value;
+        }
+        else if (arg == "--impl") {
+            implName = value;
+        }
+        else if (arg == "--input") {
+            input.filename = value;
+        }
+        else if (arg == "--size") {
+            used = sscanf(value, "%dx%d", &input.width, &input.height) == 2 && input.width > 2 && input.height > 2;
+            sizeGiven = true;
+        }
+        else if (arg == "--warmup") {
+            options.warmup = atoi(value);
+        }
+        else if (arg == "--reps") {
+            options.reps = std::max(1, atoi(value));
+        }
+        else if (arg == "--radius") {
+            input.radius = atoi(value);
+        }
+        else if (arg == "--kernel-size") {
+            input.kernelSize = atoi(value);
+            used = input.kernelSize > 0;
+        }
+        else if (arg == "--estimate") {
+            used = sscanf(value, "%dx%d", &input.estimateWidth, &input.estimateHeight) == 2 &&
+                   input.estimateWidth > 0 && input.estimateHeight > 0;
+        }
+        else if (arg == "--threads") {
+            input.threads = unsigned(std::max(0, atoi(value)));
+            used = input.threads > 0;
+        }
+        else if (arg == "--max-threads") {
+            maxThreads = unsigned(std::max(0, atoi(value)));
+            used = maxThreads > 0;
+        }
+        else if (arg == "--schedule-dir") {
+            input.scheduleDir = value;
+        }
+        else if (arg == "--cfa") {
+            used = cfaGiven = ParseCfaPattern(value, input.cfa);
+        }
+        else if (arg == "--format") {
+            used = ParseBenchFormat(value, format);
+        }
+        else if (arg == "--out") {
+            outName = value;
+        }
+        else if (arg == "--store") {
+            input.storeName = value;
+        }
+        else if (arg == "--tiff-compression") {
+            std::string codec = value;
+            used = true;
+            if (codec == "none") {
+                input.tiff.nCompression = COMPRESSION_NONE;
+            }
+            else if (codec == "deflate") {
+                input.tiff.nCompression = COMPRESSION_ADOBE_DEFLATE;
+            }
+            else if (codec == "lzw") {
+                input.tiff.nCompression = COMPRESSION_LZW;
+            }
+            else if (codec == "zstd") {
+                input.tiff.nCompression = COMPRESSION_ZSTD;
+            }
+            else {
+                used = false;
+            }
+        }
+        else if (arg == "--tiff-tile") {
+            used = sscanf(value, "%ux%u", &input.tiff.nTileWidth, &input.tiff.nTileHeight) == 2;
+        }
+        else if (arg == "--tiff-rows") {
+            input.tiff.nRowsPerStrip = uint32_t(std::max(0, atoi(value)));
+        }
+        else if (arg == "--tiff-threads") {
+            input.tiff.nThreads = unsigned(std::max(0, atoi(value)));
+        }
+        else if (arg == "--compare") {
+            compareName = value;
+        }
+        else if (arg == "--stream") {
+            streamName = value;
+        }
+        else if (arg == "--out-dir") {
+            outDir = value;
+        }
+        else if (arg == "--queue-depth") {
+            queueDepth = unsigned(std::max(1, atoi(value)));
+        }
+        else if (arg == "--tiled") {
+            tiledName = value;
+        }
+        else if (arg == "--sweep-min") {
+            sweepMin = atoi(value);
+            used = sweepMin >= 16;
+        }
+        else if (arg == "--sweep-max") {
+            sweepMax = atoi(value);
+            used = sweepMax >= 16;
+        }
+        else if (arg == "--baseline") {
+            baselineName = value;
+        }
+        else if (arg == "--regression-margin") {
+            regressionMargin = atof(value) / 100.0;
+            used = regressionMargin > 0.0;
+        }
+        else if (arg == "--batch") {
+            input.batch = atoi(value);
+            used = input.batch > 0;
+        }
+        else if (arg == "--batch-max") {
+            batchMax = atoi(value);
+            used = batchMax > 0;
+        }
+        else if (arg == "--memory-budget") {
+            memoryBudget = size_t(std::max(0.0, atof(value)) * (1 << 20));
+            used = memoryBudget > 0;
+        }
+        else {
+            used = false;
+        }
+
+        if (!used) {
+            fprintf(stderr, "Bad argument: %s\n", arg.c_str());
+            printUsage();
+            return 1;
+        }
+        i++;
+    }
+
+    if (scaling) {
+        std::vector<std::string> kernels = { "box_average", "median", "bayer_demosaic", "brighten" };
+        if (kernelName != "all") {
+            kernels = { kernelName };
+        }
+        threadScaling(argc, argv, kernels, implName == "all" ? "jit" : implName, maxThreads, pin);
+        return 0;
+    }
+
+    // Before any pipeline runs, so the Halide thread pool starts at this size.
+    if (input.threads > 0) {
+        SetWorkerThreads(input.threads);
+    }
+    if (pin && !PinToCores(input.threads ? input.threads : std::thread::hardware_concurrency())) {
+        fprintf(stderr, "Cannot pin threads on this platform\n");
+    }
+
+#ifdef SPEEDTESTS_AOT
+    fprintf(stderr, "AOT kernels: %s variant\n", AotHostIsa());
+#endif
+
+    // Without --cfa, take the layout from the input (or the first frame of a
+    // stream) when it is a TIFF with a CFAPattern tag.
+    if (!cfaGiven) {
+        std::string cfaSource = input.filename;
+        if (!streamName.empty()) {
+            std::vector<std::string> frames = ListStreamFrames(streamName);
+            cfaSource = frames.empty() ? std::string() : frames.front();
+        }
+        TiffSrcFile tiff;
+        if ((hasExtension(cfaSource, ".tif") || hasExtension(cfaSource, ".tiff")) &&
+            tiff.OpenFile(cfaSource.c_str()) == kNoError && tiff.GetCfaPattern(input.cfa)) {
+            fprintf(stderr, "CFA pattern from %s: %s\n", cfaSource.c_str(), CfaPatternName(input.cfa));
+        }
+        tiff.CloseFile();
+    }
+
+    if (!streamName.empty()) {
+        streamDemosaic(streamName, outDir, queueDepth, input.cfa);
+        return 0;
+    }
+
+    // The band-by-band runs take one kernel; 'all' means the demosaic.
+    std::string tiledKernel = (kernelName == "all") ? "bayer_demosaic" : kernelName;
+    if (!tiledName.empty()) {
+        tiledProcess(input, tiledKernel, tiledName, memoryBudget, queueDepth);
+        return 0;
+    }
+
+    if (!compareName.empty()) {
+        if (compareName == "tiff-readers") {
+            compareTiffReaders(input.filename);
+        }
+        else if (compareName == "tiff-writers") {
+            compareTiffWriters(input.filename);
+        }
+        else if (compareName == "tiff-pages") {
+            compareTiffPages(input.filename);
+        }
+        else if (compareName == "pgm-loads") {
+            comparePGMLoads(input.filename);
+        }
+        else if (compareName == "bayer") {
+            compareBayerDemosaic(input.filename);
+        }
+        else if (compareName == "median") {
+            compareMedianFilters(input.filename);
+        }
+        else if (compareName == "demosaic-quality") {
+            compareDemosaicQuality(input.width, input.height);
+        }
+        else if (compareName == "cache") {
+            benchmarkPipelineCache(input.filename);
+        }
+        else if (compareName == "tiled") {
+            compareTiled(input, tiledKernel, memoryBudget, queueDepth);
+        }
+        else if (compareName == "schedules") {
+            std::vector<std::string> kernels(std::begin(kBenchKernels), std::end(kBenchKernels));
+            if (kernelName != "all") {
+                kernels = { kernelName };
+            }
+            compareSchedules(input, options, kernels);
+        }
+        else if (compareName == "batch") {
+            // Small crops are what batching is for.
+            BenchInput crop = input;
+            if (!sizeGiven) {
+                crop.width = crop.height = 512;
+            }
+            compareBatch(crop, options, kernelName == "all" ? "bayer_demosaic" : kernelName,
+                         implName == "all" ? "jit" : implName, batchMax);
+        }
+        else {
+            fprintf(stderr, "Unknown comparison: %s\n", compareName.c_str());
+            return 1;
+        }
+        return 0;
+    }
+
+    std::vector<std::string> kernels, impls;
+    if (kernelName == "all") {
+        kernels.assign(std::begin(kBenchKernels), std::end(kBenchKernels));
+    }
+    else {
+        kernels.push_back(kernelName);
+    }
+    if (implName == "all") {
+        impls = { "jit", "aot", "hist", "cpu", "scalar" };
+    }
+    else if (implName == "schedules") {
+        impls = { "jit" };
+        for (const char* autoscheduler : kAutoschedulers) {
+            impls.push_back(PipelineSchedule{ autoscheduler }.Name());
+        }
+    }
+    else {
+        impls.push_back(implName);
+    }
+
+    if (sweep) {
+        std::vector<std::string> sweepKernels = { "box_average", "median", "bayer_demosaic", "bayer_demosaic_mhc",
+                                                  "brighten" };
+        if (kernelName != "all") {
+            sweepKernels = { kernelName };
+        }
+        std::vector<BenchResult> results = sizeSweep(input, options, sweepKernels, implName == "all" ? "jit" : implName,
+                                                     sweepMin, sweepMax, format == BenchFormat::Table && outName.empty());
+        if (format != BenchFormat::Table || !outName.empty()) {
+            std::ofstream file;
+            if (!outName.empty()) {
+                file.open(outName);
+            }
+            WriteBenchResults(outName.empty() ? std::cout : file, results, format);
+        }
+        return results.empty() ? 1 : 0;
+    }
+
+    int failures = 0;
+    if (verify) {
+        failures = verifyKernels(input, kernels, impls);
+        if (baselineName.empty()) {
+            return failures > 0 ? 1 : 0;
+        }
+    }
+
+    std::vector<BenchResult> results;
+    for (const std::string& kernel : kernels) {
+        for (const std::string& impl : impls) {
+            BenchCase bench;
+            try {
+                if (!makeBenchCase(kernel, impl, input, bench)) {
+                    if (kernelName != "all" && implName != "all") {
+                        fprintf(stderr, "Cannot run %s (%s)\n", kernel.c_str(), impl.c_str());
+                    }
+                    continue;
+                }
+                results.push_back(RunBenchCase(bench, options));
+            }
+            catch (const Halide::Error& e) {
+                fprintf(stderr, "%s (%s): Halide error: %s\n", kernel.c_str(), impl.c_str(), e.what());
+            }
+        }
+    }
+
+    if (outName.empty()) {
+        WriteBenchResults(std::cout, results, format);
+    }
+    else {
+        std::ofstream out(outName);
+        WriteBenchResults(out, results, format);
+    }
+
+    // Without a baseline yet, this run becomes it.
+    if (!baselineName.empty()) {
+        std::vector<BenchResult> baseline;
+        std::ifstream stored(baselineName);
+        if (updateBaseline || !stored || !ReadBenchResultsCsv(stored, baseline)) {
+            stored.close();
+            std::ofstream out(baselineName);
+            WriteBenchResults(out, results, BenchFormat::Csv);
+            printf("Baseline written to %s\n", baselineName.c_str());
+        }
+        else {
+            printf("Against %s (margin %.0f%%):\n", baselineName.c_str(), 100.0 * regressionMargin);
+            int regressions = CompareBenchBaseline(std::cout, results, baseline, regressionMargin);
+            printf("%d of %zu regressed\n", regressions, results.size());
+            failures += regressions;
+        }
+    }
+    return (results.empty() || failures > 0) ? 1 : 0;
 }
@@ -37,8 +37,8 @@ void BayerDemosaicCUDA(const std::string& inputFilename, const std::string& outp
         // Load the PGM image using the PGMImage class
         PGMImage inputImage(inputFilename);
 
-        uint16_t width = inputImage.width();
-        uint16_t height = inputImage.height();
+        uint32_t width = inputImage.width();
+        uint32_t height = inputImage.height();
         uint16_t* raw_data = inputImage.data();
 
         if (!raw_data) {
@@ -49,8 +49,8 @@ void BayerDemosaicCUDA(const std::string& inputFilename, const std::string& outp
         // Allocate device memory
         uint16_t* d_input;
         uint16_t* d_output;
-        size_t inputSize = width * height * sizeof(uint16_t);
-        size_t outputSize = width * height * 3 * sizeof(uint16_t);
+        size_t inputSize = inputImage.size() * sizeof(uint16_t);
+        size_t outputSize = inputImage.size() * 3 * sizeof(uint16_t);
         cudaMalloc(&d_input, inputSize);
         cudaMalloc(&d_output, outputSize);
 